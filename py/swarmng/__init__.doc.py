@@ -45,6 +45,53 @@ def init(cfg): pass
 #   This function is a wrapper for \ref swarm.generate_ensemble. For more details refer to it.
 def generate_ensemble(cfg): pass
 
+##  Integrate an ensemble with several worker processes
+#
+#   @arg @c ens : the initial conditions, a @ref DefaultEnsemble (not modified)
+#   @arg @c cfg : a @ref Config object with the integrator configuration,
+#   `shard_processes` and `destination_time`
+#
+#   Returns a new @ref DefaultEnsemble with the integrated systems. The
+#   worker processes do not run Python code, the interpreter lock is
+#   released during the integration.
+#
+#   This function is a wrapper for \ref swarm.multiprocess_integration. For more details refer to it.
+def integrate_in_processes(ens, cfg): pass
+
+##  Split a binary file into several binary files
+#
+#   @arg @c input : name of the binary file to split
+#   @arg @c outputs : list of the names of the pieces
+#   @arg @c round_robin : if True, system i goes to piece i mod N, otherwise
+#   every piece gets a contiguous range of systems
+#   @arg @c chunked : write the pieces in the chunked binary format
+#
+#   Pieces left without systems are written with only a header.
+#
+#   This function is a wrapper for \ref swarm::snapshot::split. For more details refer to it.
+def split(input, outputs, round_robin = False, chunked = False): pass
+
+##  Merge binary files into one, ordered by system id
+#
+#   @arg @c inputs : list of the names of the pieces, e.g. written by @ref split
+#   @arg @c output : name of the merged binary file
+#   @arg @c chunked : write the output in the chunked binary format
+#
+#   This function is a wrapper for \ref swarm::snapshot::merge. For more details refer to it.
+def merge(inputs, output, chunked = False): pass
+
+##  Integrate all systems of a @ref RaggedEnsemble
+#
+#   @arg @c ens : a @ref RaggedEnsemble, integrated in place
+#   @arg @c cfg : a @ref Config object with the integrator configuration
+#   and `destination_time`
+#
+#   The buckets of all sizes are integrated at once by the CPU worker
+#   threads. The interpreter lock is released during the integration.
+#
+#   This function is a wrapper for \ref swarm.ragged_integration. For more details refer to it.
+def integrate_ragged(ens, cfg): pass
+
 ## Synchronize all CUDA kernels
 #
 # This function is rarely used after 
@@ -237,6 +284,48 @@ class Ensemble:
   #  @endcode
   def __len__(self):pass
 
+  ## @name NumPy views
+  #  The following properties are NumPy arrays that share memory with
+  #  the ensemble, writing to them changes the ensemble directly.
+  #
+  #  The ensemble stores systems in chunks of @ref CHUNK_SIZE, so
+  #  the first two indices of each view are the chunk and the position
+  #  inside the chunk: system @c s is at <tt>[s // CHUNK_SIZE, s % CHUNK_SIZE]</tt>.
+  #  The last chunk may contain padding beyond nsys.
+  #  @{
+
+  ## Positions, array of shape (nchunks, CHUNK_SIZE, nbod, 3)
+  positions = property
+  ## Velocities, array of shape (nchunks, CHUNK_SIZE, nbod, 3)
+  velocities = property
+  ## Masses, array of shape (nchunks, CHUNK_SIZE, nbod)
+  masses = property
+  ## Body attributes, array of shape (nchunks, CHUNK_SIZE, nbod, number of body attributes)
+  body_attributes = property
+  ## Time of the systems, array of shape (nchunks, CHUNK_SIZE)
+  times = property
+  ## State of the systems (int32), array of shape (nchunks, CHUNK_SIZE)
+  states = property
+  ## ID of the systems (int32), array of shape (nchunks, CHUNK_SIZE)
+  ids = property
+  ## System attributes, array of shape (nchunks, CHUNK_SIZE, number of system attributes)
+  system_attributes = property
+  ## @}
+
+  ## Set positions, velocities and masses of all the systems at once
+  #
+  #  @arg @c pos : array-like of shape (nsys, nbod, 3)
+  #  @arg @c vel : array-like of shape (nsys, nbod, 3)
+  #  @arg @c mass: array-like of shape (nsys, nbod)
+  #
+  #  Raises ValueError if the shapes do not match the ensemble.
+  def set_from_arrays(self, pos, vel, mass):pass
+  ## Copy positions, velocities and masses of all the systems into new arrays
+  #
+  #  Returns a tuple (pos, vel, mass) of NumPy arrays with shapes
+  #  (nsys, nbod, 3), (nsys, nbod, 3) and (nsys, nbod).
+  def to_arrays(self):pass
+
 ## The default implementation of ensemble data structor
 # that stores data in system memory.
 class DefaultEnsemble(Ensemble):
@@ -250,6 +339,9 @@ class DefaultEnsemble(Ensemble):
   #  Note that an ensemble is not resizable and all
   #  systems have the same number of bodies.
   def create(number_of_bodies,number_of_systems):pass
+  ## @note load and save functions release the Python interpreter
+  #  lock while accessing the file.
+  #
   ## Save a binary representation of the whole ensemble to a file
   # @arg @c fileName : name of the file to save the contents to
   def save_to_bin(self, fileName):pass
@@ -266,7 +358,48 @@ class DefaultEnsemble(Ensemble):
   #
   #  returns a @ref DefaultEnsemble
   def load_from_bin(fileName):pass
+  ## Save the ensemble arrays as they are in memory (chunked binary format)
+  #
+  #  Chunked files can be read by load_from_bin and map_chunked.
+  # @arg @c fileName : name of the file to save the contents to
+  def save_to_chunked(self, fileName):pass
+  ## @static
+  #  Memory map a chunked binary file and use it as the ensemble
+  #  without copying.
+  #
+  # @arg @c fileName : name of a file written by save_to_chunked
+  # @arg @c writeback : if True, changes to the ensemble are written to the file,
+  #  otherwise the file is left intact.
+  #
+  #  Files with a different chunk size or number of attributes are
+  #  converted and loaded into memory instead.
+  #  returns a @ref DefaultEnsemble
+  def map_chunked(fileName, writeback = False):pass
   
+## Ensemble of systems with different numbers of bodies
+#
+# Systems with the same number of bodies are stored together in a
+# bucket, which is a @ref DefaultEnsemble. Systems keep the index they
+# were created with.
+class RaggedEnsemble:
+  ## @static
+  #  Create an ensemble where system i has number_of_bodies[i] bodies
+  #
+  #  @arg @c number_of_bodies : a list with the number of bodies of every system
+  def create(number_of_bodies):pass
+  ## Number of systems
+  nsys = property
+  ## Number of buckets
+  bucket_count = property
+  ## System i, a @ref System
+  def __getitem__(self, i):pass
+  ## Number of bodies of system i
+  def nbod_of(self, i):pass
+  ## Bucket k, a @ref DefaultEnsemble that shares the memory of the bucket
+  def bucket(self, k):pass
+  ## Number of bodies of the systems in bucket k
+  def bucket_nbod(self, k):pass
+
 ## An ODE integration algorithms
 #
 # The different implementations of ODE integration methods
@@ -290,7 +423,23 @@ class Integrator:
   #  For more information refer to \ref swarm.integrator.create
   def create(cfg):pass
   ## Run the integration up to the specified @ref destination_time
+  #
+  #  The Python interpreter lock is released during the integration
+  #  so other Python threads can run concurrently.
   def integrate(self):pass
+  ## Run the integration in a background thread
+  #
+  #  Returns an @ref AsyncIntegration handle immediately. The ensemble
+  #  should not be accessed until the integration is finished.
+  def integrate_async(self):pass
+
+## Handle to an integration started with @ref Integrator.integrate_async
+class AsyncIntegration:
+  ## True if the integration is finished (does not block)
+  done = property
+  ## Block until the integration is finished. If the integration
+  #  failed, a RuntimeError is raised with the error message.
+  def wait(self):pass
   
 ## GPU accelerated integrator
 #
@@ -308,12 +457,52 @@ class GpuIntegrator(Integrator):
   def create(cfg):pass
   ## The default integrate method updates the GPU ensemble
   # every time. The core_integrate just launches the kernel.
+  # Both release the Python interpreter lock while running.
   def core_integrate(self):pass
   ## Update the ensemble in system memory from GPU ensemble
   def download_ensemble(self):pass
   ## Update the GPU ensemble from the ensemble in system memory.
   def upload_ensemble(self):pass
   
+## Number of systems stored side by side in one chunk of the ensemble
+#  memory, c.f. the NumPy views in @ref Ensemble
+CHUNK_SIZE = 16
+
+## Read-only access to a BDB log file generated by the bdb_writer plugin.
+#
+#  This is a fast C++ alternative to @ref swarmng.logdb.IndexedLogDB. Every
+#  query returns a single NumPy structured array of type @ref log_record_dtype,
+#  with one row per body: a snapshot (event 1) produces nbod rows, an ejection
+#  (event 2) one row, a radial velocity observation (event 11) one row with
+#  the velocity of the star along the line of sight in vz, and any other
+#  event one row with body = -1 and NaN coordinates.
+#
+#  Usage:
+#  @code{.py}
+#  >>> db = swarmng.LogDB('mydatabase.db')
+#  >>> r = db.time_range(0, 10)
+#  >>> r[r['body'] == 1]['x']
+#  @endcode
+class LogDB:
+  ## Open the log file at path @c fileName for reading
+  def __init__(self, fileName):pass
+  ## Get meta data from the database for the provided @c name string.
+  def metadata(self, name):pass
+  ## All records with t0 <= time <= t1, sorted by time then system id
+  def time_range(self, t0, t1):pass
+  ## All records with s0 <= system id <= s1, sorted by system id then time
+  def system_range(self, s0, s1):pass
+  ## All records of one event type, sorted by time then system id
+  def event_records(self, event_id):pass
+  ## Close the log file, the object cannot be used afterwards.
+  def close(self):pass
+
+## NumPy dtype of the arrays returned by @ref LogDB queries.
+#
+#  Fields are time, x, y, z, vx, vy, vz, mass (float64)
+#  and sys, event, state, body (int32).
+def log_record_dtype():pass
+
 ## Compare two ensembles and find the maximum of energy
 # conservation error amongst systems.
 #
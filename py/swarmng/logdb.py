@@ -174,6 +174,9 @@ def iter_secondary_cursor(c, mode = DB_NEXT):
 # >>> print(next(records))
 # @endcode
 #
+# For large queries consider swarmng.LogDB that runs the queries in C++
+# and returns NumPy arrays instead of one Python object per record.
+#
 # Note that most of the methods below return key-value pairs. The 
 # key-value pair is a Python tuple where the first element is of type \ref PKey
 # and has time, system_id, event_id properties. the second element is a \ref swarmng.logrecord.LogRecord "LogRecord" 
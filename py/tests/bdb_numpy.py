@@ -0,0 +1,62 @@
+#!/usr/bin/env python2
+# -*- coding: utf8 -*-
+
+## @file bdb_numpy.py Testing that the C++ log reader agrees with swarmng.logdb
+#
+# A log file is generated with the bdb writer and queried with both
+# swarmng.LogDB (NumPy structured arrays) and swarmng.logdb.IndexedLogDB.
+
+import swarmng
+import swarmng.logdb
+import os
+import unittest
+
+class BDBNumpyTest(unittest.TestCase):
+  output_file_name = 'Testing/testing_numpy_log.db'
+  nsys = 16
+  nbod = 3
+
+  def setUp(self):
+    try:
+      os.remove(self.output_file_name)
+    except OSError:
+      pass
+    cfg = swarmng.config(
+      nsys=self.nsys,
+      nbod=self.nbod,
+      log_writer='bdb',
+      log_output_db=self.output_file_name,
+      log_interval=1,
+      integrator='hermite_cpu_log',
+      time_step=0.01,
+      nogpu=1
+    )
+    swarmng.init(cfg)
+    integ = swarmng.Integrator.create( cfg )
+    integ.ensemble = swarmng.generate_ensemble( cfg )
+    integ.destination_time = 10
+    integ.integrate()
+    del integ
+
+  def runTest(self):
+    db = swarmng.LogDB(self.output_file_name)
+    ref = swarmng.logdb.IndexedLogDB(self.output_file_name)
+
+    r = db.time_range(0, 5)
+    records = [ (k, l) for k, l in ref.time_range_records((0, 5)) if k.event_id == 1 ]
+    snapshots = r[r['event'] == 1]
+    self.assertEqual(len(snapshots), len(records) * self.nbod)
+    for i, (k, l) in enumerate(records):
+      row = snapshots[i * self.nbod]
+      self.assertEqual(row['sys'], k.system_id)
+      self.assertAlmostEqual(row['time'], l.time)
+      self.assertEqual(row['x'], l.bodies[0].position[0])
+
+    s = db.system_range(2, 3)
+    self.assertTrue(((s['sys'] >= 2) & (s['sys'] <= 3)).all())
+    self.assertEqual(len(s[s['time'] <= 5]), len(r[(r['sys'] >= 2) & (r['sys'] <= 3)]))
+
+    e = db.event_records(1)
+    self.assertTrue((e['event'] == 1).all())
+    self.assertTrue((e['time'][1:] >= e['time'][:-1]).all())
+    db.close()
@@ -59,3 +59,148 @@ class CollisionCourseTest(abstract.IntegrationTest):
     
     
     
+
+class MceStatCollisionCourseTest(abstract.IntegrationTest):
+  """Two planets on the same orbit in opposite directions, the CPU
+  close encounter statistics monitor detects their collision within a step"""
+
+  cfg = swarmng.config(
+    integrator="hermite_cpu_mce_stat",
+    time_step=0.01,
+    destination_time=2,
+    deactivate_on_close_encounter=1,
+    log_on_close_encounter=1
+    )
+  destination_time = 2
+
+  def createEnsemble(self):
+    ens = swarmng.DefaultEnsemble.create(3,16)
+    for i,s in enumerate(ens):
+      s.id = i
+      s.time = 0
+      s.set_active()
+      phi = uniform(0,2*pi)
+      for j,b in enumerate(s):
+        b.attributes[0] = 0.005
+        if(j == 0):
+          b.pos = [0, 0, 0]
+          b.vel = [0, 0, 0]
+          b.mass = 1.0
+        else:
+          b.mass = 1e-6
+          b.pos = sphericalToCartesian(1.0, phi + (j-1)*pi)
+          b.vel = sphericalToCartesian((-1)**j, phi + (j-1)*pi + pi/2)
+    return ens
+
+  def examine(self):
+    for s in self.ens:
+      self.assertEqual(s.state, -1)
+      self.assertLess(s.time, pi/2 + 0.02)
+
+
+class MceStatEncounterCountTest(unittest.TestCase):
+  """Two light planets on neighbouring orbits in opposite directions pass
+  each other every (2k+1)π/w, w being the sum of their mean motions. The
+  CPU close encounter statistics monitor counts every passage once in a
+  system attribute, whether the integration runs in one launch or several"""
+
+  cfg = swarmng.config(
+    integrator="hermite_cpu_mce_stat",
+    time_step=0.01,
+    rceh=100,
+    mce_encounter_count_attribute=0
+    )
+  destination_time = 20
+  radius = [ 1.0, 1.02 ]
+
+  def createEnsemble(self):
+    ens = swarmng.DefaultEnsemble.create(3,4)
+    for i,s in enumerate(ens):
+      s.id = i
+      s.time = 0
+      s.set_active()
+      s.attributes[0] = 0
+      phi = uniform(0,2*pi)
+      for j,b in enumerate(s):
+        b.attributes[0] = 0
+        if(j == 0):
+          b.pos = [0, 0, 0]
+          b.vel = [0, 0, 0]
+          b.mass = 1.0
+        else:
+          r = self.radius[j-1]
+          b.mass = 1e-9
+          b.pos = sphericalToCartesian(r, phi + (j-1)*pi)
+          b.vel = sphericalToCartesian((-1)**(j-1)/sqrt(r), phi + (j-1)*pi + pi/2)
+    return ens
+
+  def integrate(self, launches):
+    integ = swarmng.Integrator.create( self.cfg )
+    ens = self.createEnsemble()
+    integ.ensemble = ens
+    for k in range(1, launches + 1):
+      integ.destination_time = self.destination_time * float(k) / launches
+      integ.integrate()
+    return [ s.attributes[0] for s in ens ]
+
+  def runTest(self):
+    swarmng.init(self.cfg)
+    w = sum([ r**-1.5 for r in self.radius ])
+    expected = len([ k for k in range(100) if (2*k+1)*pi/w <= self.destination_time ])
+    for launches in [ 1, 7 ]:
+      for count in self.integrate(launches):
+        self.assertEqual(count, expected)
+
+
+class CloseEncounterInStepTest(unittest.TestCase):
+  """Two planets on neighbouring orbits in opposite directions pass each
+  other at t = π/w, in the middle of a step: at both ends of the step they
+  are farther apart than close_approach. The close encounter monitor
+  finds the passage only from the minimum distance during the step"""
+
+  options = dict(
+    integrator="hermite_cpu_ejection_or_close_encounter",
+    time_step=0.1,
+    close_approach=2,
+    deactivate_on_close_encounter=1
+    )
+  cfg = swarmng.config(options)
+  destination_time = 2
+  radius = [ 1.0, 1.005 ]
+
+  def createEnsemble(self):
+    ens = swarmng.DefaultEnsemble.create(3,4)
+    for i,s in enumerate(ens):
+      s.id = i
+      s.time = 0
+      s.set_active()
+      for j,b in enumerate(s):
+        if(j == 0):
+          b.pos = [0, 0, 0]
+          b.vel = [0, 0, 0]
+          b.mass = 1.0
+        else:
+          r = self.radius[j-1]
+          b.mass = 1e-6
+          b.pos = sphericalToCartesian(r, (j-1)*pi)
+          b.vel = sphericalToCartesian((-1)**(j-1)/sqrt(r), (j-1)*pi + pi/2)
+    return ens
+
+  def integrate(self, interpolate):
+    cfg = swarmng.config(self.options, interpolate_close_encounters=interpolate)
+    integ = swarmng.Integrator.create( cfg )
+    ens = self.createEnsemble()
+    integ.ensemble = ens
+    integ.destination_time = self.destination_time
+    integ.integrate()
+    return ens
+
+  def runTest(self):
+    swarmng.init(self.cfg)
+    passage = pi / sum([ r**-1.5 for r in self.radius ])
+    for s in self.integrate(1):
+      self.assertEqual(s.state, -1)
+      self.assertGreater(s.time, passage)
+      self.assertLess(s.time, passage + self.options["time_step"])
+    for s in self.integrate(0):
+      self.assertNotEqual(s.state, -1)
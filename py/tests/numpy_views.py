@@ -0,0 +1,49 @@
+#!/usr/bin/env python2
+# -*- coding: utf8 -*-
+## @file numpy_views.py Testing NumPy views and bulk array access of ensembles
+#
+#  The views share memory with the ensemble, so writing through a view
+#  must be visible through the regular accessors and vice versa.
+from common import *
+import numpy
+
+class NumpyViewsTest(unittest.TestCase):
+    nsys = 37
+    nbod = 3
+
+    def setUp(self):
+        self.ens = swarmng.DefaultEnsemble.create(self.nbod, self.nsys)
+        self.pos = numpy.random.rand(self.nsys, self.nbod, 3)
+        self.vel = numpy.random.rand(self.nsys, self.nbod, 3)
+        self.mass = numpy.random.rand(self.nsys, self.nbod)
+        self.ens.set_from_arrays(self.pos, self.vel, self.mass)
+
+    def test_roundtrip(self):
+        pos, vel, mass = self.ens.to_arrays()
+        self.assertTrue((pos == self.pos).all())
+        self.assertTrue((vel == self.vel).all())
+        self.assertTrue((mass == self.mass).all())
+
+    def test_views_match_accessors(self):
+        C = swarmng.CHUNK_SIZE
+        p = self.ens.positions
+        v = self.ens.velocities
+        m = self.ens.masses
+        for i in range(0, self.nsys):
+            for j in range(0, self.nbod):
+                self.assertEqual(list(p[i // C, i % C, j]), self.ens[i][j].pos)
+                self.assertEqual(list(v[i // C, i % C, j]), self.ens[i][j].vel)
+                self.assertEqual(m[i // C, i % C, j], self.ens[i][j].mass)
+
+    def test_views_are_writable(self):
+        C = swarmng.CHUNK_SIZE
+        self.ens.times[:] = 5.0
+        self.ens.ids[2 // C, 2 % C] = 42
+        self.ens.positions[1 // C, 1 % C, 2, 0] = 7.0
+        self.assertEqual(self.ens[0].time, 5.0)
+        self.assertEqual(self.ens[2].id, 42)
+        self.assertEqual(self.ens[1][2].pos[0], 7.0)
+
+    def test_wrong_shape(self):
+        self.assertRaises(ValueError, self.ens.set_from_arrays,
+                self.pos[1:], self.vel, self.mass)
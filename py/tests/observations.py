@@ -0,0 +1,104 @@
+#!/usr/bin/env python2
+# -*- coding: utf8 -*-
+
+## @file observations.py Testing the CPU transit and radial velocity monitors
+#
+# A planet on a circular orbit seen edge-on, in the x-z plane, so that the
+# observer looking down the z axis sees it transit the star. The logged
+# transit times and radial velocities are compared with the analytic orbit.
+
+import swarmng
+import os
+import unittest
+from math import *
+
+star_mass = 1.0
+planet_mass = 1e-3
+# Mean motion of a circular orbit of radius 1
+mean_motion = sqrt(star_mass + planet_mass)
+
+def edge_on_orbit():
+  ens = swarmng.DefaultEnsemble.create(2, 4)
+  for i, s in enumerate(ens):
+    s.id = i
+    s.time = 0
+    s.set_active()
+    f = planet_mass / (star_mass + planet_mass)
+    s[0].mass, s[1].mass = star_mass, planet_mass
+    # Radii of the star and the planet
+    s[0].attributes[0], s[1].attributes[0] = 0.005, 0.001
+    # Barycentric positions and velocities of the relative orbit (1, 0, 0), (0, 0, n)
+    s[0].pos, s[0].vel = [ -f, 0, 0 ], [ 0, 0, -f * mean_motion ]
+    s[1].pos, s[1].vel = [ 1 - f, 0, 0 ], [ 0, 0, (1 - f) * mean_motion ]
+  return ens
+
+class abstract:
+  class ObservationTest(unittest.TestCase):
+    output_file_name = None
+    cfg = None
+    destination_time = 4 * pi
+
+    def setUp(self):
+      try:
+        os.remove(self.output_file_name)
+      except OSError:
+        pass
+      self.cfg['log_writer'] = 'bdb'
+      self.cfg['log_output_db'] = self.output_file_name
+      swarmng.init(self.cfg)
+      integ = swarmng.Integrator.create( self.cfg )
+      integ.ensemble = edge_on_orbit()
+      integ.destination_time = self.destination_time
+      integ.integrate()
+      del integ
+
+class TransitTimingTest(abstract.ObservationTest):
+  output_file_name = 'Testing/testing_transit_log.db'
+  cfg = swarmng.config(
+      integrator = 'hermite_cpu_transit',
+      time_step  = 0.01,
+      nogpu      = 1,
+      log_transit_tol = 1e-10,
+      num_max_transit_iter = 4
+      )
+
+  def runTest(self):
+    db = swarmng.LogDB(self.output_file_name)
+    # The planet is in front of the star (z > 0) at n t = pi/2 mod 2 pi
+    expected = [ (pi/2 + 2*pi*k) / mean_motion for k in range(0, 2) ]
+    transits = db.event_records(15)
+    self.assertEqual(len(transits), 4 * len(expected))
+    for sys in range(0, 4):
+      times = sorted(transits[transits['sys'] == sys]['time'])
+      for t, e in zip(times, expected):
+        self.assertLess(abs(t - e), 1e-8)
+    db.close()
+
+class RadialVelocityTest(abstract.ObservationTest):
+  output_file_name = 'Testing/testing_rvs_log.db'
+  rv_file_name = 'Testing/testing_rv.in'
+  # Observations in the middle of the steps, not at their ends
+  rv_times = [ 0.123, 1.0, 2.3456, 5.5, 7.77, 12.3 ]
+  cfg = swarmng.config(
+      integrator = 'hermite_cpu_rvs',
+      time_step  = 0.05,
+      nogpu      = 1,
+      rv_filename = rv_file_name
+      )
+
+  def setUp(self):
+    with open(self.rv_file_name, 'w') as f:
+      for t in self.rv_times:
+        f.write("{0}\n".format(t))
+    abstract.ObservationTest.setUp(self)
+
+  def runTest(self):
+    db = swarmng.LogDB(self.output_file_name)
+    rvs = db.event_records(11)
+    self.assertEqual(len(rvs), 4 * len(self.rv_times))
+    f = planet_mass / (star_mass + planet_mass)
+    for r in rvs:
+      self.assertTrue(min(abs(r['time'] - t) for t in self.rv_times) < 1e-12)
+      expected = -f * mean_motion * cos(mean_motion * r['time'])
+      self.assertLess(abs(r['vz'] - expected), 1e-9)
+    db.close()
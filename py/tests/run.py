@@ -12,7 +12,11 @@ sys.path.append(dirname(dirname(realpath(__file__))))
 from trivial import *
 #from parabolic_collision import ParabolicTest
 from bdb_concurrent import BDBConcurrencyTest
+from numpy_views import NumpyViewsTest
+from bdb_numpy import BDBNumpyTest
+from observations import TransitTimingTest, RadialVelocityTest
 #from collision_course import CollisionCourseTest
+from collision_course import MceStatCollisionCourseTest, MceStatEncounterCountTest, CloseEncounterInStepTest
 
 if __name__ == '__main__':
 	unittest.main()
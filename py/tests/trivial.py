@@ -1,6 +1,7 @@
 #!/usr/bin/env python2
 # -*- coding: utf8 -*-
 from common import *
+from os import remove
 ## @file trivial.py Trivial unit tests that basic features work.
 #
 #  Testing the monitor stop_on_ejection, some planets are put in orbits
@@ -55,6 +56,74 @@ class BasicIntegration(abstract.IntegrationTest):
         max_deltaE = swarmng.find_max_energy_conservation_error( self.ens, self.ref)
         self.assertLess(max_deltaE, 1e-13)
 
+class HybridCloseEncounterTest(abstract.IntegrationTest):
+    cfg = swarmng.config(
+            integrator = 'hybrid_cpu',
+            time_step  = 1e-2,
+            nogpu      = 1
+            )
+    def createEnsemble(self):
+        return make_test_case(nsys = 16, nbod = 3, spacing_factor=1.05, seed = 4)
+    def examine(self):
+        max_deltaE = swarmng.find_max_energy_conservation_error( self.ens, self.ref)
+        self.assertLess(max_deltaE, 1e-6)
+
+class MvsHermiteAgreementTest(unittest.TestCase):
+    """mvs_cpu follows hermite_cpu with a much smaller time step. The kick
+    of mvs_cpu used to include the star and the coordinate conversions
+    carried their sums from one component to the next, both of which
+    take the planets far off."""
+    cfg = swarmng.config( nogpu = 1 )
+    def runTest(self):
+        swarmng.init(self.cfg)
+        ref = make_test_case(nsys = 8, nbod = 3, spacing_factor=1.4, seed = 5)
+        ens_hermite = ref.clone()
+        ens_mvs = ref.clone()
+        for ens, integrator, time_step in [ (ens_hermite, 'hermite_cpu', 1e-4), (ens_mvs, 'mvs_cpu', 1e-2) ]:
+            integ = create_integrator( self, swarmng.config(nogpu = 1, integrator = integrator, time_step = time_step) )
+            integ.ensemble = ens
+            integ.destination_time = 10.0
+            integ.integrate()
+        for i in range(0, ref.nsys):
+            for j in range(0, ref.nbod):
+                self.assertLess(norm([ a - b for a, b in zip(ens_hermite[i][j].pos, ens_mvs[i][j].pos) ]), 1e-5)
+
+def integrate_mvs(ref, destination_time = 10.0, **options):
+    """Integrate a clone of ref with mvs_cpu configured with options"""
+    ens = ref.clone()
+    integ = swarmng.Integrator.create( swarmng.config(nogpu = 1, integrator = 'mvs_cpu', **options) )
+    integ.ensemble = ens
+    integ.destination_time = destination_time
+    integ.integrate()
+    return ens
+
+def max_position_difference(ens1, ens2):
+    return max(norm([ a - b for a, b in zip(ens1[i][j].pos, ens2[i][j].pos) ])
+            for i in range(0, ens1.nsys) for j in range(0, ens1.nbod))
+
+class MvsCorrectorTest(unittest.TestCase):
+    """The symplectic corrector of third order (mvs_corrector = 3) removes
+    the leading energy error of the second-order mvs_cpu step"""
+    def runTest(self):
+        swarmng.init(swarmng.config(nogpu = 1))
+        create_integrator(self, swarmng.config(nogpu = 1, integrator = 'mvs_cpu', time_step = 0.05))
+        ref = make_test_case(nsys = 8, nbod = 3, spacing_factor=1.4, seed = 5)
+        deltaE = [ swarmng.find_max_energy_conservation_error(integrate_mvs(ref, time_step = 0.05, mvs_corrector = n), ref)
+                for n in [ 0, 3 ] ]
+        self.assertLess(deltaE[1], deltaE[0] / 10)
+
+class MvsFourthOrderTest(unittest.TestCase):
+    """Halving the step of mvs_cpu with mvs_order = 4 divides the error by
+    16: the differences between the results at h, h/2 and h/4 shrink by 2^4"""
+    def runTest(self):
+        swarmng.init(swarmng.config(nogpu = 1))
+        create_integrator(self, swarmng.config(nogpu = 1, integrator = 'mvs_cpu', time_step = 0.05))
+        ref = make_test_case(nsys = 8, nbod = 3, spacing_factor=1.4, seed = 5)
+        ens = [ integrate_mvs(ref, time_step = h, mvs_order = 4) for h in [ 0.05, 0.025, 0.0125 ] ]
+        ratio = max_position_difference(ens[0], ens[1]) / max_position_difference(ens[1], ens[2])
+        self.assertGreater(log(ratio, 2), 3.5)
+        self.assertLess(log(ratio, 2), 4.5)
+
 ## This test depends on how many attributes are configured
 ## it is always going to fail if someone changes number of attributes
 #class InitialConditions(unittest.TestCase):
@@ -89,3 +158,224 @@ class EjectionTest(abstract.IntegrationTest):
 
 
 
+
+
+class ConservationTrackingTest(abstract.IntegrationTest):
+    # A large step, so that the energy error is well above round-off
+    cfg = swarmng.config(
+            integrator = 'hermite_cpu',
+            time_step  = 5e-2,
+            nogpu      = 1,
+            track_energy_attribute = 0
+            )
+    def createEnsemble(self):
+        return make_test_case(nsys = 16, nbod = 3, spacing_factor=1.4)
+    def examine(self):
+        for i in range(0, self.ens.nsys):
+            E0 = self.ref[i].total_energy
+            deltaE = abs((self.ens[i].total_energy - E0) / E0)
+            self.assertGreater(deltaE, 1e-12)
+            self.assertLess(abs(self.ens[i].attributes[0] - deltaE), 1e-5 * deltaE)
+
+class HybridConservationTrackingTest(ConservationTrackingTest):
+    cfg = swarmng.config(
+            integrator = 'hybrid_cpu',
+            time_step  = 5e-2,
+            nogpu      = 1,
+            track_energy_attribute = 0
+            )
+
+class RaggedIntegrationTest(unittest.TestCase):
+    cfg = swarmng.config(
+            integrator = 'hermite_cpu',
+            time_step  = 1e-4,
+            nogpu      = 1,
+            destination_time = 1.0
+            )
+    def runTest(self):
+        swarmng.init(self.cfg)
+        parts = [ make_test_case(nsys = 5, nbod = n, spacing_factor=1.4, seed = n) for n in [3, 4, 6] ]
+        ragged = swarmng.RaggedEnsemble.create([ p.nbod for p in parts for i in range(0, p.nsys) ])
+        self.assertEqual(ragged.bucket_count, 3)
+        k = 0
+        for p in parts:
+            for s in p:
+                r = ragged[k]
+                r.id, r.time, r.state = s.id, s.time, s.state
+                for j in range(0, p.nbod):
+                    r[j].pos, r[j].vel, r[j].mass = s[j].pos, s[j].vel, s[j].mass
+                k += 1
+        swarmng.integrate_ragged(ragged, self.cfg)
+        k = 0
+        for p in parts:
+            integ = swarmng.Integrator.create( self.cfg )
+            integ.ensemble = p
+            integ.destination_time = 1.0
+            integ.integrate()
+            for s in p:
+                self.assertEqual(ragged.nbod_of(k), p.nbod)
+                self.assertEqual(ragged[k].time, s.time)
+                for j in range(0, p.nbod):
+                    self.assertEqual(ragged[k][j].pos, s[j].pos)
+                k += 1
+
+class AsyncIntegrationTest(unittest.TestCase):
+    cfg = BasicIntegration.cfg
+    def runTest(self):
+        swarmng.init(self.cfg)
+        ref = make_test_case(nsys = 16, nbod = 3, spacing_factor=1.4, seed = 1)
+        ens_sync = ref.clone()
+        ens_async = ref.clone()
+        for ens in [ ens_sync, ens_async ]:
+            integ = swarmng.Integrator.create( self.cfg )
+            integ.ensemble = ens
+            integ.destination_time = 1.0
+            if ens is ens_sync:
+                integ.integrate()
+            else:
+                handle = integ.integrate_async()
+                handle.wait()
+                self.assertTrue(handle.done)
+        for i in range(0, ref.nsys):
+            for j in range(0, ref.nbod):
+                self.assertEqual(ens_sync[i][j].pos, ens_async[i][j].pos)
+
+class abstract_test_particles:
+    class TestParticleIntegrationTest(unittest.TestCase):
+        """Massless bodies at the end of a system are integrated as test
+        particles, their orbits match those of bodies with tiny masses"""
+        cfg = None
+        def runTest(self):
+            swarmng.init(self.cfg)
+            ref = make_test_case(nsys = 8, nbod = 6, spacing_factor=1.4, seed = 5)
+            for s in ref:
+                for j in range(3, ref.nbod):
+                    s[j].mass = 0
+            ens_test = ref.clone()
+            ens_massive = ref.clone()
+            # Tiny masses take the bodies out of the test particle mode
+            for s in ens_massive:
+                for j in range(3, ref.nbod):
+                    s[j].mass = 1e-300
+            for ens in [ ens_test, ens_massive ]:
+                integ = create_integrator( self, self.cfg )
+                integ.ensemble = ens
+                integ.destination_time = 1.0
+                integ.integrate()
+            for i in range(0, ref.nsys):
+                for j in range(0, ref.nbod):
+                    self.assertLess(norm([ a - b for a, b in zip(ens_test[i][j].pos, ens_massive[i][j].pos) ]), 1e-10)
+
+class TestParticleIntegrationTest(abstract_test_particles.TestParticleIntegrationTest):
+    cfg = BasicIntegration.cfg
+
+class TestParticleIRK2IntegrationTest(abstract_test_particles.TestParticleIntegrationTest):
+    cfg = swarmng.config( integrator = 'irk2_cpu', time_step = 1e-3, nogpu = 1 )
+
+class TestParticleMVSIntegrationTest(abstract_test_particles.TestParticleIntegrationTest):
+    cfg = swarmng.config( integrator = 'mvs_cpu', time_step = 1e-3, nogpu = 1 )
+
+class MultiprocessIntegrationTest(unittest.TestCase):
+    cfg = swarmng.config(
+            integrator = 'hermite_cpu',
+            time_step  = 1e-4,
+            nogpu      = 1,
+            destination_time = 1.0,
+            shard_processes  = 3
+            )
+    def runTest(self):
+        swarmng.init(self.cfg)
+        ref = make_test_case(nsys = 40, nbod = 3, spacing_factor=1.4, seed = 3)
+        ens = ref.clone()
+        integ = swarmng.Integrator.create( self.cfg )
+        integ.ensemble = ens
+        integ.destination_time = 1.0
+        integ.integrate()
+        shared = swarmng.integrate_in_processes(ref, self.cfg)
+        for i in range(0, ref.nsys):
+            self.assertEqual(shared[i].id, ens[i].id)
+            self.assertEqual(shared[i].time, ens[i].time)
+            for j in range(0, ref.nbod):
+                self.assertEqual(shared[i][j].pos, ens[i][j].pos)
+
+class ChunkedSnapshotTest(unittest.TestCase):
+    def runTest(self):
+        ref = make_test_case(nsys = 13, nbod = 3, spacing_factor=1.4, seed = 2)
+        fn = path.join(TESTDIR, "chunked_test.bin")
+        ref.save_to_chunked(fn)
+        for ens in [ swarmng.DefaultEnsemble.load_from_bin(fn), swarmng.DefaultEnsemble.map_chunked(fn) ]:
+            self.assertEqual(ens.nsys, ref.nsys)
+            for i in range(0, ref.nsys):
+                self.assertEqual(ens[i].id, ref[i].id)
+                for j in range(0, ref.nbod):
+                    self.assertEqual(ens[i][j].pos, ref[i][j].pos)
+                    self.assertEqual(ens[i][j].vel, ref[i][j].vel)
+                    self.assertEqual(ens[i][j].mass, ref[i][j].mass)
+
+class SplitMergeTest(unittest.TestCase):
+    def runTest(self):
+        ref = make_test_case(nsys = 5, nbod = 3, spacing_factor=1.4, seed = 4)
+        fn = path.join(TESTDIR, "split_test.bin")
+        ref.save_to_bin(fn)
+        # More pieces than systems, some pieces are left empty
+        pieces = [ "{0}.{1}".format(fn, k) for k in range(0, 7) ]
+        for round_robin in [ False, True ]:
+            for chunked in [ False, True ]:
+                swarmng.split(fn, pieces, round_robin, chunked)
+                self.assertEqual(sum(swarmng.DefaultEnsemble.load_from_bin(p).nsys for p in pieces), ref.nsys)
+                merged = fn + ".merged"
+                swarmng.merge(pieces, merged, chunked)
+                ens = swarmng.DefaultEnsemble.load_from_bin(merged)
+                self.assertEqual(ens.nsys, ref.nsys)
+                for i in range(0, ref.nsys):
+                    self.assertEqual(ens[i].id, ref[i].id)
+                    for j in range(0, ref.nbod):
+                        self.assertEqual(ens[i][j].pos, ref[i][j].pos)
+                        self.assertEqual(ens[i][j].vel, ref[i][j].vel)
+                        self.assertEqual(ens[i][j].mass, ref[i][j].mass)
+
+class CowCloneTest(unittest.TestCase):
+    """Writes through another copy of the source, here the one held by
+    the integrator, stay in the source and do not reach the clone"""
+    cfg = BasicIntegration.cfg
+    def runTest(self):
+        swarmng.init(self.cfg)
+        ens = make_test_case(nsys = 16, nbod = 3, spacing_factor=1.4, seed = 7)
+        ref = ens.clone()
+        integ = swarmng.Integrator.create( self.cfg )
+        integ.ensemble = ens
+        integ.destination_time = 1.0
+        cow = ens.cow_clone()
+        integ.integrate()
+        for i in range(0, ref.nsys):
+            self.assertEqual(ens[i].time, integ.ensemble[i].time)
+            self.assertEqual(cow[i].time, ref[i].time)
+            self.assertNotEqual(ens[i].time, ref[i].time)
+            for j in range(0, ref.nbod):
+                self.assertEqual(ens[i][j].pos, integ.ensemble[i][j].pos)
+                self.assertEqual(cow[i][j].pos, ref[i][j].pos)
+
+class CheckpointWallIntervalTest(unittest.TestCase):
+    """With both intervals set, the wall-clock interval writes checkpoints
+    between two multiples of a checkpoint_interval that is never reached"""
+    def runTest(self):
+        fn = path.join(TESTDIR, "checkpoint_test.bin")
+        if path.exists(fn): remove(fn)
+        cfg = swarmng.config(
+                integrator = 'hermite_cpu',
+                time_step  = 1e-4,
+                nogpu      = 1,
+                checkpoint_file = fn,
+                checkpoint_interval = 100,
+                checkpoint_wall_interval = 1e-9
+                )
+        swarmng.init(cfg)
+        integ = swarmng.Integrator.create( cfg )
+        integ.ensemble = make_test_case(nsys = 8, nbod = 3, spacing_factor=1.4, seed = 3)
+        integ.destination_time = 1.0
+        integ.integrate()
+        ens = swarmng.DefaultEnsemble.load_from_bin(fn)
+        self.assertEqual(ens.nsys, 8)
+        for s in ens:
+            self.assertGreater(s.time, 0)
+            self.assertLess(s.time, 1.0)
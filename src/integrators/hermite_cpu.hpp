@@ -22,14 +22,14 @@
  *
  */
 
-#ifdef _OPENMP
-#include <omp.h>
-#endif
-
-
 #include "swarm/common.hpp"
 #include "swarm/integrator.hpp"
 #include "swarm/plugin.hpp"
+#include "swarm/runtime.hpp"
+#include "swarm/gravitation_cpu.hpp"
+#include "swarm/dense_output.hpp"
+#include "swarm/step_geometry.hpp"
+#include "monitors/cpu_monitor.hpp"
 
 namespace swarm { namespace cpu {
 /*! CPU implementation of PEC2 Hermite integrator
@@ -45,7 +45,8 @@ namespace swarm { namespace cpu {
 template< class Monitor >
 class hermite_cpu : public integrator {
 	typedef integrator base;
-	typedef Monitor monitor_t;
+	//! The CPU variant of Monitor, if there is one
+	typedef typename monitors::cpu_monitor<Monitor>::type monitor_t;
 	typedef typename monitor_t::params mon_params_t;
 	private:
 	double _time_step;
@@ -57,73 +58,67 @@ public:  //! Construct for hermite_cpu class
 	}
 
 	virtual void launch_integrator() {
-		#ifdef _OPENMP
-		#pragma omp parallel for
-		#endif
-		for(int i = 0; i < _ens.nsys(); i++){
-			integrate_system(_ens[i]);
-		}
+		runtime::instance().integrate_systems(*this, _ens);
 	}
 
+	virtual runtime::task* create_system_task() {
+		return new runtime::system_task<hermite_cpu>(*this, _ens);
+	}
+
+	virtual bool tracks_conservation() const { return true; }
+
         //! defines inner product of two arrays
 	inline static double inner_product(const double a[3],const double b[3]){
 		return a[0]*b[0]+a[1]*b[1]+a[2]*b[2];
 	}
 
-        //! Calculate the force field. 
-	void calcForces(ensemble::SystemRef& sys, double acc[][3],double jerk[][3]){
-		const int nbod = sys.nbod();
-
-		/// Clear acc and jerk
-		for(int b = 0; b < nbod; b++)	for(int c =0; c < 3; c++) 
-			acc[b][c] = 0, jerk[b][c] = 0;
-
-		/// Loop through all pairs
-		for(int i=0; i < nbod-1; i++) for(int j = i+1; j < nbod; j++) {
-
-			double dx[3] = { sys[j][0].pos()-sys[i][0].pos(),
-				sys[j][1].pos()-sys[i][1].pos(),
-				sys[j][2].pos()-sys[i][2].pos()
-			};
-			double dv[3] = { sys[j][0].vel()-sys[i][0].vel(),
-				sys[j][1].vel()-sys[i][1].vel(),
-				sys[j][2].vel()-sys[i][2].vel()
-			};
-
-			/// Calculated the magnitude
-			double r2 = dx[0]*dx[0] + dx[1]*dx[1] + dx[2] * dx[2];
-			double rinv = 1 / ( sqrt(r2) * r2 ) ;
-			double rv =  inner_product(dx,dv) * 3. / r2;
-
-			/// Update acc/jerk for i
-			const double scalar_i = +rinv*sys[j].mass();
-			for(int c = 0; c < 3; c++) {
-				acc[i][c] += dx[c]* scalar_i;
-				jerk[i][c] += (dv[c] - dx[c] * rv) * scalar_i;
-			}
-
-			/// Update acc/jerk for j
-			const double scalar_j = -rinv*sys[i].mass();
-			for(int c = 0; c < 3; c++) {
-				acc[j][c] += dx[c]* scalar_j;
-				jerk[j][c] += (dv[c] - dx[c] * rv) * scalar_j;
-			}
-		}
+        //! Calculate the force field
+	void calcForces(ensemble::SystemRef& sys, double acc[][3],double jerk[][3], test_particle_block* block = 0){
+		calc_acc_jerk(sys, acc, jerk, block);
 	}
 
         //! Integrate ensembles
-	void integrate_system(ensemble::SystemRef sys){
+	void integrate_system(ensemble::SystemRef sys, scratch_arena& scratch){
 		const int nbod = sys.nbod();
-		double pre_pos[nbod][3];
-		double pre_vel[nbod][3];
-		double acc0[nbod][3];
-		double acc1[nbod][3];
-		double jerk0[nbod][3];
-		double jerk1[nbod][3];
+		double (*pre_pos)[3] = scratch.alloc<double[3]>(nbod);
+		double (*pre_vel)[3] = scratch.alloc<double[3]>(nbod);
+		double (*acc0)[3] = scratch.alloc<double[3]>(nbod);
+		double (*acc1)[3] = scratch.alloc<double[3]>(nbod);
+		double (*jerk0)[3] = scratch.alloc<double[3]>(nbod);
+		double (*jerk1)[3] = scratch.alloc<double[3]>(nbod);
+
+		// Test particles, if there are any, are streamed from a block of their own
+		test_particle_block test_particles, *block = 0;
+		if( massive_body_count(sys) < nbod ) {
+			test_particles.alloc(scratch, nbod);
+			block = &test_particles;
+		}
 
-		calcForces(sys,acc0,jerk0);
+		calcForces(sys,acc0,jerk0,block);
 
 		monitor_t montest (_mon_params,sys,*_log);
+		monitors::set_scratch_arena(montest, scratch);
+
+		// Dense output for monitors that use it, from the values at both ends of the step
+		const bool dense = monitors::accepts_step_interpolant<monitor_t>::value;
+		double (*start_pos)[3] = 0, (*start_vel)[3] = 0, (*start_acc)[3] = 0, (*end_pos)[3] = 0, (*end_vel)[3] = 0;
+		step_interpolant interp;
+		if( dense ) {
+			start_pos = scratch.alloc<double[3]>(nbod), start_vel = scratch.alloc<double[3]>(nbod);
+			start_acc = scratch.alloc<double[3]>(nbod);
+			end_pos = scratch.alloc<double[3]>(nbod), end_vel = scratch.alloc<double[3]>(nbod);
+			interp.pos0 = start_pos, interp.vel0 = start_vel, interp.acc0 = start_acc;
+			interp.pos1 = end_pos, interp.vel1 = end_vel, interp.acc1 = acc0;
+			monitors::set_step_interpolant(montest, &interp);
+		}
+
+		// Distances and speeds for the monitors, computed at most once per step when a monitor reads them
+		const bool shared_geometry = monitors::accepts_step_geometry<monitor_t>::value;
+		step_geometry geom;
+		if( shared_geometry ) {
+			geom.alloc(scratch, nbod);
+			monitors::set_step_geometry(montest, &geom);
+		}
 
 
 		for(int iter = 0 ; (iter < _max_iterations) && sys.is_active() ; iter ++ ) {
@@ -133,6 +128,12 @@ public:  //! Construct for hermite_cpu class
 				h = _destination_time - sys.time();
 			}
 
+			if( dense ) {
+				for(int b = 0; b < nbod; b++) for(int c =0; c < 3; c++)
+					start_pos[b][c] = sys[b][c].pos(), start_vel[b][c] = sys[b][c].vel(), start_acc[b][c] = acc0[b][c];
+				interp.t0 = sys.time(), interp.h = h;
+			}
+
 			/// Predict
 			for(int b = 0; b < nbod; b++)	for(int c =0; c < 3; c++) {
 					sys[b][c].pos() += h * (sys[b][c].vel()+h*0.5*(acc0[b][c]+h/3*jerk0[b][c]));
@@ -145,7 +146,7 @@ public:  //! Construct for hermite_cpu class
 
 			///Integrate, Round one
 			{
-				calcForces(sys,acc1,jerk1);
+				calcForces(sys,acc1,jerk1,block);
 
 				// Correct
 				for(int b = 0; b < nbod; b++)	for(int c =0; c < 3; c++) {
@@ -161,7 +162,7 @@ public:  //! Construct for hermite_cpu class
 
 			/// Integrate, Round two
 			{
-				calcForces(sys,acc1,jerk1);
+				calcForces(sys,acc1,jerk1,block);
 
 				// Correct
 				for(int b = 0; b < nbod; b++)	for(int c =0; c < 3; c++) {
@@ -179,6 +180,16 @@ public:  //! Construct for hermite_cpu class
 				acc0[b][c] = acc1[b][c], jerk0[b][c] = jerk1[b][c];
 			
 			sys.time() += h;
+
+			if( dense ) {
+				for(int b = 0; b < nbod; b++) for(int c =0; c < 3; c++)
+					end_pos[b][c] = sys[b][c].pos(), end_vel[b][c] = sys[b][c].vel();
+			}
+
+			// The last force evaluation was at the positions of round one,
+			// the potential energy is evaluated again at the final positions
+			if( _conservation.enabled() )
+				_conservation.update(sys);
 //                         if (sys.time() >= 1)
 //                         {
 //                           printf("System at time:%.12f, iter = %d\n", sys.time(), iter);
@@ -188,6 +199,7 @@ public:  //! Construct for hermite_cpu class
 //                         }
 
 			if( sys.is_active() )  {
+				if( shared_geometry ) geom.reset(sys);
 				montest(0);
 				if( sys.time() > _destination_time - 1e-12 ) 
 					sys.set_inactive();
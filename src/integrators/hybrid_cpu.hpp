@@ -0,0 +1,437 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file hybrid_cpu.hpp
+ *   \brief Defines and implements \ref swarm::cpu::hybrid_cpu class - the CPU
+ *          implementation of a hybrid symplectic integrator that handles
+ *          close encounters, in the style of the hybrid scheme of MERCURY.
+ *
+ */
+
+#ifndef H_HYBRID_CPU
+#define H_HYBRID_CPU
+
+#include "mvs_cpu.hpp"
+
+namespace swarm { namespace cpu {
+
+/*! CPU implementation of a hybrid symplectic integrator: template<class Monitor>
+ *
+ * \ingroup integrators
+ *
+ *   *EXPERIMENTAL*: This class is not thoroughly tested.
+ *
+ *   Away from close encounters this is the mixed variables symplectic
+ *   integrator \ref mvs_cpu: drift, kick, Kepler drift about the star, kick,
+ *   drift, in heliocentric positions and barycentric velocities.
+ *
+ *   As in MERCURY (Chambers 1999), the interaction of every pair of planets
+ *   is split with the changeover function K(r), which is 1 beyond the
+ *   changeover distance rc and falls smoothly to 0 within 0.1 rc. The kicks
+ *   only apply the part K(r) of the interaction. After the Kepler drift of
+ *   all planets, the pairs that could have come within rc during the step
+ *   are found from the cubic interpolant of their separation. The planets of
+ *   these pairs are taken back to the beginning of the drift and integrated
+ *   together over the step with the force of the star and the remaining part
+ *   1-K(r) of their interactions, by an adaptive Runge-Kutta-Cash-Karp
+ *   integrator. A close pair is therefore integrated as accurately as
+ *   the tolerance asks for, and the other planets at symplectic speed.
+ *
+ *   The changeover distance of a planet is the larger of hybrid_changeover
+ *   Hill radii and 0.4 times the distance it travels in a step, as in
+ *   MERCURY, and for a pair the larger of the two. It is computed from the
+ *   osculating orbits at the beginning of every call to integrate.
+ *
+ */
+template< class Monitor >
+class hybrid_cpu : public mvs_cpu<Monitor> {
+	typedef mvs_cpu<Monitor> base;
+	typedef typename base::monitor_t monitor_t;
+	private:
+	//! Changeover distance in Hill radii
+	double _changeover;
+	//! Relative error allowed in every substep of the encounter integration
+	double _tolerance;
+
+public:  //! Construct for class hybrid_cpu
+	hybrid_cpu(const config& cfg): base(cfg) {
+		_changeover = cfg.optional("hybrid_changeover", 3.0);
+		_tolerance = cfg.optional("hybrid_tolerance", 1e-12);
+		if(_changeover <= 0) ERROR("hybrid_changeover should be positive");
+		if(_tolerance <= 0) ERROR("hybrid_tolerance should be positive");
+		if(base::_substep_count > 1 || base::_corrector_count > 0)
+			ERROR("hybrid_cpu does not support mvs_order and mvs_corrector");
+	}
+
+	virtual void launch_integrator() {
+		runtime::instance().integrate_systems(*this, base::_ens);
+	}
+
+	virtual runtime::task* create_system_task() {
+		return new runtime::system_task<hybrid_cpu>(*this, base::_ens);
+	}
+
+	virtual bool tracks_conservation() const { return true; }
+
+	//! Changeover function K(r) for the changeover distance rc and its derivative dK/dr
+	static void changeover(const double& r, const double& rc, double& K, double& dK) {
+		const double y = (r - 0.1 * rc) / (0.9 * rc);
+		if(y <= 0)
+			K = 0, dK = 0;
+		else if(y >= 1)
+			K = 1, dK = 0;
+		else {
+			K = y*y*y*(10 + y*(-15 + 6*y));
+			dK = 30*y*y*(1-y)*(1-y) / (0.9 * rc);
+		}
+	}
+
+	//! Changeover distance of every planet, from the standard coordinates
+	void calc_changeover_radii(ensemble::SystemRef sys, const double& h, double* rc) {
+		const int nbod = sys.nbod();
+		const double m0 = sys[0].mass();
+		rc[0] = 0;
+		for(int b = 1; b < nbod; b++) {
+			double dx[3], dv[3];
+			for(int c = 0; c < 3; c++)
+				dx[c] = sys[b][c].pos() - sys[0][c].pos(), dv[c] = sys[b][c].vel() - sys[0][c].vel();
+			const double r = sqrt(base::inner_product(dx,dx)), v2 = base::inner_product(dv,dv);
+			const double inv_a = 2./r - v2 / (m0 + sys[b].mass());
+			const double a = (inv_a > 0) ? 1./inv_a : r;
+			const double rhill = a * pow(sys[b].mass() / (3.*m0), 1./3.);
+			rc[b] = std::max(_changeover * rhill, 0.4 * h * sqrt(v2));
+		}
+	}
+
+	//! Part K(r) of the forces between the planets, used by the kicks
+	void calc_far_forces(ensemble::SystemRef& sys, const double* rc, double acc[][3]) {
+		const int nbod = sys.nbod();
+		for(int b = 0; b < nbod; b++) for(int c = 0; c < 3; c++)
+			acc[b][c] = 0.;
+
+		for(int i = 1; i < nbod-1; i++) for(int j = i+1; j < nbod; j++) {
+			double dx[3] = { sys[j][0].pos()-sys[i][0].pos(),
+				sys[j][1].pos()-sys[i][1].pos(),
+				sys[j][2].pos()-sys[i][2].pos()
+			};
+			const double r2 = base::inner_product(dx,dx), r = sqrt(r2);
+			const double rcij = std::max(rc[i], rc[j]);
+			double scalar = 1. / (r * r2);
+			if(r < rcij) {
+				double K, dK;
+				changeover(r, rcij, K, dK);
+				scalar = (K / r2 - dK / r) / r;
+			}
+			for(int c = 0; c < 3; c++) {
+				acc[i][c] += dx[c] * scalar * sys[j].mass();
+				acc[j][c] -= dx[c] * scalar * sys[i].mass();
+			}
+		}
+	}
+
+	/*! Accelerations of the n planets in group with the positions pos, from
+	 *  the star and the part 1-K(r) of the forces between them
+	 */
+	void calc_close_forces(ensemble::SystemRef& sys, const double* rc, const int* group, const int& n, double pos[][3], double acc[][3]) {
+		const double m0 = sys[0].mass();
+		for(int k = 0; k < n; k++) {
+			const double r2 = base::inner_product(pos[k],pos[k]);
+			const double scalar = -m0 / (sqrt(r2) * r2);
+			for(int c = 0; c < 3; c++)
+				acc[k][c] = pos[k][c] * scalar;
+		}
+
+		for(int k = 0; k < n-1; k++) for(int l = k+1; l < n; l++) {
+			const int i = group[k], j = group[l];
+			const double rcij = std::max(rc[i], rc[j]);
+			double dx[3] = { pos[l][0]-pos[k][0], pos[l][1]-pos[k][1], pos[l][2]-pos[k][2] };
+			const double r2 = base::inner_product(dx,dx);
+			if(r2 >= rcij * rcij) continue;
+			const double r = sqrt(r2);
+			double K, dK;
+			changeover(r, rcij, K, dK);
+			const double scalar = ((1 - K) / r2 + dK / r) / r;
+			for(int c = 0; c < 3; c++) {
+				acc[k][c] += dx[c] * scalar * sys[j].mass();
+				acc[l][c] -= dx[c] * scalar * sys[i].mass();
+			}
+		}
+	}
+
+	/*! Integrate the n planets in group over the time h with the force of
+	 *  the star and the part 1-K(r) of their interactions, starting from
+	 *  the positions and velocities in sys. dt is the substep to try first,
+	 *  it is updated to the next one.
+	 */
+	void integrate_encounter(ensemble::SystemRef& sys, const double* rc, const int* group, const int& n, const double& h, double& dt, scratch_arena& scratch) {
+		// Cash-Karp coefficients, c.f. rkck_integrator.hpp
+		static const double a[6][5] = { { 0 }, { 1.0 / 5.0 }, { 3.0 / 40.0, 9.0 / 40.0 }, { 0.3, -0.9, 1.2 },
+			{ -11.0 / 54.0, 2.5, -70.0 / 27.0, 35.0 / 27.0 },
+			{ 1631.0 / 55296.0, 175.0 / 512.0, 575.0 / 13824.0, 44275.0 / 110592.0, 253.0 / 4096.0 } };
+		static const double b[6] = { 37.0 / 378.0, 0, 250.0 / 621.0, 125.0 / 594.0, 0 , 512.0 / 1771.0 };
+		static const double e[6] = { 37.0 / 378.0 - 2825.0 / 27648.0, 0.0, 250.0 / 621.0 - 18575.0 / 48384.0,
+			125.0 / 594.0 - 13525.0 / 55296.0, -277.00 / 14336.0, 512.0 / 1771.0 - 0.25 };
+		const int order = 5;
+
+		const scratch_arena::marker m = scratch.mark();
+		double (*pos)[3] = scratch.alloc<double[3]>(n), (*vel)[3] = scratch.alloc<double[3]>(n);
+		double (*stage_pos)[3] = scratch.alloc<double[3]>(n);
+		double (*k_vel[6])[3], (*k_acc[6])[3];
+		for(int s = 0; s < 6; s++)
+			k_vel[s] = scratch.alloc<double[3]>(n), k_acc[s] = scratch.alloc<double[3]>(n);
+
+		for(int k = 0; k < n; k++) for(int c = 0; c < 3; c++)
+			pos[k][c] = sys[group[k]][c].pos(), vel[k][c] = sys[group[k]][c].vel();
+
+		// Accept any substep this short, so that a collision cannot stall the integration
+		const double dt_min = 1e-9 * h;
+		double t = 0;
+		while(t < h) {
+			const bool last = (dt >= h - t);
+			const double step = last ? h - t : dt;
+
+			for(int s = 0; s < 6; s++) {
+				for(int k = 0; k < n; k++) for(int c = 0; c < 3; c++) {
+					double dp = 0, dv = 0;
+					for(int l = 0; l < s; l++)
+						dp += a[s][l] * k_vel[l][k][c], dv += a[s][l] * k_acc[l][k][c];
+					stage_pos[k][c] = pos[k][c] + step * dp;
+					k_vel[s][k][c] = vel[k][c] + step * dv;
+				}
+				calc_close_forces(sys, rc, group, n, stage_pos, k_acc[s]);
+			}
+
+			// Largest relative error of the positions and velocities
+			double max_error = 0;
+			for(int k = 0; k < n; k++) {
+				double pos_error[3], vel_error[3], new_pos[3], new_vel[3];
+				for(int c = 0; c < 3; c++) {
+					double dp = 0, dv = 0, ep = 0, ev = 0;
+					for(int s = 0; s < 6; s++) {
+						dp += b[s] * k_vel[s][k][c], dv += b[s] * k_acc[s][k][c];
+						ep += e[s] * k_vel[s][k][c], ev += e[s] * k_acc[s][k][c];
+					}
+					new_pos[c] = pos[k][c] + step * dp, new_vel[c] = vel[k][c] + step * dv;
+					pos_error[c] = step * ep, vel_error[c] = step * ev;
+				}
+				const double pe = base::inner_product(pos_error,pos_error) / base::inner_product(new_pos,new_pos);
+				const double ve = base::inner_product(vel_error,vel_error) / base::inner_product(new_vel,new_vel);
+				max_error = std::max(max_error, std::max(pe, ve));
+			}
+			const double normalized_error = sqrt(max_error) / _tolerance;
+			const bool accept = (normalized_error <= 1.) || (step <= dt_min);
+
+			if(accept) {
+				for(int k = 0; k < n; k++) for(int c = 0; c < 3; c++) {
+					double dp = 0, dv = 0;
+					for(int s = 0; s < 6; s++)
+						dp += b[s] * k_vel[s][k][c], dv += b[s] * k_acc[s][k][c];
+					pos[k][c] += step * dp, vel[k][c] += step * dv;
+				}
+				t = last ? h : t + step;
+			}
+
+			// Next substep, at most five times longer or shorter
+			double factor = (normalized_error > 0) ? 0.9 * pow(normalized_error, -1./order) : 5.;
+			factor = std::min(std::max(factor, 0.2), 5.);
+			// The last substep of the step was cut short, do not take it as a guess
+			if(!(accept && last && factor >= 1.))
+				dt = std::max(step * factor, dt_min);
+		}
+
+		for(int k = 0; k < n; k++) for(int c = 0; c < 3; c++)
+			sys[group[k]][c].pos() = pos[k][c], sys[group[k]][c].vel() = vel[k][c];
+		scratch.release(m);
+	}
+
+	//! Integrating a system
+	void integrate_system(ensemble::SystemRef sys, scratch_arena& scratch){
+		const int nbod = sys.nbod();
+		double (*acc)[3] = scratch.alloc<double[3]>(nbod);
+		double *rc = scratch.alloc<double>(nbod), *dmin = scratch.alloc<double>(nbod);
+		int *in_encounter = scratch.alloc<int>(nbod), *group = scratch.alloc<int>(nbod);
+
+		// Positions and velocities before the Kepler drift, to find and integrate the encounters
+		double (*drift_pos[2])[3], (*drift_vel[2])[3];
+		for(int k = 0; k < 2; k++)
+			drift_pos[k] = scratch.alloc<double[3]>(nbod), drift_vel[k] = scratch.alloc<double[3]>(nbod);
+		step_interpolant drift;
+		drift.pos0 = drift_pos[0], drift.vel0 = drift_vel[0], drift.pos1 = drift_pos[1], drift.vel1 = drift_vel[1];
+		drift.acc0 = drift.acc1 = 0;
+
+		// Setting up Monitor
+		monitor_t montest(base::_mon_params,sys,*base::_log) ;
+		monitors::set_scratch_arena(montest, scratch);
+
+		// Dense output for monitors that use it, cubic in the standard coordinates at both ends of the step
+		const bool dense = monitors::accepts_step_interpolant<monitor_t>::value;
+		double (*std_pos[2])[3] = { 0, 0 }, (*std_vel[2])[3] = { 0, 0 }, (*tmp_pos)[3] = 0, (*tmp_vel)[3] = 0;
+		step_interpolant interp;
+		if( dense ) {
+		  for(int k = 0; k < 2; k++)
+		    std_pos[k] = scratch.alloc<double[3]>(nbod), std_vel[k] = scratch.alloc<double[3]>(nbod);
+		  tmp_pos = scratch.alloc<double[3]>(nbod), tmp_vel = scratch.alloc<double[3]>(nbod);
+		  for(int b=0;b<nbod;++b) for(int c=0;c<3;++c)
+		    std_pos[1][b][c] = sys[b][c].pos(), std_vel[1][b][c] = sys[b][c].vel();
+		  interp.acc0 = interp.acc1 = 0;
+		  monitors::set_step_interpolant(montest, &interp);
+		}
+
+		// Distances and speeds for the monitors, computed at most once per step when a monitor reads them
+		const bool shared_geometry = monitors::accepts_step_geometry<monitor_t>::value;
+		step_geometry geom;
+		if( shared_geometry ) {
+		  geom.alloc(scratch, nbod);
+		  monitors::set_step_geometry(montest, &geom);
+		}
+
+		// Internal coordinates, kept while the conservation tracker reads the standard ones
+		const bool track = base::_conservation.enabled();
+		double (*saved_pos)[3] = 0, (*saved_vel)[3] = 0;
+		if( track )
+		  saved_pos = scratch.alloc<double[3]>(nbod), saved_vel = scratch.alloc<double[3]>(nbod);
+
+		// begin init();
+		const double sqrtGM = sqrt(sys[0].mass());
+		calc_changeover_radii(sys, base::_time_step, rc);
+		base::convert_std_to_helio_pos_bary_vel_coord(sys);
+		calc_far_forces(sys,rc,acc);
+		double encounter_dt = base::_time_step;
+		// end init()
+
+		for(int iter = 0 ; (iter < base::_max_iterations) && sys.is_active() ; iter ++ )
+		  {
+
+		// begin advance();
+		    double hby2 = 0.5 * std::min( base::_destination_time - sys.time() ,  base::_time_step );
+
+		// Step 1
+		base::drift_step(sys,hby2);
+
+		// Step 2: Kick Step
+		for(int b=1;b<nbod;++b)
+		  for(int c=0;c<3;++c)
+		    sys[b][c].vel() += hby2 * acc[b][c];
+
+		// 3: Kepler Drift Step (Keplerian orbit about sun/central body)
+		for(int b=0;b<nbod;++b) for(int c=0;c<3;++c)
+		  drift_pos[0][b][c] = sys[b][c].pos(), drift_vel[0][b][c] = sys[b][c].vel();
+		for(int b=1;b<nbod;++b)
+		  this->drift_kepler( sys[b][0].pos(),sys[b][1].pos(),sys[b][2].pos(),sys[b][0].vel(),sys[b][1].vel(),sys[b][2].vel(),sqrtGM, 2.0*hby2 );
+
+		// Pairs of planets that could have come within the changeover distance during the drift
+		for(int b=0;b<nbod;++b) for(int c=0;c<3;++c)
+		  drift_pos[1][b][c] = sys[b][c].pos(), drift_vel[1][b][c] = sys[b][c].vel();
+		drift.t0 = sys.time(), drift.h = 2.0*hby2;
+		int n_encounter = 0;
+		for(int b=0;b<nbod;++b) in_encounter[b] = 0;
+		for(int i=2;i<nbod;++i)
+		  {
+		    drift.min_distances(i, dmin);
+		    for(int j=1;j<i;++j)
+		      if( dmin[j] < std::max(rc[i],rc[j]) )
+			in_encounter[i] = in_encounter[j] = 1;
+		  }
+
+		// Integrate the planets in encounters over the drift again
+		for(int b=1;b<nbod;++b)
+		  if( in_encounter[b] )
+		    {
+		      group[n_encounter++] = b;
+		      for(int c=0;c<3;++c)
+			sys[b][c].pos() = drift_pos[0][b][c], sys[b][c].vel() = drift_vel[0][b][c];
+		    }
+		if( n_encounter > 0 )
+		  integrate_encounter(sys, rc, group, n_encounter, 2.0*hby2, encounter_dt, scratch);
+
+		calc_far_forces(sys,rc,acc);
+
+		// Step 4: Kick Step
+		for(int b=1;b<nbod;++b)
+		  for(int c=0;c<3;++c)
+		    sys[b][c].vel() += hby2 * acc[b][c];
+
+		// Step 5
+		base::drift_step(sys,hby2);
+
+		interp.t0 = sys.time(), interp.h = 2.0*hby2;
+		sys.time() += 2.0*hby2;
+
+		// end advance
+
+		// The errors are evaluated in the standard coordinates, the internal ones are restored exactly
+		if( track )
+		  {
+		    for(int b=0;b<nbod;++b) for(int c=0;c<3;++c)
+		      saved_pos[b][c] = sys[b][c].pos(), saved_vel[b][c] = sys[b][c].vel();
+		    base::convert_internal_to_std_coord(sys);
+		    base::_conservation.update(sys);
+		    for(int b=0;b<nbod;++b) for(int c=0;c<3;++c)
+		      sys[b][c].pos() = saved_pos[b][c], sys[b][c].vel() = saved_vel[b][c];
+		  }
+
+		if( dense )
+		  {
+		    // The end of the last step is the beginning of this one
+		    std::swap(std_pos[0], std_pos[1]), std::swap(std_vel[0], std_vel[1]);
+		    base::copy_std_coord(sys, std_pos[1], std_vel[1], tmp_pos, tmp_vel);
+		    interp.pos0 = std_pos[0], interp.vel0 = std_vel[0];
+		    interp.pos1 = std_pos[1], interp.vel1 = std_vel[1];
+		  }
+
+		if( shared_geometry ) geom.reset(sys);
+
+		const int thread_in_system_for_monitor = 0;
+		bool using_std_coord = false;
+		bool needs_std_coord = montest.pass_one( thread_in_system_for_monitor );
+
+		if(needs_std_coord)
+		  {
+		    base::convert_internal_to_std_coord(sys);
+		    using_std_coord = true;
+		    // pass_two reads the geometry in the standard coordinates
+		    if( shared_geometry ) geom.reset(sys);
+		  }
+
+		int new_state = montest.pass_two ( thread_in_system_for_monitor );
+
+		if( montest.need_to_log_system() )
+		  { log::system(*base::_log, sys); }
+
+		if(using_std_coord)
+		  {
+		    base::convert_std_to_internal_coord(sys);
+		    using_std_coord = false;
+		  }
+
+			if( sys.is_active() )
+			  {
+			    if( sys.time() >= base::_destination_time )
+			      { sys.set_inactive();     }
+			  }
+
+		  }
+
+		// shutdown();
+		base::convert_helio_pos_bary_vel_to_std_coord (sys);
+	}
+};
+
+  } } // Close namespaces
+
+#endif
@@ -23,14 +23,14 @@
  *
  */
 
-#ifdef _OPENMP
-#include <omp.h>
-#endif
-
-
 #include "swarm/common.hpp"
 #include "swarm/integrator.hpp"
 #include "swarm/plugin.hpp"
+#include "swarm/runtime.hpp"
+#include "swarm/gravitation_cpu.hpp"
+#include "swarm/dense_output.hpp"
+#include "swarm/step_geometry.hpp"
+#include "monitors/cpu_monitor.hpp"
 
 namespace swarm { namespace cpu {
 /*! CPU implementation of implicit Runge-Kutta integrator
@@ -46,7 +46,8 @@ namespace swarm { namespace cpu {
 template< class Monitor >
 class irk2_cpu : public integrator {
         typedef integrator base;
-        typedef Monitor monitor_t;
+        //! The CPU variant of Monitor, if there is one
+        typedef typename monitors::cpu_monitor<Monitor>::type monitor_t;
         typedef typename monitor_t::params mon_params_t;
         private:
         double _time_step;
@@ -58,14 +59,15 @@ public:  //! Construct for irk2_cpu class
         }
 
         virtual void launch_integrator() {
-                #ifdef _OPENMP
-                #pragma omp parallel for
-                #endif
-                for(int i = 0; i < _ens.nsys(); i++){
-                        integrate_system(_ens[i]);
-                }
+                runtime::instance().integrate_systems(*this, _ens);
+        }
+
+        virtual runtime::task* create_system_task() {
+                return new runtime::system_task<irk2_cpu>(*this, _ens);
         }
 
+        virtual bool tracks_conservation() const { return true; }
+
         //! defines inner product of two arrays
         inline static double inner_product(const double a[3],const double b[3]){
                 return a[0]*b[0]+a[1]*b[1]+a[2]*b[2];
@@ -77,13 +79,14 @@ public:  //! Construct for irk2_cpu class
         void calcForces(ensemble::SystemRef& sys,double* pos, double* acc){
                
           const int nbod = sys.nbod();
+          const int nmassive = massive_body_count(sys);
                
                for(int b = 0; b < 3*nbod; b++)   
                   acc[b] = 0;
 
-                /// Loop through all pairs
-                for(int i=0; i < nbod-1; i++) 
-                    for(int j = i+1; j < nbod; j++) 
+                /// Loop through all pairs of massive bodies
+                for(int i=0; i < nmassive-1; i++) 
+                    for(int j = i+1; j < nmassive; j++) 
                     {
 
                         double dx[3] = { pos[3*j]- pos[3*i],
@@ -109,18 +112,36 @@ public:  //! Construct for irk2_cpu class
                                 
                         }
                 }
+
+                /// Test particles only feel the massive bodies
+                for(int t = nmassive; t < nbod; t++)
+                    for(int i = 0; i < nmassive; i++)
+                    {
+                        double dx[3] = { pos[3*i]- pos[3*t],
+                                pos[3*i+1]- pos[3*t+1],
+                                pos[3*i+2]- pos[3*t+2],
+                        };
+                        double r2 = dx[0]*dx[0] + dx[1]*dx[1] + dx[2] * dx[2];
+                        const double scalar = sys[i].mass() / ( sqrt(r2) * r2 );
+                        for(int c = 0; c < 3; c++)
+                                acc[3*t+c] += dx[c]* scalar;
+                    }
         }
 
         /** Integrate ensembles
          * Default method is the order of 12
          */
-        void integrate_system(ensemble::SystemRef sys){
+        void integrate_system(ensemble::SystemRef sys, scratch_arena& scratch){
                 const int nbod = sys.nbod();
                 const static int nsd = 6, nmd = 3, ndgl = 3*nbod;
-                double F[ndgl*nsd], YH[ndgl], QQ[ndgl];
+                double* F = scratch.alloc<double>(ndgl*nsd);
+                double* YH = scratch.alloc<double>(ndgl);
+                double* QQ = scratch.alloc<double>(ndgl);
                 double C[nsd],AA[nsd][nsd],E[nsd][nsd+nmd],B[nsd],BC[nsd];
                 double SM[nmd],AM[nsd+nmd];
-                double FS[ndgl],PS[ndgl], ZQ[ndgl][nsd];
+                double* FS = scratch.alloc<double>(ndgl);
+                double* PS = scratch.alloc<double>(ndgl);
+                double (*ZQ)[nsd] = scratch.alloc<double[nsd]>(ndgl);
 
                 double uround=1e-16;
                 
@@ -131,8 +152,8 @@ public:  //! Construct for irk2_cpu class
                 
                 coef<nsd,nmd>(ns,C,B,BC,AA,E,SM,AM,h);
                 
-                double* Q = new double[N];
-                double* P = new double[N];
+                double* Q = scratch.alloc<double>(N);
+                double* P = scratch.alloc<double>(N);
                 for (int i = 0; i < nbod; i++)
                 {
                   for (int j = 0; j < 3; j++)
@@ -159,6 +180,29 @@ public:  //! Construct for irk2_cpu class
                 double dynold, dyno;
 
                 monitor_t montest (_mon_params,sys,*_log);
+                monitors::set_scratch_arena(montest, scratch);
+
+                // Dense output for monitors that use it, from the values at both ends of the step
+                const bool dense = monitors::accepts_step_interpolant<monitor_t>::value;
+                double *Q0 = 0, *P0 = 0, *A0 = 0, *A1 = 0;
+                step_interpolant interp;
+                if( dense ) {
+                        Q0 = scratch.alloc<double>(N), P0 = scratch.alloc<double>(N);
+                        A0 = scratch.alloc<double>(N), A1 = scratch.alloc<double>(N);
+                        interp.pos0 = reinterpret_cast<double(*)[3]>(Q0), interp.vel0 = reinterpret_cast<double(*)[3]>(P0);
+                        interp.acc0 = reinterpret_cast<double(*)[3]>(A0);
+                        interp.pos1 = reinterpret_cast<double(*)[3]>(Q), interp.vel1 = reinterpret_cast<double(*)[3]>(P);
+                        interp.acc1 = reinterpret_cast<double(*)[3]>(A1);
+                        monitors::set_step_interpolant(montest, &interp);
+                }
+
+                // Distances and speeds for the monitors, computed at most once per step when a monitor reads them
+                const bool shared_geometry = monitors::accepts_step_geometry<monitor_t>::value;
+                step_geometry geom;
+                if( shared_geometry ) {
+                        geom.alloc(scratch, nbod);
+                        monitors::set_step_geometry(montest, &geom);
+                }
 
 
                 for(int iter = 0 ; (iter < _max_iterations) && sys.is_active() ; iter ++ ) {
@@ -200,6 +244,13 @@ public:  //! Construct for irk2_cpu class
                           }
                           
                         }
+                        // FS holds the acceleration at the beginning of the step
+                        if( dense ) {
+                                for(int i = 0; i < N; i++)
+                                        Q0[i] = Q[i], P0[i] = P[i], A0[i] = FS[i];
+                                interp.t0 = sys.time(), interp.h = h;
+                        }
+
                         // fixed point iteration
                         int niter = 0;
                         dynold = 0.0;
@@ -262,8 +313,17 @@ public:  //! Construct for irk2_cpu class
                         }
                                                              
                         sys.time() += h;
+
+                        // The quintic interpolant costs one more force evaluation
+                        if( dense )
+                                calcForces(sys,Q,A1);
+
+                        // The forces of the step are not evaluated at the new positions
+                        if( _conservation.enabled() )
+                                _conservation.update(sys);
                         
                         if( sys.is_active() )  {
+                                if( shared_geometry ) geom.reset(sys);
                                 montest(0);
                                 if( sys.time() > _destination_time - 1e-12) 
                                         sys.set_inactive();
@@ -28,6 +28,11 @@
 #include "swarm/common.hpp"
 #include "swarm/integrator.hpp"
 #include "swarm/plugin.hpp"
+#include "swarm/runtime.hpp"
+#include "swarm/dense_output.hpp"
+#include "swarm/step_geometry.hpp"
+#include "swarm/gravitation_cpu.hpp"
+#include "monitors/cpu_monitor.hpp"
 
 //! Flag for using standard coordiates
 #define  ASSUME_PROPAGATOR_USES_STD_COORDINATES 0
@@ -49,11 +54,18 @@ namespace swarm { namespace cpu {
 template< class Monitor >
 class mvs_cpu : public integrator {
 	typedef integrator base;
-	typedef Monitor monitor_t;
+	protected:
+	//! The CPU variant of Monitor, if there is one
+	typedef typename monitors::cpu_monitor<Monitor>::type monitor_t;
 	typedef typename monitor_t::params mon_params_t;
-	private:
 	double _time_step;
 	mon_params_t _mon_params;
+	//! Number and weights of the second-order substeps of a step, c.f. mvs_order
+	int _substep_count;
+	double _substep_weight[7];
+	//! Number and coefficients of the stages of the symplectic corrector, c.f. mvs_corrector
+	int _corrector_count;
+	double _corrector_a[3], _corrector_b[3];
 
   // included here so as to avoid namespace conflicts between CPU and OMP integrators
 #include "../propagators/keplerian.hpp"
@@ -61,13 +73,46 @@ class mvs_cpu : public integrator {
 public:  //! Construct for class mvs_cpu
 	mvs_cpu(const config& cfg): base(cfg),_time_step(0.001), _mon_params(cfg) {
 		_time_step =  cfg.require("time_step", 0.0);
+
+		// Compositions of the second-order step (Yoshida 1990)
+		const int order = cfg.optional("mvs_order", 2);
+		if(order == 2) {
+			_substep_count = 1, _substep_weight[0] = 1.;
+		} else if(order == 4) {
+			const double w1 = 1. / (2. - pow(2., 1./3.));
+			_substep_count = 3;
+			_substep_weight[0] = _substep_weight[2] = w1, _substep_weight[1] = 1. - 2. * w1;
+		} else if(order == 6) {
+			const double w1 = -1.17767998417887, w2 = 0.235573213359357, w3 = 0.784513610477560;
+			_substep_count = 7;
+			_substep_weight[0] = _substep_weight[6] = w3, _substep_weight[1] = _substep_weight[5] = w2;
+			_substep_weight[2] = _substep_weight[4] = w1, _substep_weight[3] = 1. - 2. * (w1 + w2 + w3);
+		} else
+			ERROR("mvs_order should be 2, 4 or 6");
+
+		// Stages a = i h, b chosen so that the corrector removes the errors of order (m/M) h^2 up to h^2, h^4 or h^6
+		const int corrector = cfg.optional("mvs_corrector", 0);
+		for(int i = 0; i < 3; i++) _corrector_a[i] = i + 1, _corrector_b[i] = 0;
+		if(corrector == 0) {
+			_corrector_count = 0;
+		} else if(corrector == 3) {
+			_corrector_count = 1, _corrector_b[0] = 1./24.;
+		} else if(corrector == 5) {
+			_corrector_count = 2, _corrector_b[0] = 41./720., _corrector_b[1] = -11./1440.;
+		} else if(corrector == 7) {
+			_corrector_count = 3, _corrector_b[0] = 7843./120960., _corrector_b[1] = -211./15120., _corrector_b[2] = 191./120960.;
+		} else
+			ERROR("mvs_corrector should be 0, 3, 5 or 7");
+		if(_corrector_count > 0 && _substep_count > 1)
+			ERROR("mvs_corrector can only be used with mvs_order = 2");
 	}
 
-        //! 
 	virtual void launch_integrator() {
-		for(int i = 0; i < _ens.nsys(); i++){
-			integrate_system(_ens[i]);
-		}
+		runtime::instance().integrate_systems(*this, _ens);
+	}
+
+	virtual runtime::task* create_system_task() {
+		return new runtime::system_task<mvs_cpu>(*this, _ens);
 	}
 
         //! Method for calculating inner product of two arrays
@@ -75,16 +120,17 @@ public:  //! Construct for class mvs_cpu
 		return a[0]*b[0]+a[1]*b[1]+a[2]*b[2];
 	}
 
-        //! Method for calculating forces
+        //! Method for calculating the forces between the planets, the star is accounted for by the Kepler drift
 	void calcForces(ensemble::SystemRef& sys, double acc[][3]){
 		const int nbod = sys.nbod();
+		const int nmassive = massive_body_count(sys);
 
 		// Clear acc 
 		for(int b = 0; b < nbod; b++)	for(int c =0; c < 3; c++) 
 		     acc[b][c] = 0.;
 
-		// Loop through all pairs
-		for(int i=0; i < nbod-1; i++) for(int j = i+1; j < nbod; j++) {
+		// Loop through the pairs of massive planets
+		for(int i=1; i < nmassive-1; i++) for(int j = i+1; j < nmassive; j++) {
 
 			double dx[3] = { sys[j][0].pos()-sys[i][0].pos(),
 				sys[j][1].pos()-sys[i][1].pos(),
@@ -112,6 +158,19 @@ public:  //! Construct for class mvs_cpu
 				acc[j][c] += dx[c]* scalar_j;
 			}
 		}
+
+		// Test particles only feel the massive planets
+		for(int t=nmassive; t < nbod; t++) for(int i = 1; i < nmassive; i++) {
+			double dx[3] = { sys[i][0].pos()-sys[t][0].pos(),
+				sys[i][1].pos()-sys[t][1].pos(),
+				sys[i][2].pos()-sys[t][2].pos()
+			};
+			double r2 = dx[0]*dx[0] + dx[1]*dx[1] + dx[2] * dx[2];
+			const double scalar = sys[i].mass() / ( sqrt(r2) * r2 );
+			for(int c = 0; c < 3; c++) {
+				acc[t][c] += dx[c]* scalar;
+			}
+		}
 	}
 
 
@@ -129,11 +188,10 @@ public:  //! Construct for class mvs_cpu
 	/// Shift to  funky coordinate system (see A. Quillen's qymsym's tobary)
 	void convert_std_to_helio_pos_bary_vel_coord(ensemble::SystemRef sys)  { 
 	  const int nbod = sys.nbod();
-	        double pc0;
-		double sump = 0., sumv = 0., mtot = 0.;
 		for(int c=0;c<3;++c)
 		  {
-		    pc0 = sys[0][c].pos();
+		    double sump = 0., sumv = 0., mtot = 0.;
+		    const double pc0 = sys[0][c].pos();
 		    // Find Center of mass and momentum
 		    for(int j=0;j<nbod;++j) {
 		      const double mj = sys[j].mass();
@@ -158,15 +216,13 @@ public:  //! Construct for class mvs_cpu
 	void convert_helio_pos_bary_vel_to_std_coord (ensemble::SystemRef sys)  
 	{ 
 	  const int nbod = sys.nbod();
-	  double sump = 0., sumv = 0., mtot;
 	  double m0 = sys[0].mass();
-	  double pc0, vc0;
 
 	  for(int c=0;c<3;++c)
 	    {
-	      pc0 = sys[0][c].pos();
-	      vc0 = sys[0][c].vel();
-	      mtot = m0;
+	      double sump = 0., sumv = 0., mtot = m0;
+	      const double pc0 = sys[0][c].pos();
+	      const double vc0 = sys[0][c].vel();
 	      for(int j=1;j<nbod;++j)
 		{
 		  const double mj = sys[j].mass();
@@ -209,25 +265,68 @@ public:  //! Construct for class mvs_cpu
 	    }
 	}
 
-        //! Integrating an ensemble
-	void integrate_system(ensemble::SystemRef sys){
-		const int nbod = sys.nbod();
-		double acc[nbod][3];
+	/// Kepler drift of the planets about the star for the time dt
+	void kepler_step(ensemble::SystemRef sys, const double& sqrtGM, const double& dt)
+	{
+	  for(int b=1;b<sys.nbod();++b)
+	    drift_kepler( sys[b][0].pos(),sys[b][1].pos(),sys[b][2].pos(),sys[b][0].vel(),sys[b][1].vel(),sys[b][2].vel(),sqrtGM, dt );
+	}
 
-		// Setting up Monitor
-		monitor_t montest(_mon_params,sys,*_log) ;
+	/// Drift step and kick of the planets for the time dt, the forces are computed into acc
+	void interaction_step(ensemble::SystemRef sys, double acc[][3], const double& dt)
+	{
+	  drift_step(sys,dt);
+	  calcForces(sys,acc);
+	  for(int b=1;b<sys.nbod();++b)
+	    for(int c=0;c<3;++c)
+	      sys[b][c].vel() += dt * acc[b][c];
+	}
 
-		// begin init();
-		const double sqrtGM = sqrt(sys[0].mass());
-		convert_std_to_helio_pos_bary_vel_coord(sys);
-		calcForces(sys,acc);
-		// end init()
+	/*! Symplectic corrector (direction = 1) or its inverse (direction = -1)
+	 *
+	 *  The second-order step is conjugate to the flow of the system up to
+	 *  errors of order (m/M)^2: the corrector maps the internal coordinates,
+	 *  which are integrated by the steps, to coordinates that are accurate to
+	 *  (m/M) h^(n-1) for mvs_corrector = n (Wisdom, Holman & Touma 1996). Every
+	 *  stage is the kernel Kepler(a) Interaction(b) Kepler(-2a) Interaction(-b) Kepler(a).
+	 *  acc is overwritten.
+	 */
+	void apply_corrector(ensemble::SystemRef sys, double acc[][3], const double& direction)
+	{
+	  const double sqrtGM = sqrt(sys[0].mass());
+	  for(int i=0;i<_corrector_count;++i)
+	    {
+	      // The maps compose in the reverse order of their Lie operators, hence the sign of b
+	      const double a = _corrector_a[i] * _time_step, b = -direction * _corrector_b[i] * _time_step;
+	      kepler_step(sys,sqrtGM,a);
+	      interaction_step(sys,acc,b);
+	      kepler_step(sys,sqrtGM,-2.0*a);
+	      interaction_step(sys,acc,-b);
+	      kepler_step(sys,sqrtGM,a);
+	    }
+	}
 
-		for(int iter = 0 ; (iter < _max_iterations) && sys.is_active() ; iter ++ )
-		  {
+	/// Copy the standard coordinates of sys to pos and vel, sys is left unchanged (tmp_pos and tmp_vel are overwritten). The corrector is applied if corr_acc is given
+	void copy_std_coord(ensemble::SystemRef sys, double pos[][3], double vel[][3], double tmp_pos[][3], double tmp_vel[][3], double (*corr_acc)[3] = 0)
+	{
+	  const int nbod = sys.nbod();
+	  for(int b=0;b<nbod;++b) for(int c=0;c<3;++c)
+	    tmp_pos[b][c] = sys[b][c].pos(), tmp_vel[b][c] = sys[b][c].vel();
+	  if(corr_acc) apply_corrector(sys,corr_acc,1.0);
+	  convert_internal_to_std_coord(sys);
+	  for(int b=0;b<nbod;++b) for(int c=0;c<3;++c)
+	    {
+	      pos[b][c] = sys[b][c].pos(), vel[b][c] = sys[b][c].vel();
+	      // Restore the internal coordinates exactly
+	      sys[b][c].pos() = tmp_pos[b][c], sys[b][c].vel() = tmp_vel[b][c];
+	    }
+	}
 
-		// begin advance();
-		    double hby2 = 0.5 * std::min( _destination_time - sys.time() ,  _time_step );
+	/// Second-order step for the time h: drift, kick, Kepler drift, kick, drift. acc holds the forces at the beginning and is updated
+	void advance(ensemble::SystemRef sys, double acc[][3], const double& sqrtGM, const double& h)
+	{
+		const int nbod = sys.nbod();
+		const double hby2 = 0.5 * h;
 
 		// Step 1
 		drift_step(sys,hby2);
@@ -240,8 +339,7 @@ public:  //! Construct for class mvs_cpu
 		// __syncthreads();
 
 		// 3: Kepler Drift Step (Keplerian orbit about sun/central body)
-		for(int b=1;b<nbod;++b)
-		  drift_kepler( sys[b][0].pos(),sys[b][1].pos(),sys[b][2].pos(),sys[b][0].vel(),sys[b][1].vel(),sys[b][2].vel(),sqrtGM, 2.0*hby2 );
+		kepler_step(sys,sqrtGM,h);
 		// __syncthreads();
 
 		// TODO: check for close encounters here
@@ -255,11 +353,80 @@ public:  //! Construct for class mvs_cpu
 
 		// Step 5
 		drift_step(sys,hby2);
+	}
+
+        //! Integrating an ensemble
+	void integrate_system(ensemble::SystemRef sys, scratch_arena& scratch){
+		const int nbod = sys.nbod();
+		double (*acc)[3] = scratch.alloc<double[3]>(nbod);
+
+		// Setting up Monitor
+		monitor_t montest(_mon_params,sys,*_log) ;
+		monitors::set_scratch_arena(montest, scratch);
+
+		// With a corrector, the coordinates that are integrated are mapped back
+		// to the real ones only for the monitors, the dense output and the result
+		const bool corrector = _corrector_count > 0;
+		double (*corr_acc)[3] = 0, (*saved_pos)[3] = 0, (*saved_vel)[3] = 0;
+		if( corrector ) {
+		  corr_acc = scratch.alloc<double[3]>(nbod);
+		  saved_pos = scratch.alloc<double[3]>(nbod), saved_vel = scratch.alloc<double[3]>(nbod);
+		}
 
-		sys.time() += 2.0*hby2;
+		// Dense output for monitors that use it, cubic in the standard coordinates at both ends of the step
+		const bool dense = monitors::accepts_step_interpolant<monitor_t>::value;
+		double (*std_pos[2])[3] = { 0, 0 }, (*std_vel[2])[3] = { 0, 0 }, (*tmp_pos)[3] = 0, (*tmp_vel)[3] = 0;
+		step_interpolant interp;
+		if( dense ) {
+		  for(int k = 0; k < 2; k++)
+		    std_pos[k] = scratch.alloc<double[3]>(nbod), std_vel[k] = scratch.alloc<double[3]>(nbod);
+		  tmp_pos = scratch.alloc<double[3]>(nbod), tmp_vel = scratch.alloc<double[3]>(nbod);
+		  for(int b=0;b<nbod;++b) for(int c=0;c<3;++c)
+		    std_pos[1][b][c] = sys[b][c].pos(), std_vel[1][b][c] = sys[b][c].vel();
+		  interp.acc0 = interp.acc1 = 0;
+		  monitors::set_step_interpolant(montest, &interp);
+		}
+
+		// Distances and speeds for the monitors, computed at most once per step when a monitor reads them
+		const bool shared_geometry = monitors::accepts_step_geometry<monitor_t>::value;
+		step_geometry geom;
+		if( shared_geometry ) {
+		  geom.alloc(scratch, nbod);
+		  monitors::set_step_geometry(montest, &geom);
+		}
+
+		// begin init();
+		const double sqrtGM = sqrt(sys[0].mass());
+		convert_std_to_helio_pos_bary_vel_coord(sys);
+		if( corrector ) apply_corrector(sys,corr_acc,-1.0);
+		calcForces(sys,acc);
+		// end init()
+
+		for(int iter = 0 ; (iter < _max_iterations) && sys.is_active() ; iter ++ )
+		  {
+
+		// begin advance();
+		    const double h = std::min( _destination_time - sys.time() ,  _time_step );
+
+		for(int k = 0; k < _substep_count; k++)
+		  advance(sys,acc,sqrtGM,_substep_weight[k]*h);
+
+		interp.t0 = sys.time(), interp.h = h;
+		sys.time() += h;
 
 		// end advance
 
+		if( dense )
+		  {
+		    // The end of the last step is the beginning of this one
+		    std::swap(std_pos[0], std_pos[1]), std::swap(std_vel[0], std_vel[1]);
+		    copy_std_coord(sys, std_pos[1], std_vel[1], tmp_pos, tmp_vel, corr_acc);
+		    interp.pos0 = std_pos[0], interp.vel0 = std_vel[0];
+		    interp.pos1 = std_pos[1], interp.vel1 = std_vel[1];
+		  }
+
+		if( shared_geometry ) geom.reset(sys);
+
 		const int thread_in_system_for_monitor = 0;
 #if ASSUME_PROPAGATOR_USES_STD_COORDINATES
 		montest( thread_in_system_for_monitor );
@@ -269,8 +436,16 @@ public:  //! Construct for class mvs_cpu
 
 		if(needs_std_coord) 
 		  { 
+		    if( corrector )
+		      {
+			for(int b=0;b<nbod;++b) for(int c=0;c<3;++c)
+			  saved_pos[b][c] = sys[b][c].pos(), saved_vel[b][c] = sys[b][c].vel();
+			apply_corrector(sys,corr_acc,1.0);
+		      }
 		    convert_internal_to_std_coord(sys); 
 		    using_std_coord = true; 
+		    // pass_two reads the geometry in the standard coordinates
+		    if( shared_geometry ) geom.reset(sys);
 		  }
 		
 		//			__syncthreads();
@@ -282,7 +457,13 @@ public:  //! Construct for class mvs_cpu
 		//			__syncthreads();
 		if(using_std_coord)
 		  {
-		    convert_std_to_internal_coord(sys);
+		    if( corrector )
+		      {
+			for(int b=0;b<nbod;++b) for(int c=0;c<3;++c)
+			  sys[b][c].pos() = saved_pos[b][c], sys[b][c].vel() = saved_vel[b][c];
+		      }
+		    else
+		      convert_std_to_internal_coord(sys);
 		    using_std_coord = false;
 		  }
 #endif
@@ -298,6 +479,7 @@ public:  //! Construct for class mvs_cpu
 		  }
 
 		// shutdown();
+		if( corrector ) apply_corrector(sys,corr_acc,1.0);
 		convert_helio_pos_bary_vel_to_std_coord (sys);
 	}
 };
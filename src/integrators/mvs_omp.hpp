@@ -17,15 +17,14 @@
  ************************************************************************/
 
 /*! \file mvs_omp.hpp
- *   \brief Defines OpenMP implementation of mixed 
+ *   \brief Defines multi-threaded implementation of mixed 
  *          variables symplectic propagator on CPU.
  *
+ *   The systems are distributed over the worker threads of
+ *   \ref swarm::runtime.
  */
 
 #include "mvs_cpu.hpp"
-#ifdef _OPENMP
-#include <omp.h>
-#endif
 
 namespace swarm { namespace cpu {
 
@@ -39,18 +38,8 @@ class mvs_omp : public mvs_cpu<Monitor> {
 	public:
 	typedef mvs_cpu<Monitor> base;
 
-        //!
+        //! mvs_cpu runs on the worker threads of \ref runtime already, this is the same integrator
 	mvs_omp(const config& cfg): base(cfg){}
-
-        //!
-	virtual void launch_integrator() {
-#pragma omp parallel for
-		for(int i = 0; i < base::_ens.nsys(); i++){
-			base::integrate_system(base::_ens[i]);
-		}
-	}
-
-
 };
 #endif
 
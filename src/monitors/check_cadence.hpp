@@ -0,0 +1,61 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file check_cadence.hpp
+ *   \brief Defines \ref swarm::monitors::check_cadence, a step counter
+ *          for monitors that do not have to test every step.
+ *
+ */
+
+#pragma once
+
+namespace swarm { namespace monitors {
+
+/** Counts the steps between the tests of a monitor.
+ *
+ *  Ejections and orbit crossings develop over many orbits, so testing
+ *  them every few steps usually only delays the detection by a few
+ *  steps. due() is true for the first step a monitor sees and then every
+ *  interval steps.
+ *
+ *  An ejected body does not come back, but a condition that can be
+ *  undone is missed if it holds only between two tests: secular
+ *  oscillations of the eccentricities can make two orbits cross for a
+ *  while and then separate them again. The interval should be short
+ *  compared to the time such a condition lasts. Monitors for transient
+ *  conditions, like close encounters, should test every step.
+ *
+ *  \ingroup monitors
+ */
+struct check_cadence {
+	int interval, countdown;
+
+	GENERIC check_cadence(const int& k = 1):interval(k > 1 ? k : 1),countdown(0){}
+
+	//! True if the monitor should test this step
+	GENERIC bool due() {
+		if(countdown > 0) { countdown--; return false; }
+		countdown = interval - 1;
+		return true;
+	}
+
+	//! Test again on the next call to due()
+	GENERIC void reset() { countdown = 0; }
+};
+
+} } // end namespace monitors :: swarm
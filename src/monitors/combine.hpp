@@ -27,6 +27,9 @@
 #pragma once
 
 #include <limits>
+#include "swarm/dense_output.hpp"
+#include "swarm/step_geometry.hpp"
+#include "monitor_scratch.hpp"
 
 namespace swarm {
 namespace monitors {
@@ -108,7 +111,12 @@ struct combine {
 
 
 	GPUAPI bool pass_one (int thread_in_system) 
-          {  return _monitor1.pass_one(thread_in_system) || _monitor2.pass_one(thread_in_system);  }
+          {
+	    // Both monitors have to see every step, e.g. to count the steps between tests
+	    bool n1 = _monitor1.pass_one(thread_in_system);
+	    bool n2 = _monitor2.pass_one(thread_in_system);
+	    return n1 || n2;
+	  }
 	    
 
 	GPUAPI int pass_two (int thread_in_system) 
@@ -139,11 +147,47 @@ struct combine {
 	      _monitor1.log_system();
 	  }
 
+	//! Pass the interpolant of the last step to the monitors that use it
+	GPUAPI void set_step_interpolant(const step_interpolant* interp) {
+		monitors::set_step_interpolant(_monitor1, interp);
+		monitors::set_step_interpolant(_monitor2, interp);
+	}
+
+	//! Pass the geometry cache to the monitors that use it
+	GPUAPI void set_step_geometry(const step_geometry* geom) {
+		monitors::set_step_geometry(_monitor1, geom);
+		monitors::set_step_geometry(_monitor2, geom);
+	}
+
+	//! Pass the scratch arena of the integrator to the monitors that use it
+	void set_scratch_arena(scratch_arena& a) {
+		monitors::set_scratch_arena(_monitor1, a);
+		monitors::set_scratch_arena(_monitor2, a);
+	}
+
 	GPUAPI combine(const params& p,ensemble::SystemRef& s,log_t& l)
 		:_params(p),_monitor1(p.p1,s,l),_monitor2(p.p2,s,l){}
 	
 };
 
+//! A combination of monitors uses the interpolant if one of them does
+template< class log_t,  class Monitor1,  class Monitor2 >
+struct accepts_step_interpolant< combine<log_t, Monitor1, Monitor2> > {
+	static const bool value = accepts_step_interpolant<Monitor1>::value || accepts_step_interpolant<Monitor2>::value;
+};
+
+//! A combination of monitors uses the geometry cache if one of them does
+template< class log_t,  class Monitor1,  class Monitor2 >
+struct accepts_step_geometry< combine<log_t, Monitor1, Monitor2> > {
+	static const bool value = accepts_step_geometry<Monitor1>::value || accepts_step_geometry<Monitor2>::value;
+};
+
+//! A combination of monitors uses the scratch arena if one of them does
+template< class log_t,  class Monitor1,  class Monitor2 >
+struct accepts_scratch_arena< combine<log_t, Monitor1, Monitor2> > {
+	static const bool value = accepts_scratch_arena<Monitor1>::value || accepts_scratch_arena<Monitor2>::value;
+};
+
 }
 
 }
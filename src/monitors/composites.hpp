@@ -33,7 +33,8 @@ namespace swarm { namespace monitors {
 
 
 /** Combination of stop_on_ejcetion, stop_on_close_encounter and
- * stop_on_crossing_orbit
+ * stop_on_crossing_orbit. Ejection is the monitor used for ejections, the
+ * CPU integrators replace it with stop_on_ejection_cpu (c.f. \ref cpu_monitor).
  *
  *  *EXPERIMENTAL*: This class is not thoroughly tested.
  *  \ingroup experimental
@@ -43,12 +44,12 @@ namespace swarm { namespace monitors {
  *
  * 
  */
-template <class L> 
+template <class L, class Ejection = stop_on_ejection<L> > 
 struct stop_on_ejection_or_close_encounter_or_crossing_orbit {
 
         //! Defines parameter structure
 	struct params {
-		typename stop_on_ejection<L>        ::params ej;
+		typename Ejection                   ::params ej;
 		typename stop_on_close_encounter<L> ::params ce;
 		typename stop_on_crossing_orbit<L>  ::params co;
 		
@@ -87,6 +88,14 @@ struct stop_on_ejection_or_close_encounter_or_crossing_orbit {
 	      ej.log_system();
 	  }
 	
+        //! All three monitors read the geometry cache of the integrator
+        GPUAPI void set_step_geometry(const step_geometry* geom)
+          {  ej.set_step_geometry(geom); ce.set_step_geometry(geom); co.set_step_geometry(geom);  }
+
+        //! The close encounter monitor tests the minimum distances during the step
+        GPUAPI void set_step_interpolant(const step_interpolant* interp)
+          {  ce.set_step_interpolant(interp);  }
+
         GPUAPI bool is_deactivate_on() { return ej.is_deactivate_on() || ce.is_deactivate_on() || co.is_deactivate_on(); }
         GPUAPI bool is_log_on() { return ej.is_log_on() || ce.is_log_on() || co.is_log_on(); }
         GPUAPI bool is_verbose_on() { return ej.is_verbose_on() || ce.is_verbose_on() || co.is_verbose_on(); };
@@ -100,7 +109,13 @@ struct stop_on_ejection_or_close_encounter_or_crossing_orbit {
 
         //! check if the system needs full test
 	GPUAPI bool pass_one (int thread_in_system) 
-          {  return ej.pass_one(thread_in_system) || ce.pass_one(thread_in_system) || co.pass_one(thread_in_system);  }
+          {
+	    // Every monitor has to see every step, e.g. to count the steps between tests
+	    bool n1 = ej.pass_one(thread_in_system);
+	    bool n2 = ce.pass_one(thread_in_system);
+	    bool n3 = co.pass_one(thread_in_system);
+	    return n1 || n2 || n3;
+	  }
 	    
 
         //! check if deactivating the system
@@ -128,13 +143,14 @@ struct stop_on_ejection_or_close_encounter_or_crossing_orbit {
 	  }
 
 private:
-	stop_on_ejection<L>        ej;
+	Ejection                   ej;
 	stop_on_close_encounter<L> ce;
 	stop_on_crossing_orbit<L>  co;
 };
 
 
-/** Combination of stop_on_ejcetion and stop_on_close_encounter
+/** Combination of stop_on_ejcetion and stop_on_close_encounter.
+ *  Ejection is the monitor used for ejections, as above.
  *  *EXPERIMENTAL*: This class is not thoroughly tested.
  *  \ingroup experimental
  *
@@ -142,12 +158,12 @@ private:
  * \ingroup monitors
  *
  */
-template <class L> 
+template <class L, class Ejection = stop_on_ejection<L> > 
 struct stop_on_ejection_or_close_encounter {
 
         //! Define the structure params
 	struct params {
-		typename stop_on_ejection<L>        ::params ej;
+		typename Ejection                   ::params ej;
 		typename stop_on_close_encounter<L> ::params ce;
 		
 		params(const config& cfg)
@@ -184,6 +200,14 @@ struct stop_on_ejection_or_close_encounter {
 	      ej.log_system();
 	  }
 	
+        //! Both monitors read the geometry cache of the integrator
+        GPUAPI void set_step_geometry(const step_geometry* geom)
+          {  ej.set_step_geometry(geom); ce.set_step_geometry(geom);  }
+
+        //! The close encounter monitor tests the minimum distances during the step
+        GPUAPI void set_step_interpolant(const step_interpolant* interp)
+          {  ce.set_step_interpolant(interp);  }
+
         GPUAPI bool is_deactivate_on() { return ej.is_deactivate_on() || ce.is_deactivate_on(); }
         GPUAPI bool is_log_on() { return ej.is_log_on() || ce.is_log_on(); }
         GPUAPI bool is_verbose_on() { return ej.is_verbose_on() || ce.is_verbose_on(); };
@@ -197,7 +221,11 @@ struct stop_on_ejection_or_close_encounter {
 
         //! Check if need full test
 	GPUAPI bool pass_one (int thread_in_system) 
-          {  return ej.pass_one(thread_in_system) || ce.pass_one(thread_in_system);  }
+          {
+	    bool n1 = ej.pass_one(thread_in_system);
+	    bool n2 = ce.pass_one(thread_in_system);
+	    return n1 || n2;
+	  }
 	    
         //! check if deactivating the system
 	GPUAPI int pass_two (int thread_in_system) 
@@ -217,7 +245,7 @@ struct stop_on_ejection_or_close_encounter {
 	  }
 
 private:
-	stop_on_ejection<L>        ej;
+	Ejection                   ej;
 	stop_on_close_encounter<L> ce;
 };
 
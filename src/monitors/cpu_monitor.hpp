@@ -0,0 +1,79 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file cpu_monitor.hpp
+ *   \brief Defines \ref swarm::monitors::cpu_monitor, the monitor that the
+ *          CPU integrators use in place of a given monitor.
+ *
+ */
+
+#pragma once
+
+#include "combine.hpp"
+#include "monitor_scratch.hpp"
+#include "composites.hpp"
+#include "stop_on_ejection_cpu.hpp"
+#include "mce_stat_cpu.hpp"
+
+namespace swarm {
+  namespace monitors {
+
+template<class log_t> class mce_stat;
+
+/** Monitor that the CPU integrators use for Monitor.
+ *
+ *  Some monitors have variants written for the CPU, with the same
+ *  parameters and results. The CPU integrators declare their monitor as
+ *  cpu_monitor<Monitor>::type, so the plugins keep naming the same
+ *  monitors for the CPU and GPU integrators.
+ *
+ *  \ingroup monitors
+ */
+template<class Monitor>
+struct cpu_monitor {
+	typedef Monitor type;
+};
+
+template<class log_t>
+struct cpu_monitor< stop_on_ejection<log_t> > {
+	typedef stop_on_ejection_cpu<log_t> type;
+};
+
+//! mce_stat needs the shared memory of the GPU integrators
+template<class log_t>
+struct cpu_monitor< mce_stat<log_t> > {
+	typedef mce_stat_cpu<log_t> type;
+};
+
+template<class log_t, class Monitor1, class Monitor2>
+struct cpu_monitor< combine<log_t, Monitor1, Monitor2> > {
+	typedef combine<log_t, typename cpu_monitor<Monitor1>::type, typename cpu_monitor<Monitor2>::type> type;
+};
+
+template<class L, class Ejection>
+struct cpu_monitor< stop_on_ejection_or_close_encounter<L, Ejection> > {
+	typedef stop_on_ejection_or_close_encounter<L, typename cpu_monitor<Ejection>::type> type;
+};
+
+template<class L, class Ejection>
+struct cpu_monitor< stop_on_ejection_or_close_encounter_or_crossing_orbit<L, Ejection> > {
+	typedef stop_on_ejection_or_close_encounter_or_crossing_orbit<L, typename cpu_monitor<Ejection>::type> type;
+};
+
+}
+}
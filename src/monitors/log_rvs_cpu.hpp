@@ -0,0 +1,165 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file log_rvs_cpu.hpp
+ *   \brief Defines and implements the monitor \ref swarm::monitors::log_rvs_cpu
+ *          that logs the radial velocity of the star at observation times
+ *          for the CPU integrators.
+ *
+ *  *EXPERIMENTAL*: This class is not thoroughly tested.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include "swarm/dense_output.hpp"
+
+namespace swarm {
+  namespace monitors {
+
+/** Parameters for log_rvs_cpu monitor
+ * rv_filename: name of file with observation times, one per line
+ * log_rvs_tol (real): anything !=0 turns on logging
+ *
+ * \ingroup monitors_param
+ */
+struct log_rvs_cpu_params {
+	double tol;
+	//! Sorted observation times, shared by the copies of the parameters
+	shared_ptr< std::vector<double> > rv_times;
+
+	log_rvs_cpu_params(const config &cfg):rv_times(new std::vector<double>())
+	{
+		tol = cfg.optional("log_rvs_tol", 2.e-8);
+
+		std::string filename = cfg.optional("rv_filename",std::string("rv.in"));
+		std::ifstream rv_file(filename.c_str());
+		if(!rv_file.good())
+			ERROR("Can't open RV observation times file " + filename);
+
+		double time;
+		while(rv_file >> time)
+			rv_times->push_back(time);
+		std::sort(rv_times->begin(), rv_times->end());
+	}
+};
+
+/**
+ * Monitor that logs the velocity of the star (body 0) along the line of
+ * sight (z axis) at the observation times, as EVT_RV_OBS events, for the
+ * CPU integrators.
+ *
+ * After every step, the velocity of the star at the observation times
+ * within the step is evaluated from the dense output of the step (c.f.
+ * \ref swarm::step_interpolant), so the error does not grow with the
+ * distance to the end of the step. Unlike log_rvs, all observations
+ * within the step are logged; observations at the initial time, before
+ * the first step, are not. Only works with integrators that provide
+ * dense output, which all CPU integrators do.
+ *
+ *   *  Assumes integration results in increasing time.
+ *
+ *  \ingroup monitors
+ */
+template<class log_t>
+class log_rvs_cpu {
+	public:
+	typedef log_rvs_cpu_params params;
+
+	private:
+	params _params;
+	bool condition_met;
+	size_t _next_time_idx;
+
+	ensemble::SystemRef& _sys;
+	log_t& _log;
+	const step_interpolant* _interp;
+
+	public:
+	template<class T>
+	static GENERIC int thread_per_system(T compile_time_param){
+		return 1;
+	}
+
+	template<class T>
+	static GENERIC int shmem_per_system(T compile_time_param) {
+		return 0;
+	}
+	bool is_deactivate_on() { return false; };
+	bool is_log_on() { return _params.tol!=0.; };
+	bool is_verbose_on() { return false; };
+	bool is_any_on() { return is_deactivate_on() || is_log_on() || is_verbose_on() ; }
+	bool is_condition_met () { return ( condition_met ); }
+	bool need_to_log_system ()
+	{ return false; }
+	bool need_to_deactivate ()
+	{ return ( is_deactivate_on() && is_condition_met() ); }
+
+	void log_system()  {  log::system(_log, _sys);  }
+
+	void operator () (const int thread_in_system)
+	{
+		if(pass_one(thread_in_system))
+			pass_two(thread_in_system);
+	}
+
+	const std::vector<double>& times() const { return *_params.rv_times; }
+
+	//! True if there are observations within the last step
+	bool pass_one (const int thread_in_system)
+	{
+		condition_met = false;
+		if(!is_any_on() || (thread_in_system!=0) || !_interp) return false;
+		// A step logs the observations in (t0, t1], so that an observation at
+		// the end of one call to integrate is not logged again by the next
+		while(_next_time_idx < times().size() && times()[_next_time_idx] <= _interp->t0)
+			_next_time_idx++;
+		return _next_time_idx < times().size() && times()[_next_time_idx] <= _interp->t1();
+	}
+
+	//! Log the velocity of the star at the observations within the last step
+	int pass_two (const int thread_in_system)
+	{
+		if(is_any_on() && (thread_in_system==0) && _interp)
+		  {
+			for(; _next_time_idx < times().size() && times()[_next_time_idx] <= _interp->t1(); _next_time_idx++)
+			  {
+				const double t_log = times()[_next_time_idx];
+				double p[3], v[3];
+				_interp->evaluate(0, t_log, p, v);
+				log::event(_log,log::EVT_RV_OBS,t_log,_sys.id(),0,v[2]);
+				condition_met = true;
+			  }
+		  }
+		return _sys.state();
+	}
+
+	//! The dense output of the last step, c.f. swarm::step_interpolant
+	void set_step_interpolant(const step_interpolant* interp) { _interp = interp; }
+
+	log_rvs_cpu(const params& p,ensemble::SystemRef& s,log_t& l)
+		:_params(p),_next_time_idx(0),_sys(s),_log(l),_interp(0) {}
+};
+
+}
+
+
+}
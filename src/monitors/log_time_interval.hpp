@@ -24,6 +24,8 @@
 
 #pragma once
 
+#include "swarm/dense_output.hpp"
+
 namespace swarm {
   namespace monitors {
 
@@ -46,6 +48,11 @@ struct log_time_interval_params {
 /** Monitor that logs the entire state of systems at periodic intervals of approximately "log_interval"
  *  Systems may be integrated for more than log interval before another log entry is written.
  *  Assumes integration results in increasing time.
+ *
+ *  With integrators that provide dense output (c.f. \ref swarm::step_interpolant),
+ *  the snapshots are written at the exact times t0 + k * log_interval,
+ *  interpolated within the step that passes them, so the time step does
+ *  not have to be shrunk or aligned with the log interval.
  * 
  *  \ingroup monitors
  *
@@ -63,6 +70,7 @@ class log_time_interval {
 	ensemble::SystemRef& _sys;
 	double _next_log_time;
 	log_t& _log;
+	const step_interpolant* _interp;
 
 	public:
 		template<class T>
@@ -100,7 +108,13 @@ class log_time_interval {
 	    condition_met = false;
 	    if(is_log_on())
 	      {
-		if(thread_in_system == 0 && _sys.time() >= _next_log_time )  
+		if(thread_in_system == 0 && _interp != 0 && _interp->t1() == _sys.time() )
+		  {
+		    // Log every requested time within the last step, at that time
+		    for(; _next_log_time <= _sys.time(); _next_log_time += _params.time_interval)
+		      log::interpolated_system(_log, _sys, (_next_log_time > _interp->t0 ? _next_log_time : _interp->t0), *_interp);
+		  }
+		else if(thread_in_system == 0 && _sys.time() >= _next_log_time )  
 		  {
 		    condition_met = true; 
 		    _next_log_time += _params.time_interval; 
@@ -115,8 +129,11 @@ class log_time_interval {
           {   return _sys.state();  }
 
 
+	//! Log from the interpolant of the last step instead of the current state
+	GPUAPI void set_step_interpolant(const step_interpolant* interp) { _interp = interp; }
+
 	GPUAPI log_time_interval(const params& p,ensemble::SystemRef& s,log_t& l)
-		:_params(p),_sys(s),_log(l),_next_log_time(s.time()){}
+		:_params(p),_sys(s),_log(l),_next_log_time(s.time()),_interp(0){}
 	
 };
 
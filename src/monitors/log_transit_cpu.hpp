@@ -0,0 +1,273 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file log_transit_cpu.hpp
+ *   \brief Defines and implements the monitor \ref swarm::monitors::log_transit_cpu
+ *          that logs transits and occultations for the CPU integrators.
+ *
+ *  *EXPERIMENTAL*: This class is not thoroughly tested.
+ *
+ */
+
+#pragma once
+
+#include "swarm/gravitation_cpu.hpp"
+#include "swarm/runtime.hpp"
+#include "monitor_scratch.hpp"
+
+namespace swarm {
+  namespace monitors {
+
+/*! Parameters for log_transit_cpu monitor
+ * log_transit_tol (real): desired precision of transit times (zero makes inactive)
+ * num_max_transit_iter (int): maximum number of Newton iterations
+ * time_step (real): time step of the integrator
+ * log_transits, log_occultations (bool): events to log
+ *
+ * \ingroup monitors_param
+ */
+struct log_transit_cpu_params {
+	double tol, dt;
+	int num_max_iter;
+	bool log_on_transit, log_on_occultation;
+
+	log_transit_cpu_params(const config &cfg)
+	{
+		num_max_iter = cfg.optional("num_max_transit_iter", 2);
+		tol = cfg.optional("log_transit_tol", 2.e-8); //! 0.1 seconds for G=Msol=AU=1
+		dt = cfg.require("time_step", 0.0);
+		log_on_transit = cfg.optional("log_transits", true);
+		log_on_occultation = cfg.optional("log_occultations", false);
+	}
+};
+
+/** Monitor that logs transits of the planets in front of the star (body 0)
+ *  and occultations behind it, for the CPU integrators. The observer looks
+ *  down the z axis.
+ *
+ *  Logs the same events as log_transit (EVT_TRANSIT or EVT_OCCULTATION with
+ *  the body, the minimum impact parameter and the projected velocity, in
+ *  units of the stellar radius if body attribute 0 holds the radii), but
+ *  does not depend on the shared memory layout of the GPU integrators
+ *  and works for any number of bodies.
+ *
+ *  When the sky-projected separation of a planet and the star may reach
+ *  its minimum within half a step of the current time, the time of the
+ *  minimum is found by Newton iterations on d(b^2)/dt = 0: the whole
+ *  system is advanced with a Taylor series to the estimate and the
+ *  accelerations and jerks are evaluated there by \ref swarm::cpu::calc_acc_jerk,
+ *  until the correction is smaller than log_transit_tol. The system is
+ *  restored afterwards.
+ *  The work arrays are taken from the scratch arena of the integrator
+ *  (c.f. monitors::set_scratch_arena).
+ *
+ *   *  Assumes integration results in increasing time and a fixed time step.
+ *
+ *  \ingroup monitors
+ */
+template<class log_t>
+class log_transit_cpu {
+	public:
+	typedef log_transit_cpu_params params;
+
+	private:
+	params _params;
+	bool condition_met;
+
+	ensemble::SystemRef& _sys;
+	log_t& _log;
+
+	//! State of the integration, restored after the iterations, and the force field, c.f. set_scratch_arena
+	double (*_pos)[3], (*_vel)[3], (*_acc)[3], (*_jerk)[3];
+
+	public:
+	template<class T>
+	static GENERIC int thread_per_system(T compile_time_param){
+		return 1;
+	}
+
+	template<class T>
+	static GENERIC int shmem_per_system(T compile_time_param) {
+		return 0;
+	}
+	bool is_deactivate_on() { return false; };
+	bool is_log_on() { return _params.tol!=0.; };
+	bool is_verbose_on() { return false; };
+	bool is_any_on() { return is_deactivate_on() || is_log_on() || is_verbose_on() ; }
+	bool is_condition_met () { return ( condition_met ); }
+	bool need_to_log_system ()
+	{ return (is_log_on() && is_condition_met() ); }
+	bool need_to_deactivate ()
+	{ return ( is_deactivate_on() && is_condition_met() ); }
+
+	void log_system()  {  log::system(_log, _sys);  }
+
+	void operator () (const int thread_in_system)
+	{
+		pass_one(thread_in_system);
+		pass_two(thread_in_system);
+		if(need_to_log_system() && (thread_in_system==0) )
+			log_system();
+	}
+
+	//! The tests need the standard coordinates, c.f. mvs_cpu
+	bool pass_one (const int thread_in_system)
+	{
+		condition_met = false;
+		return is_any_on();
+	}
+
+	//! Derivatives of b^2 = |dx|^2, the sky-projected separation of i and j, from the force field
+	void derivatives(const int& i, const int& j, double dx[2], double dv[2], double da[2], double dj[2], double& db2dt, double& d2b2dt2, double& d3b2dt3)
+	{
+		for(int c = 0; c < 2; c++) {
+			dx[c] = _sys[j][c].pos()-_sys[i][c].pos();
+			dv[c] = _sys[j][c].vel()-_sys[i][c].vel();
+			da[c] = _acc[j][c]-_acc[i][c];
+			dj[c] = _jerk[j][c]-_jerk[i][c];
+		}
+		db2dt = 2.*(dx[0]*dv[0]+dx[1]*dv[1]);
+		d2b2dt2 = 2.*(dv[0]*dv[0]+dv[1]*dv[1]+dx[0]*da[0]+dx[1]*da[1]);
+		d3b2dt3 = 6.*(dv[0]*da[0]+dv[1]*da[1])+2.*(dx[0]*dj[0]+dx[1]*dj[1]);
+	}
+
+	//! Time to the minimum of b^2 from its Taylor series
+	static double time_to_minimum(const double& db2dt, const double& d2b2dt2, const double& d3b2dt3)
+	{
+		double dt_try = -db2dt/d2b2dt2;  // find vertex of parabola
+		return -db2dt/(d2b2dt2+0.5*dt_try*d3b2dt3);
+	}
+
+	/*! Time of the minimum of b^2 between i and j relative to the current
+	 *  time, the minimum impact parameter b and the projected velocity at
+	 *  that time. vproj is negative if there is no minimum within half a
+	 *  step of the current time.
+	 */
+	void calc_transit_time(const int& i, const int& j, const double& dt, const double& b2begin, double& dt_min_b2, double& b, double& vproj)
+	{
+		const int nbod = _sys.nbod();
+		double dx[2], dv[2], da[2], dj[2], db2dt, d2b2dt2, d3b2dt3;
+		cpu::calc_acc_jerk(_sys, _acc, _jerk);
+		derivatives(i, j, dx, dv, da, dj, db2dt, d2b2dt2, d3b2dt3);
+		double dt_try = time_to_minimum(db2dt, d2b2dt2, d3b2dt3);
+
+		if((dt_try<=-0.5*dt) || (dt_try>0.5*dt) ) // ignore if already past or vertex past next step
+		  { dt_min_b2 = dt_try; b=-1.; vproj = -1.; return;  }
+
+		// store values from actual integration to return to after finding transit time
+		for(int bod = 0; bod < nbod; bod++) for(int c = 0; c < 3; c++)
+			_pos[bod][c] = _sys[bod][c].pos(), _vel[bod][c] = _sys[bod][c].vel();
+
+		double dt_cum = 0., b2 = b2begin;
+		for(int iter=0;iter<_params.num_max_iter;++iter)
+		  {
+			// take trial step towards transit mid-point
+			for(int bod = 0; bod < nbod; bod++) for(int c = 0; c < 3; c++) {
+				const double a = _acc[bod][c], jk = _jerk[bod][c];
+				_sys[bod][c].pos() += dt_try*(_sys[bod][c].vel()+(dt_try*0.5)*(a+(dt_try/3.0)*jk));
+				_sys[bod][c].vel() += dt_try*(a+(dt_try*0.5)*jk);
+			}
+			dt_cum += dt_try;
+			cpu::calc_acc_jerk(_sys, _acc, _jerk);
+			derivatives(i, j, dx, dv, da, dj, db2dt, d2b2dt2, d3b2dt3);
+			b2 = dx[0]*dx[0]+dx[1]*dx[1];
+			dt_try = time_to_minimum(db2dt, d2b2dt2, d3b2dt3);
+			if(fabs(dt_try)<=_params.tol) break;
+		  }
+		// last correction from the Taylor series
+		dt_cum += dt_try;
+		b2 += dt_try*(db2dt+0.5*dt_try*(d2b2dt2+dt_try*d3b2dt3/3.));
+		dv[0] += dt_try*(da[0]+0.5*dt_try*dj[0]);
+		dv[1] += dt_try*(da[1]+0.5*dt_try*dj[1]);
+
+		// restore values from main integration
+		for(int bod = 0; bod < nbod; bod++) for(int c = 0; c < 3; c++)
+			_sys[bod][c].pos() = _pos[bod][c], _sys[bod][c].vel() = _vel[bod][c];
+
+		if((dt_cum<=-0.5*dt) || (dt_cum>0.5*dt) ) // ignore if already past or vertex past next step
+		  { dt_min_b2 = dt_cum; b=-1.; vproj = -1.; return;  }
+
+		dt_min_b2 = 0.;
+		double min_b2 = b2begin;
+		if(b2<min_b2) { min_b2 = b2; dt_min_b2 = dt_cum; }
+		b = (min_b2>=0) ? sqrt(min_b2) : -sqrt(-min_b2);
+		vproj = sqrt(dv[0]*dv[0]+dv[1]*dv[1]);
+	}
+
+	//! Log a transit or occultation of j and i = 0 near the current time
+	bool check_in_transit(const int& i, const int& j, const double dt)
+	{
+		double depth = _sys[j][2].pos()-_sys[i][2].pos();
+		if(!_params.log_on_occultation && (depth < 0.)) return false;
+		if(!_params.log_on_transit && (depth > 0.)) return false;
+
+		double dx[2] = { _sys[j][0].pos()-_sys[i][0].pos(), _sys[j][1].pos()-_sys[i][1].pos() };
+		double dv[2] = { _sys[j][0].vel()-_sys[i][0].vel(), _sys[j][1].vel()-_sys[i][1].vel() };
+		double b2begin = dx[0]*dx[0]+dx[1]*dx[1];
+		double db2dt = 2.*(dx[0]*dv[0]+dx[1]*dv[1]);
+
+		double radi = (_sys.num_body_attributes()>=1) ? _sys[i].attribute(0) : 0.;
+		double radj = (_sys.num_body_attributes()>=1) ? _sys[j].attribute(0) : 0.;
+		if( std::min(b2begin-0.5*dt*db2dt,b2begin+0.5*dt*db2dt)>(radi+radj)*(1.+_params.tol)*(radi+radj)*(1.+_params.tol) )
+			return false;
+
+		double dt_min_b2, b, vproj;
+		calc_transit_time(i,j,dt,b2begin,dt_min_b2,b,vproj);
+		if(vproj < 0.) return false;
+
+		if(_sys.num_body_attributes()>=1)
+		  {
+			if (depth>0.)  { b /= radi; vproj /= radi; }
+			else      { b /= radj; vproj /= radj; }
+		  }
+
+		if((dt_min_b2>=-0.5*dt)&&(dt_min_b2<0.5*dt))
+		  {
+			double tout = _sys.time()+dt_min_b2;
+			int event_id = (depth>0.) ? log::EVT_TRANSIT : log::EVT_OCCULTATION;
+			log::event(_log,event_id,tout,_sys.id(),j,b,vproj);
+		  }
+		return true;
+	}
+
+	int pass_two (const int thread_in_system)
+	{
+		if(is_any_on() && (thread_in_system==0))
+		  {
+			for(int b = 1; b < _sys.nbod(); b++)
+				condition_met = check_in_transit(0,b,_params.dt) || condition_met;
+		  }
+		return _sys.state();
+	}
+
+	//! Take the work arrays from the scratch arena of the integrator
+	void set_scratch_arena(scratch_arena& a) {
+		const int nbod = _sys.nbod();
+		_pos = a.alloc<double[3]>(nbod), _vel = a.alloc<double[3]>(nbod);
+		_acc = a.alloc<double[3]>(nbod), _jerk = a.alloc<double[3]>(nbod);
+	}
+
+	log_transit_cpu(const params& p,ensemble::SystemRef& s,log_t& l)
+		:_params(p),_sys(s),_log(l),_pos(0),_vel(0),_acc(0),_jerk(0) {}
+
+};
+
+}
+
+
+}
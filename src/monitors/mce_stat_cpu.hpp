@@ -0,0 +1,344 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Thien Nguyen and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file mce_stat_cpu.hpp
+ *   \brief Defines and implements the monitor \ref swarm::monitors::mce_stat_cpu
+ *          that keeps MERCURY-style close encounter statistics for the
+ *          CPU integrators.
+ *
+ *  *EXPERIMENTAL*: This class is not thoroughly tested.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include "swarm/runtime.hpp"
+#include "monitor_scratch.hpp"
+
+namespace swarm {
+  namespace monitors {
+
+/** Parameters for mce_stat_cpu monitor
+ * rceh (real): close encounter distance in Hill radii, as in MERCURY
+ * mce_encounter_count_attribute (int): system attribute that counts the close encounters (-1 for none)
+ * mce_min_distance_attribute (int): system attribute that holds the distance of the closest encounter (-1 for none)
+ * deactivate_on_close_encounter (bool): deactivate the system on a collision
+ * log_on_close_encounter (bool): log encounters and collisions
+ * verbose_on_close_encounter (bool): print encounters and collisions
+ *
+ * \ingroup monitors_param
+ */
+struct mce_stat_cpu_params {
+	double rceh;
+	int count_attribute, distance_attribute;
+	bool deactivate_on, log_on, verbose_on;
+
+	mce_stat_cpu_params(const config &cfg)
+	{
+		rceh = cfg.optional("rceh",1e-6);
+		count_attribute = cfg.optional("mce_encounter_count_attribute",-1);
+		distance_attribute = cfg.optional("mce_min_distance_attribute",-1);
+		if(count_attribute >= ensemble::NUM_SYS_ATTRIBUTES || distance_attribute >= ensemble::NUM_SYS_ATTRIBUTES)
+			ERROR("mce_stat_cpu: attribute number is larger than the number of system attributes");
+		deactivate_on = cfg.optional("deactivate_on_close_encounter",false);
+		log_on = cfg.optional("log_on_close_encounter",false);
+		verbose_on = cfg.optional("verbose_on_close_encounter",false);
+	}
+};
+
+/** Monitor that keeps close encounter statistics of the planets like
+ *  mce_stat (the close encounter routines of MERCURY by J. E. Chambers),
+ *  for the CPU integrators.
+ *
+ *  mce_stat needs the shared memory and the thread layout of the GPU
+ *  integrators. This monitor keeps the state at the end of the previous
+ *  step itself, in one array per coordinate, and finds the minimum
+ *  separation of every pair during the step from the cubic Hermite
+ *  interpolation of their squared distance (mce_min in MERCURY). The loop
+ *  over the pairs has no branches and no shared state, so the compiler
+ *  vectorizes it; the encounters themselves are rare and are handled in
+ *  a second loop over the results.
+ *
+ *  The close encounter distance of a planet is rceh times its Hill radius
+ *  at the beginning of the integration, its physical radius is body
+ *  attribute 0 (zero if the system has no body attributes). A close
+ *  encounter is a closest approach of two planets within the larger of
+ *  their close encounter distances, a collision a closest approach within
+ *  the sum of their radii. The closest approaches are found in the step
+ *  in which the distance stops decreasing, so every one is seen exactly
+ *  once, even when the integration is split into several launches. The
+ *  statistics are kept in the system attributes
+ *
+ *   * mce_encounter_count_attribute: number of close encounters,
+ *   * mce_min_distance_attribute: distance of the closest encounter
+ *     (zero before the first one),
+ *
+ *  which carry over to the next launch. With log_on_close_encounter it logs
+ *
+ *   * EVT_ENCOUNTER (i, j, distance) at the time of closest approach,
+ *   * EVT_COLLISION (i, j, distance) when two planets collide,
+ *   * EVT_COLLISION_CENTRAL (0, j, distance) when a planet comes within
+ *     the sum of its radius and the radius of the star.
+ *
+ *  A collision makes the condition true, so it deactivates the system with
+ *  deactivate_on_close_encounter. Unlike mce_stat, bodies are not merged.
+ *  The arrays are taken from the scratch arena of the integrator
+ *  (c.f. monitors::set_scratch_arena).
+ *
+ *  \ingroup monitors
+ */
+template<class log_t>
+class mce_stat_cpu {
+	public:
+	typedef mce_stat_cpu_params params;
+
+	private:
+	//! Positions and velocities of every body, one array per coordinate
+	struct state_t {
+		double *x, *y, *z, *u, *v, *w;
+	};
+
+	params _params;
+	bool condition_met;
+
+	ensemble::SystemRef& _sys;
+	log_t& _log;
+
+	int _nbod;
+	double _last_time;
+	//! State at the end of the last step and at the end of this one, c.f. set_scratch_arena
+	state_t _s0, _s1;
+	//! Close encounter distance and physical radius of every body
+	double *_rce, *_radius;
+	//! Minimum squared distance of the last step and its time relative to the end of the step, per j < i
+	double *_d2min, *_tmin;
+	//! Whether the distance of i and j reached a minimum during the last step, per j < i
+	char *_approach;
+
+	public:
+	template<class T>
+	static GENERIC int thread_per_system(T compile_time_param){
+		return 1;
+	}
+
+	template<class T>
+	static GENERIC int shmem_per_system(T compile_time_param) {
+		return 0;
+	}
+	bool is_deactivate_on() { return _params.deactivate_on; };
+	bool is_log_on() { return _params.log_on; };
+	bool is_verbose_on() { return _params.verbose_on; };
+	bool is_any_on() { return is_deactivate_on() || is_log_on() || is_verbose_on() ; }
+	bool is_condition_met () { return ( condition_met ); }
+	bool need_to_log_system ()
+	{ return (is_log_on() && is_condition_met() ); }
+	bool need_to_deactivate ()
+	{ return ( is_deactivate_on() && is_condition_met() ); }
+
+	void log_system()  {  log::system(_log, _sys);  }
+
+	void operator () (const int thread_in_system)
+	{
+		pass_one(thread_in_system);
+		pass_two(thread_in_system);
+		if(need_to_log_system() && (thread_in_system==0) )
+			log_system();
+	}
+
+	//! The statistics need the standard coordinates after every step, c.f. mvs_cpu
+	bool pass_one (const int thread_in_system)
+	{
+		condition_met = false;
+		return true;
+	}
+
+	int pass_two (const int thread_in_system)
+	{
+		if(thread_in_system!=0) return _sys.state();
+		const double h = _sys.time() - _last_time;
+		load(_s1);
+		if(h > 0)
+		  {
+			for(int i = 1; i < _nbod; i++) {
+				min_distance_during_step(i, h);
+				update_statistics(i);
+			}
+		  }
+		std::swap(_s0, _s1);
+		_last_time = _sys.time();
+		if(need_to_deactivate())
+			_sys.set_disabled();
+		return _sys.state();
+	}
+
+	//! Take the arrays from the scratch arena of the integrator and load the initial state
+	void set_scratch_arena(scratch_arena& a) {
+		state_t* s[2] = { &_s0, &_s1 };
+		for(int k = 0; k < 2; k++) {
+			s[k]->x = a.alloc<double>(_nbod), s[k]->y = a.alloc<double>(_nbod), s[k]->z = a.alloc<double>(_nbod);
+			s[k]->u = a.alloc<double>(_nbod), s[k]->v = a.alloc<double>(_nbod), s[k]->w = a.alloc<double>(_nbod);
+		}
+		_rce = a.alloc<double>(_nbod), _radius = a.alloc<double>(_nbod);
+		_d2min = a.alloc<double>(_nbod), _tmin = a.alloc<double>(_nbod);
+		_approach = a.alloc<char>(_nbod);
+		load(_s0);
+		init();
+	}
+
+	mce_stat_cpu(const params& p,ensemble::SystemRef& s,log_t& l)
+		:_params(p),condition_met(false),_sys(s),_log(l),_nbod(s.nbod()),_last_time(s.time())
+		,_rce(0),_radius(0),_d2min(0),_tmin(0),_approach(0)
+	{
+		state_t none = { 0, 0, 0, 0, 0, 0 };
+		_s0 = _s1 = none;
+	}
+
+	private:
+
+	void load(const state_t& s)
+	{
+		for(int b = 0; b < _nbod; b++) {
+			s.x[b] = _sys[b][0].pos(), s.y[b] = _sys[b][1].pos(), s.z[b] = _sys[b][2].pos();
+			s.u[b] = _sys[b][0].vel(), s.v[b] = _sys[b][1].vel(), s.w[b] = _sys[b][2].vel();
+		}
+	}
+
+	//! Close encounter distances from the Hill radii of the initial orbits (mce_init in MERCURY)
+	void init()
+	{
+		const double third = 1./3.;
+		_rce[0] = 0.;
+		for(int b = 1; b < _nbod; b++) {
+			const double gm = _sys[0].mass() + _sys[b].mass();
+			const double r = sqrt(_s0.x[b]*_s0.x[b] + _s0.y[b]*_s0.y[b] + _s0.z[b]*_s0.z[b]);
+			const double v2 = _s0.u[b]*_s0.u[b] + _s0.v[b]*_s0.v[b] + _s0.w[b]*_s0.w[b];
+			double a = gm*r/(2.*gm - r*v2);
+			if(a <= 0.) a = r;
+			const double hill = a*pow(third*_sys[b].mass()/_sys[0].mass(), third);
+			_rce[b] = hill*_params.rceh;
+		}
+		// mce_stat derives the radius from the density, which gives back attribute 0
+		for(int b = 0; b < _nbod; b++)
+			_radius[b] = (_sys.num_body_attributes() >= 1) ? _sys[b].attribute(0) : 0.;
+	}
+
+	/*! Minimum squared distance of i and every j < i during the last step
+	 *  of length h, its time relative to the end of the step and whether
+	 *  it is a closest approach, into _d2min[j], _tmin[j] and _approach[j]
+	 *  (mce_min in MERCURY).
+	 */
+	void min_distance_during_step(const int& i, const double& h)
+	{
+		min_distance_during_step(i, h, _d2min, _tmin, _approach);
+	}
+
+	//! The results do not alias the state, so the loop needs no alias checks
+	void min_distance_during_step(const int& i, const double& h, double* __restrict d2min, double* __restrict tmin, char* __restrict approach)
+	{
+		const double xi0 = _s0.x[i], yi0 = _s0.y[i], zi0 = _s0.z[i], ui0 = _s0.u[i], vi0 = _s0.v[i], wi0 = _s0.w[i];
+		const double xi1 = _s1.x[i], yi1 = _s1.y[i], zi1 = _s1.z[i], ui1 = _s1.u[i], vi1 = _s1.v[i], wi1 = _s1.w[i];
+		const double *x0 = _s0.x, *y0 = _s0.y, *z0 = _s0.z, *u0 = _s0.u, *v0 = _s0.v, *w0 = _s0.w;
+		const double *x1 = _s1.x, *y1 = _s1.y, *z1 = _s1.z, *u1 = _s1.u, *v1 = _s1.v, *w1 = _s1.w;
+		for(int j = 0; j < i; j++) {
+			const double dx0 = xi0 - x0[j], dy0 = yi0 - y0[j], dz0 = zi0 - z0[j];
+			const double du0 = ui0 - u0[j], dv0 = vi0 - v0[j], dw0 = wi0 - w0[j];
+			const double dx1 = xi1 - x1[j], dy1 = yi1 - y1[j], dz1 = zi1 - z1[j];
+			const double du1 = ui1 - u1[j], dv1 = vi1 - v1[j], dw1 = wi1 - w1[j];
+			const double d0 = dx0*dx0 + dy0*dy0 + dz0*dz0, d0t = 2.*(dx0*du0 + dy0*dv0 + dz0*dw0);
+			const double d1 = dx1*dx1 + dy1*dy1 + dz1*dz1, d1t = 2.*(dx1*du1 + dy1*dv1 + dz1*dw1);
+
+			// Minimum of the cubic Hermite interpolant of d^2 on [-h, 0]
+			const double tmp = 6.*(d0 - d1);
+			const double a = tmp + 3.*h*(d0t + d1t);
+			const double b = tmp + 2.*h*(d0t + 2.*d1t);
+			const double c = h*d1t;
+			const double root = sqrt(std::max(b*b - 4.*a*c, 0.));
+			const double q = -0.5*(b + ((b > 0.) ? root : -root));
+			const double ratio = c/q;
+			const double tau = (q == 0.) ? 0. : std::max(std::min(ratio, 0.), -1.);
+			const double s = 1. + tau;
+			const double d2 = std::max(tau*tau*((3. + 2.*tau)*d0 + s*h*d0t)
+					+ s*s*((1. - 2.*tau)*d1 + tau*h*d1t), 0.);
+			const double t2 = tau*h;
+
+			// Separating at the start and approaching at the end: the minimum is at one end
+			const bool at_end = (d0t > 0.) & (d1t < 0.);
+			const double d2end = std::min(d0, d1), tend = (d0 < d1) ? -h : 0.;
+			const bool interior = !at_end & (d2 < d2end);
+			const double d2m = interior ? d2 : d2end, tm = interior ? t2 : tend;
+			d2min[j] = d2m, tmin[j] = tm;
+			// The end of one step is the start of the next, so only one step sees the sign change
+			approach[j] = (d0t < 0.) & (d1t >= 0.);
+		}
+	}
+
+	//! Update the statistics of i and every j < i from the last step
+	void update_statistics(const int& i)
+	{
+		// Planet with the star
+		{
+			const double rhit = _radius[i] + _radius[0];
+			if(_approach[0] && (_d2min[0] <= rhit*rhit))
+				report_collision(log::EVT_COLLISION_CENTRAL, 0, i);
+		}
+		for(int j = 1; j < i; j++) {
+			if(!_approach[j]) continue;
+			const double d2 = _d2min[j];
+			const double rce = std::max(_rce[i], _rce[j]);
+			if(d2 <= rce*rce)
+				record_encounter(j, i);
+			const double rhit = _radius[i] + _radius[j];
+			if(d2 <= rhit*rhit)
+				report_collision(log::EVT_COLLISION, j, i);
+		}
+	}
+
+	void record_encounter(const int& j, const int& i)
+	{
+		const double d = sqrt(_d2min[j]), t = _sys.time() + _tmin[j];
+		int n = 1;
+		if(_params.count_attribute >= 0)
+			n = (int) (_sys.attribute(_params.count_attribute) += 1.);
+		if(_params.distance_attribute >= 0) {
+			double& dmin = _sys.attribute(_params.distance_attribute);
+			if((dmin <= 0.) || (d < dmin)) dmin = d;
+		}
+		if(is_log_on())
+			log::event(_log, log::EVT_ENCOUNTER, t, _sys.id(), j, i, d);
+		if(is_verbose_on())
+			lprintf(_log, "Close encounter: sys=%d, T=%f j=%d i=%d d=%lg n=%d.\n"
+					, _sys.id(), t, j, i, d, n);
+	}
+
+	void report_collision(const int& event_id, const int& j, const int& i)
+	{
+		condition_met = true;
+		const double d = sqrt(_d2min[j]), t = _sys.time() + _tmin[j];
+		if(is_log_on())
+			log::event(_log, event_id, t, _sys.id(), j, i, d);
+		if(is_verbose_on())
+			lprintf(_log, "Collision: sys=%d, T=%f j=%d i=%d d=%lg.\n"
+					, _sys.id(), t, j, i, d);
+	}
+};
+
+}
+
+
+}
@@ -0,0 +1,72 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file monitor_scratch.hpp
+ *   \brief Defines \ref swarm::monitors::set_scratch_arena, which hands the
+ *          scratch arena of a CPU integrator to its monitor.
+ *
+ */
+
+#pragma once
+
+namespace swarm {
+
+class scratch_arena;
+
+namespace monitors {
+
+/*! value is true if Monitor has a member set_scratch_arena(scratch_arena&)
+ *
+ *  Monitors that need per-system work arrays (e.g. log_transit_cpu)
+ *  implement set_scratch_arena and take the arrays from the arena, like the
+ *  integrator does, instead of allocating them every time they are built.
+ *  The CPU integrators call monitors::set_scratch_arena() right after
+ *  building the monitor of a system. The arrays are valid until the
+ *  integrator is done with the system.
+ */
+template<class Monitor>
+struct accepts_scratch_arena {
+	typedef char yes[1];
+	typedef char no[2];
+	template<class U, void (U::*)(scratch_arena&)> struct check;
+	template<class U> static yes& test(check<U, &U::set_scratch_arena>*);
+	template<class U> static no& test(...);
+	static const bool value = sizeof(test<Monitor>(0)) == sizeof(yes);
+};
+
+template<bool accepts>
+struct scratch_arena_setter {
+	template<class Monitor>
+	static void set(Monitor&, scratch_arena&) {}
+};
+
+template<>
+struct scratch_arena_setter<true> {
+	template<class Monitor>
+	static void set(Monitor& m, scratch_arena& a) { m.set_scratch_arena(a); }
+};
+
+//! Pass the scratch arena of the integrator to m, if m can use it
+template<class Monitor>
+void set_scratch_arena(Monitor& m, scratch_arena& a) {
+	scratch_arena_setter< accepts_scratch_arena<Monitor>::value >::set(m, a);
+}
+
+}
+
+}
@@ -26,6 +26,8 @@
 #pragma once
 
 #include <limits>
+#include "swarm/step_geometry.hpp"
+#include "swarm/dense_output.hpp"
 
 namespace swarm { namespace monitors {
 
@@ -34,12 +36,13 @@ namespace swarm { namespace monitors {
  * log_on_close_encounter (bool): 
  * verbose_on_close_encounter (bool): 
  * close_approach (real): maximum distance in Hill radii to trigger action
+ * interpolate_close_encounters (bool): test the minimum distance during the step, if the integrator provides dense output
  *
  * \ingroup monitors_param
  */ 
 struct stop_on_close_encounter_param {
 	double dmin;
-  bool deactivate_on, log_on, verbose_on;
+  bool deactivate_on, log_on, verbose_on, interpolate;
   /*! \param cfg Configuration Paramaters
    */
 	stop_on_close_encounter_param(const config &cfg)
@@ -48,6 +51,7 @@ struct stop_on_close_encounter_param {
 		deactivate_on = cfg.optional("deactivate_on_close_encounter",false);
 		log_on = cfg.optional("log_on_close_encounter",false);
 		verbose_on = cfg.optional("verbose_on_close_encounter",false);
+		interpolate = cfg.optional("interpolate_close_encounters",true);
 	}
 };
 
@@ -56,7 +60,12 @@ struct stop_on_close_encounter_param {
  *  \ingroup experimental
 
  *  Signals and logs if current separation between any two bodies (measured in mutual Hill radii) is less than "close_approach".
- *  WARNING: Does not interpolate between steps
+ *  WARNING: Does not interpolate between steps on the GPU
+ *
+ *  With integrators that provide dense output (c.f. \ref swarm::step_interpolant),
+ *  the distance tested is a lower estimate of the minimum distance during
+ *  the step (\ref swarm::step_interpolant::min_distance), so encounters in
+ *  the middle of a step are found with larger time steps.
  *
  *  \ingroup monitors
  *  \ingroup monitors_for_planetary_systems
@@ -71,6 +80,8 @@ class stop_on_close_encounter {
         bool need_full_test, condition_met;
 	ensemble::SystemRef& _sys;
 	log_t& _log;
+	const step_geometry* _geom;
+	const step_interpolant* _interp;
 
 
 	public:
@@ -125,12 +136,24 @@ class stop_on_close_encounter {
 
 
 	GPUAPI bool check_close_encounters(const int& i, const int& j){
+		return check_close_encounters(i, j, distance_tested(i,j));
+	}
+
+	//! Lower estimate of the minimum distance during the step with dense output, the distance at its end otherwise
+	GPUAPI double distance_tested(const int& i, const int& j){
+		if( _params.interpolate && _interp != 0 && _interp->t1() == _sys.time() )
+			return _interp->min_distance(i,j);
+		return _geom ? _geom->distance_between(i,j) : _sys.distance_between(i,j);
+	}
+
+	//! Test whether the distance d between i and j is a close encounter
+	GPUAPI bool check_close_encounters(const int& i, const int& j, const double& d){
 
-		double d = _sys.distance_between(i,j);
 		double _GM = _sys[0].mass();  // remove _ if ok to keep
 		//		double rH = pow((_sys[i].mass()+_sys[j].mass())/(3.*_GM),1./3.);
 		//		bool close_encounter = d < _p.dmin * rH;
-		double a = 0.5*(_sys[i].distance_to_origin()+_sys[i].distance_to_origin());
+		const double ri = _geom ? _geom->distance_to_origin(i) : _sys[i].distance_to_origin();
+		double a = 0.5*(ri+ri);
 		double rH3 = (_sys[i].mass()+_sys[j].mass())/(3.*_GM)*a*a*a;
 		bool close_encounter = d*d*d < _params.dmin*_params.dmin*_params.dmin * rH3;
 
@@ -175,8 +198,14 @@ class stop_on_close_encounter {
   }
 #endif
 
+	//! Read the distances from the geometry cache of the integrator
+	GPUAPI void set_step_geometry(const step_geometry* geom) { _geom = geom; }
+
+	//! Test the minimum distances during the step from the interpolant of the integrator
+	GPUAPI void set_step_interpolant(const step_interpolant* interp) { _interp = interp; }
+
 	GPUAPI stop_on_close_encounter(const params& p,ensemble::SystemRef& s,log_t& l)
-	    :_params(p),_sys(s),_log(l){}
+	    :_params(p),_sys(s),_log(l),_geom(0),_interp(0){}
 	
 };
 
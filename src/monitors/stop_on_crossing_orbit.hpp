@@ -28,6 +28,8 @@
 #pragma once
 
 #include <limits>
+#include "swarm/step_geometry.hpp"
+#include "check_cadence.hpp"
 
 namespace swarm { namespace monitors {
 
@@ -35,12 +37,14 @@ namespace swarm { namespace monitors {
  * deactivate_on_crossing (bool): 
  * log_on_crossing (bool): 
  * verbose_on_crossing (bool): 
+ * crossing_check_interval (int): test every so many steps (default 1)
  *
  * \ingroup monitors_param
  * \ingroup monitors_for_planetary_systems
  */ 
 struct stop_on_crossing_orbit_params {
   bool deactivate_on, log_on, verbose_on;
+  int check_interval;
   /*! \param cfg Configuration Paramaters
    */
   stop_on_crossing_orbit_params(const config &cfg)
@@ -48,6 +52,7 @@ struct stop_on_crossing_orbit_params {
 	  deactivate_on = cfg.optional("deactivate_on_crossing",false);
 	  log_on = cfg.optional("log_on_crossing",false);
 	  verbose_on = cfg.optional("verbose_on_crossing",false);
+	  check_interval = cfg.optional("crossing_check_interval",1);
 	}
 };
 
@@ -60,6 +65,12 @@ GPUAPI double sqr(const double& d){
  *  \ingroup experimental
  * 
  *  WARNING:  This only tests for potential orbit crossing and makes assumptions about planet ordering
+ *
+ *  The orbital elements change slowly, with crossing_check_interval = K
+ *  the orbits are tested every K steps (c.f. \ref check_cadence).
+ *  Secular oscillations can make orbits cross for a while only, so K
+ *  steps should be short compared to the secular time scales, otherwise
+ *  a crossing can be missed.
  *  \ingroup monitors
  */
 template<class log_t>
@@ -72,6 +83,9 @@ class stop_on_crossing_orbit {
         bool condition_met;
 	ensemble::SystemRef& _sys;
 	log_t& _log;
+	const step_geometry* _geom;
+	check_cadence _cadence;
+	bool test_due;
 
 
 	public:
@@ -106,7 +120,8 @@ class stop_on_crossing_orbit {
 		// h2 = ||pos X vel||^2
 		double h2 = sqr(y*vz-z*vy) + sqr(z*vx-x*vz) + sqr(x*vy-y*vx);
 		double _GM = _sys[b].mass(); 
-		double r = _sys[b].distance_to_origin(), sp = _sys[b].speed();
+		double r = _geom ? _geom->distance_to_origin(b) : _sys[b].distance_to_origin();
+		double sp = _geom ? sqrt(_geom->speed_squared(b)) : _sys[b].speed();
 		double energy = sp*0.5-_GM/r;
 
 		a = -0.5*_GM/energy;
@@ -176,13 +191,14 @@ class stop_on_crossing_orbit {
 	GPUAPI bool pass_one (int thread_in_system) 
           {
 	    condition_met = false;
-	    return true;
+	    test_due = is_any_on() && (thread_in_system==0) && _cadence.due();
+	    return test_due;
 	  }
 	    
 
 	GPUAPI int pass_two (int thread_in_system) 
           {
-	    if(is_any_on() && (thread_in_system==0) )
+	    if( test_due )
 	      {
 		// Check for crossing orbits between every pair of planets
 		for(int j = 2; j < _sys.nbod(); j++)
@@ -197,8 +213,11 @@ class stop_on_crossing_orbit {
 	  }
 
 
+	//! Read the distances and speeds from the geometry cache of the integrator
+	GPUAPI void set_step_geometry(const step_geometry* geom) { _geom = geom; }
+
 	GPUAPI stop_on_crossing_orbit(const params& p,ensemble::SystemRef& s,log_t& l)
-	    :_params(p),_sys(s),_log(l){}
+	    :_params(p),_sys(s),_log(l),_geom(0),_cadence(p.check_interval),test_due(false){}
 	
 };
 
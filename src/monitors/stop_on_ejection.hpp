@@ -26,6 +26,8 @@
 
 #include <limits>
 #include "../swarm/types/config.hpp"
+#include "../swarm/step_geometry.hpp"
+#include "check_cadence.hpp"
 
 namespace swarm {
   namespace monitors {
@@ -35,6 +37,8 @@ namespace swarm {
  * log_on_ejection (bool): 
  * verbose_on_ejection (bool): 
  * rmax (real): minimum distance to check for ejections
+ * ejection_check_interval (int): test every so many steps (default 1)
+ * ejection_check_bound (bool): skip the tests until a body could have reached rmax
  *
  * \ingroup monitors_param
  * \ingroup monitors_for_planetary_systems
@@ -42,6 +46,8 @@ namespace swarm {
 struct stop_on_ejection_params {
 	double rmax;
         bool deactivate_on, log_on, verbose_on;
+	int check_interval;
+	bool check_bound;
   /*! \param cfg Configuration Paramaters
    */
 	stop_on_ejection_params(const config &cfg)
@@ -50,6 +56,8 @@ struct stop_on_ejection_params {
 		deactivate_on = cfg.optional("deactivate_on_ejection",false);
 		log_on = cfg.optional("log_on_ejection",false);
 		verbose_on = cfg.optional("verbose_on_ejection",false);
+		check_interval = cfg.optional("ejection_check_interval",1);
+		check_bound = cfg.optional("ejection_check_bound",false);
 	}
 };
 
@@ -58,6 +66,13 @@ struct stop_on_ejection_params {
  *	2. is moving away from the origin
  *	3. is on a nearly parabolic or hyperbolic orbit from origin (neglecting mutual interactions)
  *	Note that this stopping criteria is specifically written for planetary systems with barycenter or star at origin.
+ *
+ *  An ejection is not undone, so the test does not have to run every
+ *  step. With ejection_check_interval = K it runs every K steps. With
+ *  ejection_check_bound, every test also estimates how soon a body could
+ *  reach rmax, (rmax - r) / (2 v) for the closest candidate, where the
+ *  factor 2 allows for perturbations of the Keplerian speed, and no
+ *  test runs before that.
  *  \ingroup monitors
  *  \ingroup monitors_for_planetary_systems
  */
@@ -66,12 +81,15 @@ class stop_on_ejection {
 	public:
 	typedef stop_on_ejection_params params;
 
-	private:
+	protected:
 	params _params;
         bool condition_met;
 
 	ensemble::SystemRef& _sys;
 	log_t& _log;
+	const step_geometry* _geom;
+	check_cadence _cadence;
+	double _last_test_time, _safe_interval;
 
 	public:
 
@@ -109,13 +127,13 @@ class stop_on_ejection {
 
 		double x,y,z,vx,vy,vz; _sys[b].get(x,y,z,vx,vy,vz);
 		//		double r = sqrt(_sys[b].distance_to_origin_squared());  // WARNING: Deceiving function name
-		double r = _sys[b].distance_to_origin();  // WARNING: Deceiving function name
+		double r = _geom ? _geom->distance_to_origin(b) : _sys[b].distance_to_origin();  // WARNING: Deceiving function name
 		if( r < _params.rmax ) return false;
 		double rdotv = x*vx+y*vy+z*vz;
 		if( rdotv <= 0. ) return false;
 		
 		bool stopit = false;
-		double speed_sq = _sys[b].speed_squared();  // WARNING: Deceiving function name
+		double speed_sq = _geom ? _geom->speed_squared(b) : _sys[b].speed_squared();  // WARNING: Deceiving function name
 		double epp = 0.5*speed_sq*r/_sys[b].mass()-1.;
 		if( fabs(epp) < 1e-4 ) {
 			double energy = 0.5*speed_sq-_sys[b].mass()/r;
@@ -171,18 +189,46 @@ class stop_on_ejection {
 
         //! default constructor for stop_on_ejection
 	GPUAPI stop_on_ejection(const params& p,ensemble::SystemRef& s,log_t& l)
-		:_params(p),_sys(s),_log(l){}
+		:_params(p),_sys(s),_log(l),_geom(0),_cadence(p.check_interval)
+		,_last_test_time(s.time()),_safe_interval(0){}
+
+	//! Read the distances and speeds from the geometry cache of the integrator
+	GPUAPI void set_step_geometry(const step_geometry* geom) { _geom = geom; }
+
+	//! True if the bodies should be tested this step
+	GPUAPI bool test_due() {
+		if( !_cadence.due() ) return false;
+		return !_params.check_bound || fabs(_sys.time() - _last_test_time) >= _safe_interval;
+	}
+
+	//! Shortest time in which a body could get from its current distance to rmax
+	GPUAPI double time_to_reach_rmax() {
+		double t = std::numeric_limits<double>::max();
+		for(int b = 1; b < _sys.nbod(); b++) {
+			const double r = _geom ? _geom->distance_to_origin(b) : _sys[b].distance_to_origin();
+			const double v2 = _geom ? _geom->speed_squared(b) : _sys[b].speed_squared();
+			if( r >= _params.rmax ) return 0;
+			if( v2 > 0 ) {
+				const double tb = (_params.rmax - r) / (2 * sqrt(v2));
+				if( tb < t ) t = tb;
+			}
+		}
+		return t;
+	}
 
         //! check bodies other than the central star and set the status of need_full_test
 	GPUAPI bool pass_one (int thread_in_system) 
           {
 	    bool need_full_test = false; 
 	    condition_met = false;
-	    if(is_any_on()&&(thread_in_system==0))
+	    if(is_any_on()&&(thread_in_system==0)&&test_due())
 	      {
 		// Check each body other than central star
 		for(int b = 1; b < _sys.nbod(); b++)
 		  condition_met = condition_met || test_body(b);
+
+		if( _params.check_bound )
+		  {  _last_test_time = _sys.time(); _safe_interval = time_to_reach_rmax();  }
 		
 		if( condition_met && is_log_on() )
 		  {  need_full_test = true;  }
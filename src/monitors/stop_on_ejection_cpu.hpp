@@ -0,0 +1,111 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file stop_on_ejection_cpu.hpp
+ *   \brief Defines the monitor \ref swarm::monitors::stop_on_ejection_cpu,
+ *          stop_on_ejection with a cheap pre-filter for the CPU integrators.
+ *
+ */
+
+#pragma once
+
+#include "stop_on_ejection.hpp"
+
+namespace swarm {
+  namespace monitors {
+
+/** Same as stop_on_ejection, for the CPU integrators.
+ *
+ *  A body can only be ejected once it is farther than rmax from the
+ *  origin, which almost never happens. Instead of running test_body,
+ *  with its square roots, for every body, this monitor first compares the
+ *  squared distances of all bodies with rmax^2 in one loop without
+ *  branches, which the compiler vectorizes, and runs test_body only for
+ *  the bodies beyond rmax. The filter reads the positions even when the
+ *  integrator provides a step geometry, whose distances need a square root
+ *  per body. The results are the same as stop_on_ejection.
+ *
+ *  The CPU integrators select this monitor automatically in place of
+ *  stop_on_ejection (c.f. \ref cpu_monitor).
+ *
+ *  \ingroup monitors
+ *  \ingroup monitors_for_planetary_systems
+ */
+template<class log_t>
+class stop_on_ejection_cpu : public stop_on_ejection<log_t> {
+	typedef stop_on_ejection<log_t> base;
+	//! rmax^2, rounded down so that no body that test_body accepts is filtered out
+	double _rmax2;
+
+	public:
+	typedef typename base::params params;
+
+	stop_on_ejection_cpu(const params& p,ensemble::SystemRef& s,log_t& l)
+		:base(p,s,l),_rmax2(p.rmax*p.rmax*(1-1e-12)){}
+
+	//! Whether body b is not closer than rmax, without a square root
+	bool candidate(const int& b) {
+		ensemble::SystemRef& sys = base::_sys;
+		const double x = sys[b][0].pos(), y = sys[b][1].pos(), z = sys[b][2].pos();
+		return x*x + y*y + z*z >= _rmax2;
+	}
+
+	//! Number of bodies other than the central star that are not closer than rmax
+	int count_candidates() {
+		int n = 0;
+		for(int b = 1; b < base::_sys.nbod(); b++)
+			n += candidate(b);
+		return n;
+	}
+
+	//! Same as stop_on_ejection::pass_one, running test_body only for candidates
+	bool pass_one (int thread_in_system) 
+	{
+		bool need_full_test = false; 
+		base::condition_met = false;
+		if(base::is_any_on()&&(thread_in_system==0)&&base::test_due())
+		{
+			// test_body rejects the bodies closer than rmax itself
+			if( count_candidates() > 0 )
+				for(int b = 1; b < base::_sys.nbod(); b++)
+					if( candidate(b) )
+						base::condition_met = base::condition_met || base::test_body(b);
+
+			if( base::_params.check_bound )
+			{  base::_last_test_time = base::_sys.time(); base::_safe_interval = base::time_to_reach_rmax();  }
+
+			if( base::condition_met && base::is_log_on() )
+			{  need_full_test = true;  }
+		}
+		return need_full_test;
+	}
+
+	void operator () (const int thread_in_system) 
+	{ 
+		pass_one(thread_in_system);
+		base::pass_two(thread_in_system);
+		if(base::need_to_log_system() && (thread_in_system==0) )
+			base::log_system();
+	}
+
+	//! Read the distances and speeds from the geometry cache of the integrator
+	void set_step_geometry(const step_geometry* geom) { base::set_step_geometry(geom); }
+};
+
+}
+}
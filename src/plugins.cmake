@@ -8,7 +8,8 @@
 
 # CPU plugins
 ADD_PLUGIN(plugins/hermite_cpu.cpp Hermite_CPU TRUE "Hermite CPU Integrator[uses OpenMP by default]")
-ADD_PLUGIN(plugins/mvs_cpu.cpp MVS_CPU FALSE "MVS CPU Integrator")
+ADD_PLUGIN(plugins/mvs_cpu.cpp MVS_CPU TRUE "MVS CPU Integrator")
+ADD_PLUGIN(plugins/hybrid_cpu.cpp Hybrid_CPU TRUE "Hybrid symplectic CPU Integrator for close encounters")
 if(OPENMP_FOUND)
 	ADD_PLUGIN(plugins/mvs_omp.cpp MVS_OMP FALSE "MVS OpenMP Integrator")
 endif()
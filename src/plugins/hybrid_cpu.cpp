@@ -0,0 +1,49 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Eric Ford and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file hybrid_cpu.cpp
+ *   \brief Initializes the CPU version of the hybrid symplectic integrator plugins.
+ *
+ */
+
+
+#include "integrators/hybrid_cpu.hpp"
+#include "monitors/log_time_interval.hpp"
+#include "monitors/stop_on_ejection.hpp"
+#include "monitors/mce_stat_cpu.hpp"
+
+//! Declare host_log variable
+typedef gpulog::host_log L;
+using namespace swarm::monitors;
+using namespace swarm::cpu;
+using swarm::integrator_plugin_initializer;
+
+//! Initialize the integrator plugin for the hybrid integrator on CPU
+integrator_plugin_initializer<
+  hybrid_cpu< stop_on_ejection<L> >
+	> hybrid_cpu_plugin("hybrid_cpu");
+
+//! Initialize the integrator plugin for the hybrid log integrator on CPU
+integrator_plugin_initializer<
+  hybrid_cpu< log_time_interval<L> >
+	> hybrid_cpu_log_plugin("hybrid_cpu_log");
+
+//! Initialize the integrator plugin for hybrid_cpu_mce_stat
+integrator_plugin_initializer<
+  hybrid_cpu< mce_stat_cpu<L> >
+	> hybrid_cpu_mce_stat_plugin("hybrid_cpu_mce_stat");
@@ -25,6 +25,9 @@
 #include "monitors/log_time_interval.hpp"
 #include "monitors/stop_on_ejection.hpp"
 #include "monitors/composites.hpp"
+#include "monitors/log_transit_cpu.hpp"
+#include "monitors/log_rvs_cpu.hpp"
+#include "monitors/mce_stat_cpu.hpp"
 
 //! Declare host_log variable
 typedef gpulog::host_log L;
@@ -37,7 +40,17 @@ integrator_plugin_initializer<
   irk2_cpu< stop_on_ejection<L> >
         > irk2_cpu_plugin("irk2_cpu");
 
+//! Initialize the integrator plugin for irk2_cpu_transit
+integrator_plugin_initializer<
+  irk2_cpu< log_transit_cpu<L> >
+	> irk2_cpu_transit_plugin("irk2_cpu_transit");
 
+//! Initialize the integrator plugin for irk2_cpu_rvs
+integrator_plugin_initializer<
+  irk2_cpu< log_rvs_cpu<L> >
+	> irk2_cpu_rvs_plugin("irk2_cpu_rvs");
 
-
-
+//! Initialize the integrator plugin for irk2_cpu_mce_stat
+integrator_plugin_initializer<
+  irk2_cpu< mce_stat_cpu<L> >
+	> irk2_cpu_mce_stat_plugin("irk2_cpu_mce_stat");
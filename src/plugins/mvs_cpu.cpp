@@ -26,6 +26,9 @@
 #include "monitors/log_time_interval.hpp"
 #include "monitors/stop_on_ejection.hpp"
 #include "monitors/composites.hpp"
+#include "monitors/log_transit_cpu.hpp"
+#include "monitors/log_rvs_cpu.hpp"
+#include "monitors/mce_stat_cpu.hpp"
 
 //! Declare host_log variable
 typedef gpulog::host_log L;
@@ -56,4 +59,17 @@ integrator_plugin_initializer<
   mvs_cpu< log_time_interval<L> >
 	> mvs_cpu_log_plugin("mvs_cpu_log");
 
+//! Initialize the integrator plugin for mvs_cpu_transit
+integrator_plugin_initializer<
+  mvs_cpu< log_transit_cpu<L> >
+	> mvs_cpu_transit_plugin("mvs_cpu_transit");
+
+//! Initialize the integrator plugin for mvs_cpu_rvs
+integrator_plugin_initializer<
+  mvs_cpu< log_rvs_cpu<L> >
+	> mvs_cpu_rvs_plugin("mvs_cpu_rvs");
 
+//! Initialize the integrator plugin for mvs_cpu_mce_stat
+integrator_plugin_initializer<
+  mvs_cpu< mce_stat_cpu<L> >
+	> mvs_cpu_mce_stat_plugin("mvs_cpu_mce_stat");
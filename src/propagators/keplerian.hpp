@@ -67,8 +67,7 @@ GPUAPI void SC_prussing(double y, double& S, double &C)
      }
   else
      {
-       float absy = y;
-       absy = fabs(y);
+     const double absy = fabs(y);
      double u = sqrt(absy);
      double u3 = u*u*u;
      if (y>0.0) 
@@ -1,8 +1,14 @@
 #include "swarm/swarm.h"
 #include "swarm/snapshot.hpp"
+#include "swarm/multiprocess.hpp"
+#include "swarm/ragged.hpp"
 #include "swarm/kepler.h"
+#include "swarm/log/bdb_database.hpp"
 #include <boost/python.hpp>
 #include <boost/python/suite/indexing/map_indexing_suite.hpp>
+#include <boost/thread.hpp>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
 
 /** @file module.cpp
  *	@brief Python interface to the Swarm-NG
@@ -177,14 +183,540 @@ void bodattr_setitem(ensemble::Body::attributes_t& bodattr, const int& i, const
 	}
 }
 
+/*
+ * NumPy views of ensemble data
+ *
+ * The ensemble stores CHUNK_SIZE systems side by side in every Body and Sys
+ * struct (c.f. CoalescedStructArray). Merging the block and lane indices
+ * into one system index is not expressible with strides, so the views are
+ * 4-dimensional: view[s / CHUNK_SIZE, s % CHUNK_SIZE, ...] is system s.
+ * The views share memory with the ensemble and hold a reference to the
+ * Python ensemble object so the storage outlives them.
+ *
+ * The last chunk may contain padding lanes beyond nsys, their contents
+ * are meaningless.
+ */
+
+//! Import the NumPy C API, returns false if numpy cannot be imported
+bool import_numpy(){
+	import_array1(false);
+	return true;
+}
+
+//! Wrap a strided region of ensemble memory in an ndarray owned by ens_obj
+object make_view(object& ens_obj, void* data, int typenum, int nd, npy_intp* shape, npy_intp* strides){
+	PyObject* a = PyArray_New(&PyArray_Type, nd, shape, typenum, strides, data, 0, NPY_ARRAY_WRITEABLE, NULL);
+	if( a == NULL ) throw_error_already_set();
+	Py_INCREF(ens_obj.ptr());
+	if( PyArray_SetBaseObject((PyArrayObject*) a, ens_obj.ptr()) != 0 ) {
+		Py_DECREF(a);
+		throw_error_already_set();
+	}
+	return object(handle<>(a));
+}
+
+//! Byte offset of a member of the first Body/Sys struct
+inline npy_intp byte_offset(const void* p, const void* base){
+	return (const char*)p - (const char*)base;
+}
+
+/*! View over a per-body quantity (position, velocity, mass or attributes).
+ *  c_count is 3 for vectors, 0 for scalars (mass) and the number of
+ *  attributes for attributes.
+ */
+object body_view(object ens_obj, const double* first, const int& c_count, const npy_intp& c_stride){
+	ensemble& ens = extract<ensemble&>(ens_obj);
+	npy_intp shape[4] = { ens.bodies().block_count() / std::max(ens.nbod(),1), ensemble::CHUNK_SIZE, ens.nbod(), c_count };
+	npy_intp strides[4] = { (npy_intp) sizeof(ensemble::Body) * ens.nbod(), sizeof(double), sizeof(ensemble::Body), c_stride };
+	return make_view(ens_obj, (void*) first, NPY_DOUBLE, (c_count > 0) ? 4 : 3, shape, strides);
+}
+
+object positions_view(object ens_obj){
+	ensemble& ens = extract<ensemble&>(ens_obj);
+	ensemble::Body& b = ens.bodies().begin()[0];
+	return body_view(ens_obj, &b[0].pos(), 3, byte_offset(&b[1].pos(), &b[0].pos()) );
+}
+
+object velocities_view(object ens_obj){
+	ensemble& ens = extract<ensemble&>(ens_obj);
+	ensemble::Body& b = ens.bodies().begin()[0];
+	return body_view(ens_obj, &b[0].vel(), 3, byte_offset(&b[1].vel(), &b[0].vel()) );
+}
+
+object masses_view(object ens_obj){
+	ensemble& ens = extract<ensemble&>(ens_obj);
+	ensemble::Body& b = ens.bodies().begin()[0];
+	return body_view(ens_obj, &b.mass(), 0, 0 );
+}
+
+object body_attributes_view(object ens_obj){
+	ensemble& ens = extract<ensemble&>(ens_obj);
+	ensemble::Body& b = ens.bodies().begin()[0];
+	const npy_intp stride = (ensemble::NUM_BODY_ATTRIBUTES > 1) ? byte_offset(&b.attribute(1), &b.attribute(0)) : sizeof(double);
+	return body_view(ens_obj, &b.attribute(0), (int) ensemble::NUM_BODY_ATTRIBUTES, stride );
+}
+
+//! View over a per-system quantity, c_count is 0 for scalars
+object sys_view(object ens_obj, const void* first, const int& typenum, const int& c_count, const npy_intp& c_stride, const npy_intp& lane_stride){
+	ensemble& ens = extract<ensemble&>(ens_obj);
+	npy_intp shape[3] = { ens.systems().block_count(), ensemble::CHUNK_SIZE, c_count };
+	npy_intp strides[3] = { sizeof(ensemble::Sys), lane_stride, c_stride };
+	return make_view(ens_obj, (void*) first, typenum, (c_count > 0) ? 3 : 2, shape, strides);
+}
+
+object times_view(object ens_obj){
+	ensemble& ens = extract<ensemble&>(ens_obj);
+	ensemble::Sys& s = ens.systems().begin()[0];
+	return sys_view(ens_obj, &s.time(), NPY_DOUBLE, 0, 0, sizeof(double));
+}
+
+object states_view(object ens_obj){
+	ensemble& ens = extract<ensemble&>(ens_obj);
+	ensemble::Sys& s = ens.systems().begin()[0];
+	return sys_view(ens_obj, &s.state(), NPY_INT, 0, 0, sizeof(s._bunch[0]));
+}
+
+object ids_view(object ens_obj){
+	ensemble& ens = extract<ensemble&>(ens_obj);
+	ensemble::Sys& s = ens.systems().begin()[0];
+	return sys_view(ens_obj, &s.id(), NPY_INT, 0, 0, sizeof(s._bunch[0]));
+}
+
+object sys_attributes_view(object ens_obj){
+	ensemble& ens = extract<ensemble&>(ens_obj);
+	ensemble::Sys& s = ens.systems().begin()[0];
+	const npy_intp stride = (ensemble::NUM_SYS_ATTRIBUTES > 1) ? byte_offset(&s.attribute(1), &s.attribute(0)) : sizeof(double);
+	return sys_view(ens_obj, &s.attribute(0), NPY_DOUBLE, (int) ensemble::NUM_SYS_ATTRIBUTES, stride, sizeof(double));
+}
+
+//! Convert any array-like to a C-contiguous double array of the given shape
+PyArrayObject* require_double_array(const object& o, const int& nd, const npy_intp* shape, const char* name){
+	PyArrayObject* a = (PyArrayObject*) PyArray_FROMANY(o.ptr(), NPY_DOUBLE, nd, nd, NPY_ARRAY_IN_ARRAY);
+	if( a == NULL ) throw_error_already_set();
+	for(int i = 0; i < nd; i++)
+		if( PyArray_DIM(a,i) != shape[i] ) {
+			Py_DECREF(a);
+			PyErr_Format(PyExc_ValueError, "%s has the wrong shape, expected (nsys, nbod%s)", name, (nd == 3) ? ", 3" : "");
+			throw_error_already_set();
+		}
+	return a;
+}
+
+/*! Fill positions, velocities and masses of all systems from
+ *  arrays of shape (nsys,nbod,3), (nsys,nbod,3) and (nsys,nbod).
+ */
+void set_from_arrays(ensemble& ens, const object& pos, const object& vel, const object& mass){
+	const npy_intp shape[3] = { ens.nsys(), ens.nbod(), 3 };
+	PyArrayObject* p = require_double_array(pos, 3, shape, "pos");
+	PyArrayObject* v = require_double_array(vel, 3, shape, "vel");
+	PyArrayObject* m = require_double_array(mass, 2, shape, "mass");
+	const double* pp = (const double*) PyArray_DATA(p);
+	const double* vv = (const double*) PyArray_DATA(v);
+	const double* mm = (const double*) PyArray_DATA(m);
+
+	for(int i = 0; i < ens.nsys(); i++) {
+		ensemble::SystemRef s = ens[i];
+		for(int j = 0; j < ens.nbod(); j++, pp += 3, vv += 3, mm++) {
+			for(int c = 0; c < 3; c++)
+				s[j][c].pos() = pp[c], s[j][c].vel() = vv[c];
+			s[j].mass() = *mm;
+		}
+	}
+
+	Py_DECREF(p); Py_DECREF(v); Py_DECREF(m);
+}
+
+/*! Copy positions, velocities and masses of all systems out
+ *  into a tuple of new arrays (pos, vel, mass) with shapes
+ *  (nsys,nbod,3), (nsys,nbod,3) and (nsys,nbod).
+ */
+tuple to_arrays(ensemble& ens){
+	npy_intp shape[3] = { ens.nsys(), ens.nbod(), 3 };
+	object pos(handle<>(PyArray_SimpleNew(3, shape, NPY_DOUBLE)));
+	object vel(handle<>(PyArray_SimpleNew(3, shape, NPY_DOUBLE)));
+	object mass(handle<>(PyArray_SimpleNew(2, shape, NPY_DOUBLE)));
+	double* pp = (double*) PyArray_DATA((PyArrayObject*) pos.ptr());
+	double* vv = (double*) PyArray_DATA((PyArrayObject*) vel.ptr());
+	double* mm = (double*) PyArray_DATA((PyArrayObject*) mass.ptr());
+
+	for(int i = 0; i < ens.nsys(); i++) {
+		ensemble::SystemRef s = ens[i];
+		for(int j = 0; j < ens.nbod(); j++, pp += 3, vv += 3, mm++) {
+			for(int c = 0; c < 3; c++)
+				pp[c] = s[j][c].pos(), vv[c] = s[j][c].vel();
+			*mm = s[j].mass();
+		}
+	}
+
+	return make_tuple(pos, vel, mass);
+}
+
+
+/*
+ * Releasing the GIL
+ *
+ * Integration and file I/O do not touch any Python objects, so
+ * the interpreter lock is released while they run. This lets other
+ * Python threads make progress, e.g. to run several integrators
+ * concurrently from a thread pool.
+ */
+
+//! Release the GIL for the lifetime of this object, exception safe
+struct ScopedGILRelease {
+	ScopedGILRelease() : _state(PyEval_SaveThread()) {}
+	~ScopedGILRelease() { PyEval_RestoreThread(_state); }
+	private:
+	PyThreadState* _state;
+};
+
+void integrate_nogil(integrator& integ){
+	ScopedGILRelease nogil;
+	integ.integrate();
+}
+
+void gpu_integrate_nogil(gpu::integrator& integ){
+	ScopedGILRelease nogil;
+	integ.integrate();
+}
+
+void core_integrate_nogil(gpu::integrator& integ){
+	ScopedGILRelease nogil;
+	integ.core_integrate();
+}
+
+defaultEnsemble load_nogil(const string& filename){
+	ScopedGILRelease nogil;
+	return snapshot::load(filename);
+}
+
+defaultEnsemble load_text_nogil(const string& filename){
+	ScopedGILRelease nogil;
+	return snapshot::load_text(filename);
+}
+
+void save_nogil(defaultEnsemble& ens, const string& filename){
+	ScopedGILRelease nogil;
+	snapshot::save(ens, filename);
+}
+
+void save_text_nogil(defaultEnsemble& ens, const string& filename){
+	ScopedGILRelease nogil;
+	snapshot::save_text(ens, filename);
+}
+
+void save_chunked_nogil(defaultEnsemble& ens, const string& filename){
+	ScopedGILRelease nogil;
+	snapshot::save_chunked(ens, filename);
+}
+
+defaultEnsemble map_chunked_nogil(const string& filename, const bool& writeback){
+	ScopedGILRelease nogil;
+	return snapshot::map_chunked(filename, writeback);
+}
+
+defaultEnsemble integrate_in_processes_nogil(const defaultEnsemble& ens, const config& cfg){
+	ScopedGILRelease nogil;
+	multiprocess_integration m(cfg);
+	return m.run(ens).ens;
+}
+
+std::vector<string> string_list(const object& names){
+	std::vector<string> v;
+	for(int i = 0; i < len(names); i++)
+		v.push_back(extract<string>(names[i]));
+	return v;
+}
+
+void split_nogil(const string& input, const object& outputs, const bool& round_robin, const bool& chunked){
+	const std::vector<string> names = string_list(outputs);
+	ScopedGILRelease nogil;
+	snapshot::split(input, names, round_robin ? snapshot::SPLIT_ROUND_ROBIN : snapshot::SPLIT_RANGE, chunked);
+}
+
+void merge_nogil(const object& inputs, const string& output, const bool& chunked){
+	const std::vector<string> names = string_list(inputs);
+	ScopedGILRelease nogil;
+	snapshot::merge(names, output, chunked);
+}
+
+ragged_ensemble create_ragged(const object& nbods){
+	std::vector<int> n;
+	for(int i = 0; i < len(nbods); i++)
+		n.push_back(extract<int>(nbods[i]));
+	return ragged_ensemble::create(n);
+}
+
+ensemble::SystemRef ragged_getitem(ragged_ensemble& ens, const int& i){
+	if( i < 0 || i >= ens.nsys()) {
+		PyErr_SetString(PyExc_IndexError,"");
+		throw_error_already_set();
+	}
+	return ens[i];
+}
+
+defaultEnsemble ragged_bucket(ragged_ensemble& ens, const int& k){
+	if( k < 0 || k >= ens.bucket_count()) {
+		PyErr_SetString(PyExc_IndexError,"");
+		throw_error_already_set();
+	}
+	return ens.bucket(k);
+}
+
+void integrate_ragged_nogil(ragged_ensemble& ens, const config& cfg){
+	ScopedGILRelease nogil;
+	ragged_integration(cfg).run(ens);
+}
+
+/*! Handle for an integration running in a background thread
+ *
+ *  Returned by Integrator.integrate_async. The integrator is kept
+ *  alive until the thread is finished. Any exception thrown by
+ *  the integration is reported as a RuntimeError by wait().
+ */
+class AsyncIntegration {
+	public:
+	AsyncIntegration(Pintegrator integ) : _integ(integ), _finished(false), _failed(false) {
+		_thread = boost::thread(boost::bind(&AsyncIntegration::run, this));
+	}
+
+	~AsyncIntegration(){
+		if(_thread.joinable()) {
+			ScopedGILRelease nogil;
+			_thread.join();
+		}
+	}
+
+	//! Block until the integration is finished
+	void wait(){
+		{
+			ScopedGILRelease nogil;
+			if(_thread.joinable()) _thread.join();
+		}
+		if(_failed) {
+			PyErr_SetString(PyExc_RuntimeError, _error.c_str());
+			throw_error_already_set();
+		}
+	}
+
+	//! Whether the integration is finished, does not block
+	bool done() {
+		boost::lock_guard<boost::mutex> lock(_mutex);
+		return _finished;
+	}
+
+	private:
+	void run(){
+		std::string error;
+		bool failed = false;
+		try {
+			_integ->integrate();
+		} catch(const std::exception& e) {
+			failed = true, error = e.what();
+		} catch(...) {
+			failed = true, error = "Unknown error in integration";
+		}
+		boost::lock_guard<boost::mutex> lock(_mutex);
+		_failed = failed, _error = error, _finished = true;
+	}
+
+	Pintegrator _integ;
+	boost::thread _thread;
+	boost::mutex _mutex;
+	bool _finished, _failed;
+	std::string _error;
+};
+
+typedef boost::shared_ptr<AsyncIntegration> PAsyncIntegration;
+
+PAsyncIntegration integrate_async(Pintegrator integ){
+	return PAsyncIntegration(new AsyncIntegration(integ));
+}
+
+
+/*
+ * Reading BDB log files
+ *
+ * The queries are executed with the C++ cursors and the results are
+ * returned as one NumPy structured array per query. This is much
+ * faster than decoding the records one at a time in Python.
+ *
+ * Every row of the result describes one body, a snapshot record
+ * (EVT_SNAPSHOT) produces nbod rows. An ejection record produces
+ * one row. A radial velocity observation (EVT_RV_OBS) produces one
+ * row with the velocity of the star along the line of sight in vz.
+ * Other events produce one row with body = -1 and NaN coordinates, so
+ * event queries still report time and system.
+ */
+
+//! One row of a query result, must be kept in sync with log_record_dtype
+struct log_row {
+	double time, x, y, z, vx, vy, vz, mass;
+	int sys, event, state, body;
+};
+
+//! NumPy dtype equivalent of log_row
+object log_record_dtype(){
+	object numpy = import("numpy");
+	list fields;
+	const char* doubles[] = { "time", "x", "y", "z", "vx", "vy", "vz", "mass" };
+	const char* ints[] = { "sys", "event", "state", "body" };
+	for(int i = 0; i < 8; i++) fields.append(make_tuple(doubles[i], "f8"));
+	for(int i = 0; i < 4; i++) fields.append(make_tuple(ints[i], "i4"));
+	return numpy.attr("dtype")(fields);
+}
+
+//! Decode a log record and append the resulting rows to the vector
+void append_log_rows(gpulog::logrecord lr, std::vector<log_row>& rows){
+	log_row r;
+	r.event = lr.msgid();
+	r.state = 0;
+	switch(r.event){
+	case log::EVT_SNAPSHOT: {
+		int nbod;
+		const log::body* bodies;
+		lr >> r.time >> r.sys >> r.state >> nbod >> bodies;
+		for(int b = 0; b < nbod; b++) {
+			r.body = bodies[b].body_id;
+			r.x = bodies[b].x, r.y = bodies[b].y, r.z = bodies[b].z;
+			r.vx = bodies[b].vx, r.vy = bodies[b].vy, r.vz = bodies[b].vz;
+			r.mass = bodies[b].mass;
+			rows.push_back(r);
+		}
+		break;
+	}
+	case log::EVT_EJECTION: {
+		log::body b;
+		lr >> r.time >> r.sys >> b;
+		r.body = b.body_id;
+		r.x = b.x, r.y = b.y, r.z = b.z;
+		r.vx = b.vx, r.vy = b.vy, r.vz = b.vz;
+		r.mass = b.mass;
+		rows.push_back(r);
+		break;
+	}
+	case log::EVT_RV_OBS:
+		lr >> r.time >> r.sys >> r.body >> r.vz;
+		r.x = r.y = r.z = r.vx = r.vy = r.mass = std::numeric_limits<double>::quiet_NaN();
+		rows.push_back(r);
+		break;
+	default:
+		if(r.event < 0) return;
+		lr >> r.time >> r.sys;
+		r.body = -1;
+		r.x = r.y = r.z = r.vx = r.vy = r.vz = r.mass = std::numeric_limits<double>::quiet_NaN();
+		rows.push_back(r);
+	}
+}
+
+/*! Read-only access to a BDB log file generated by the bdb_writer plugin.
+ *
+ *  Fast C++ replacement for the query methods of swarmng.logdb.IndexedLogDB.
+ */
+class LogDB {
+	public:
+	LogDB(const string& fileName) : _env(log::bdb_database::createDefaultEnv()), _db(_env) {
+		_db.openForReading(fileName);
+	}
+
+	~LogDB(){ close(); }
+
+	void close(){
+		if(_env == 0) return;
+		_db.close();
+		_env->close(0);
+		delete _env; _env = 0;
+	}
+
+	string metadata(const string& name){
+		check_open();
+		return _db.getMetaData(name);
+	}
+
+	//! All records with t0 <= time <= t1, sorted by time then system
+	object time_range(const double& t0, const double& t1){
+		check_open();
+		std::vector<log_row> rows;
+		{
+			ScopedGILRelease nogil;
+			log::Pprimary_cursor_t c = _db.primary_cursor();
+			log::pkey_t key(t0,0,0);
+			log::lrw_t lrw(buffer_size);
+			for(bool has = c->position_at(key,lrw); has && key.time <= t1; has = c->next(key,lrw))
+				append_log_rows(lrw.lr(), rows);
+			c->close();
+		}
+		return to_array(rows);
+	}
+
+	//! All records with s0 <= system id <= s1, sorted by system then time
+	object system_range(const int& s0, const int& s1){
+		check_open();
+		std::vector<log_row> rows;
+		{
+			ScopedGILRelease nogil;
+			log::Psecondary_cursor_t c = _db.system_cursor();
+			log::pkey_t key;
+			log::lrw_t lrw(buffer_size);
+			for(bool has = c->position_at((log::sysid_t) s0,key,lrw); has && (int)key.system_id() <= s1; has = c->next(key,lrw))
+				append_log_rows(lrw.lr(), rows);
+			c->close();
+		}
+		return to_array(rows);
+	}
+
+	//! All records of one event type, sorted by time then system
+	object event_records(const int& event_id){
+		check_open();
+		std::vector<log_row> rows;
+		{
+			ScopedGILRelease nogil;
+			log::Psecondary_cursor_t c = _db.event_cursor();
+			log::pkey_t key;
+			log::lrw_t lrw(buffer_size);
+			for(bool has = c->position_at((log::evtid_t) event_id,key,lrw); has && key.event_id() == event_id; has = c->next(key,lrw))
+				append_log_rows(lrw.lr(), rows);
+			c->close();
+		}
+		return to_array(rows);
+	}
+
+	private:
+	//! Same buffer size as the command line query
+	static const int buffer_size = 20480;
+
+	void check_open(){
+		if(_env == 0) {
+			PyErr_SetString(PyExc_ValueError, "Operation on a closed log file");
+			throw_error_already_set();
+		}
+	}
+
+	object to_array(const std::vector<log_row>& rows){
+		object a = import("numpy").attr("empty")(rows.size(), log_record_dtype());
+		if(!rows.empty())
+			std::memcpy(PyArray_DATA((PyArrayObject*) a.ptr()), &rows[0], rows.size() * sizeof(log_row));
+		return a;
+	}
+
+	DbEnv* _env;
+	log::bdb_database _db;
+};
+
 
 BOOST_PYTHON_MODULE(libswarmng_ext) {
 
+	if( !import_numpy() ) throw_error_already_set();
+	PyEval_InitThreads();
+
 	def("init", swarm::init );
 	def("generate_ensemble", generate_ensemble );
+	def("integrate_in_processes", integrate_in_processes_nogil );
+	def("split", split_nogil, (arg("input"), arg("outputs"), arg("round_robin") = false, arg("chunked") = false));
+	def("merge", merge_nogil, (arg("inputs"), arg("output"), arg("chunked") = false));
 	def("sync", cudaThreadSynchronize );
 	def("calc_keplerian_for_cartesian", calc_keplerian_for_cartesian_wrap);
 	def("calc_cartesian_for_keplerian", calc_cartesian_for_keplerian_wrap);
+	scope().attr("CHUNK_SIZE") = (int) ensemble::CHUNK_SIZE;
 
 	class_<config>("Config")
 		.def( map_indexing_suite< config >() )
@@ -252,25 +784,68 @@ BOOST_PYTHON_MODULE(libswarmng_ext) {
 		.add_property("nsys", make_function(&ensemble::nsys , return_value_policy<copy_const_reference>() ) )
 		.add_property("nbod", make_function(&ensemble::nbod , return_value_policy<copy_const_reference>() ) )
 		.def("__getitem__", &ens_getitem )
+		.add_property("positions", &positions_view )
+		.add_property("velocities", &velocities_view )
+		.add_property("masses", &masses_view )
+		.add_property("body_attributes", &body_attributes_view )
+		.add_property("times", &times_view )
+		.add_property("states", &states_view )
+		.add_property("ids", &ids_view )
+		.add_property("system_attributes", &sys_attributes_view )
+		.def("set_from_arrays", &set_from_arrays )
+		.def("to_arrays", &to_arrays )
 		;
 
 	class_<defaultEnsemble, bases<ensemble> >("DefaultEnsemble")
 		.def("create", &defaultEnsemble::create )
 		.staticmethod("create")
 		.def( "clone", &defaultEnsemble::clone )
-		.def("save_to_bin", &snapshot::save) 
-		.def("save_to_text", &snapshot::save_text) 
-		.def("load_from_bin", &snapshot::load) 
-		.def("load_from_text", &snapshot::load_text) 
+		.def( "cow_clone", &defaultEnsemble::cow_clone )
+		.def("save_to_bin", &save_nogil) 
+		.def("save_to_text", &save_text_nogil) 
+		.def("load_from_bin", &load_nogil) 
+		.def("load_from_text", &load_text_nogil) 
+		.def("save_to_chunked", &save_chunked_nogil) 
+		.def("map_chunked", &map_chunked_nogil, (arg("fileName"), arg("writeback") = false)) 
 		.staticmethod("load_from_bin")
 		.staticmethod("load_from_text")
+		.staticmethod("map_chunked")
 		;
 	
 
+	class_<ragged_ensemble>("RaggedEnsemble")
+		.def("create", &create_ragged )
+		.staticmethod("create")
+		.def("__len__", &ragged_ensemble::nsys )
+		.def("__getitem__", &ragged_getitem )
+		.def("nbod_of", &ragged_ensemble::nbod )
+		.def("bucket", &ragged_bucket )
+		.def("bucket_nbod", &ragged_ensemble::bucket_nbod )
+		.add_property("nsys", &ragged_ensemble::nsys )
+		.add_property("bucket_count", &ragged_ensemble::bucket_count )
+		;
+
+	def("integrate_ragged", integrate_ragged_nogil );
+
+	class_<AsyncIntegration, PAsyncIntegration, noncopyable >("AsyncIntegration", no_init )
+		.def("wait", &AsyncIntegration::wait )
+		.add_property("done", &AsyncIntegration::done )
+		;
+
+	class_<LogDB, boost::shared_ptr<LogDB>, noncopyable >("LogDB", boost::python::init<string>() )
+		.def("metadata", &LogDB::metadata )
+		.def("time_range", &LogDB::time_range )
+		.def("system_range", &LogDB::system_range )
+		.def("event_records", &LogDB::event_records )
+		.def("close", &LogDB::close )
+		;
+	def("log_record_dtype", &log_record_dtype );
+
 	class_<integrator, Pintegrator, noncopyable >("Integrator", no_init )
 		.def("create",&integrator::create)
 		.staticmethod("create")
-		.def("integrate", &integrator::integrate )
+		.def("integrate", &integrate_nogil )
+		.def("integrate_async", &integrate_async )
 		.add_property("ensemble", make_function(&integrator::get_ensemble, return_value_policy<reference_existing_object>() ), &integrator::set_ensemble)
 		.add_property("destination_time", &integrator::get_destination_time, &integrator::set_destination_time)
 		;
@@ -280,8 +855,8 @@ BOOST_PYTHON_MODULE(libswarmng_ext) {
 	class_<gpu::integrator, bases<integrator> , gpu::Pintegrator, noncopyable>("GpuIntegrator", no_init)
 		.def("create", &create_gpu_integrator )
 		.staticmethod("create")
-		.def("integrate", &gpu::integrator::integrate )
-		.def("core_integrate", &gpu::integrator::core_integrate )
+		.def("integrate", &gpu_integrate_nogil )
+		.def("core_integrate", &core_integrate_nogil )
 		.def("download_ensemble", &gpu::integrator::download_ensemble )
 		.def("upload_ensemble", &gpu::integrator::upload_ensemble )
 		.add_property("ensemble", make_function(&integrator::get_ensemble, return_value_policy<reference_existing_object>() ), gpu_set_ensemble)
@@ -0,0 +1,177 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file checkpoint.cpp
+ *   \brief Implements \ref swarm::checkpoint.
+ *
+ */
+
+#include "common.hpp"
+#include "checkpoint.hpp"
+#include "snapshot.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+namespace swarm {
+
+//! Wall-clock time in seconds
+double wall_time(){
+	timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+//! Flush a file or a directory to disk
+bool sync_path(const std::string& path, const int& flags){
+	const int fd = open(path.c_str(), flags);
+	if(fd == -1) return false;
+	const bool ok = fsync(fd) == 0;
+	close(fd);
+	return ok;
+}
+
+checkpoint::checkpoint(const config& cfg)
+	:_step(0),_interval_stop(0),_count(0),_pending(false),_stopping(false) {
+	_filename = cfg.require("checkpoint_file", std::string());
+	_interval = cfg.optional("checkpoint_interval", 0.0);
+	_wall_interval = cfg.optional("checkpoint_wall_interval", 0.0) * 60;
+	if(_interval < 0 || _wall_interval < 0)
+		ERROR("Checkpoint intervals cannot be negative");
+	if(_interval == 0 && _wall_interval == 0)
+		ERROR("Either checkpoint_interval or checkpoint_wall_interval should be set");
+	_last_wall = wall_time();
+
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_wake, NULL);
+	pthread_cond_init(&_done, NULL);
+	if(pthread_create(&_writer, NULL, &checkpoint::writer_main, this) != 0)
+		ERROR("Cannot start the checkpoint writer thread");
+}
+
+checkpoint::~checkpoint(){
+	pthread_mutex_lock(&_mutex);
+	_stopping = true;
+	pthread_cond_broadcast(&_wake);
+	pthread_mutex_unlock(&_mutex);
+	pthread_join(_writer, NULL);
+
+	pthread_cond_destroy(&_done);
+	pthread_cond_destroy(&_wake);
+	pthread_mutex_destroy(&_mutex);
+}
+
+double checkpoint::next_stop(const double& now, const double& destination_time){
+	if(now >= destination_time)
+		return destination_time;
+
+	double next = destination_time;
+	if(_interval > 0) {
+		// Stop at multiples of the interval, so that a resumed
+		// integration stops at the same times
+		_interval_stop = (floor(now / _interval + 1e-6) + 1) * _interval;
+		next = std::min(next, _interval_stop);
+	}
+	if(_wall_interval > 0) {
+		// Stop often enough in between to check the wall-clock interval
+		if(_step <= 0) _step = (destination_time - now) / 100;
+		next = std::min(next, now + _step);
+	}
+	return (next > now) ? next : destination_time;
+}
+
+void checkpoint::reached(defaultEnsemble& ens, const double& time){
+	const bool interval_due = (_interval > 0) && (time == _interval_stop);
+	const bool wall_due = (_wall_interval > 0) && (wall_time() - _last_wall >= _wall_interval);
+	if(interval_due || wall_due)
+		save(ens);
+}
+
+void checkpoint::save(defaultEnsemble& ens){
+	wait();
+
+	if(_staging.nsys() != ens.nsys() || _staging.nbod() != ens.nbod())
+		_staging = hostEnsemble::create(ens.nbod(), ens.nsys());
+
+	memcpy(_staging.bodies().begin(), ens.bodies().begin(), ens.bodies().block_count() * sizeof(ensemble::Body));
+	memcpy(_staging.systems().begin(), ens.systems().begin(), ens.systems().block_count() * sizeof(ensemble::Sys));
+	_last_wall = wall_time();
+
+	pthread_mutex_lock(&_mutex);
+	_pending = true;
+	pthread_cond_signal(&_wake);
+	pthread_mutex_unlock(&_mutex);
+}
+
+void checkpoint::wait(){
+	pthread_mutex_lock(&_mutex);
+	while(_pending)
+		pthread_cond_wait(&_done, &_mutex);
+	const std::string error = _error;
+	_error.clear();
+	pthread_mutex_unlock(&_mutex);
+
+	if(!error.empty())
+		ERROR("Cannot write checkpoint " + _filename + ": " + error);
+}
+
+void* checkpoint::writer_main(void* arg){
+	((checkpoint*) arg)->writer_loop();
+	return 0;
+}
+
+void checkpoint::writer_loop(){
+	pthread_mutex_lock(&_mutex);
+	while(true) {
+		while(!_pending && !_stopping)
+			pthread_cond_wait(&_wake, &_mutex);
+		// A pending checkpoint is written even when stopping
+		if(!_pending) break;
+		pthread_mutex_unlock(&_mutex);
+
+		std::string error;
+		try {
+			write_staging();
+		} catch(const std::exception& e) {
+			error = e.what();
+		}
+
+		pthread_mutex_lock(&_mutex);
+		if(error.empty()) _count++; else _error = error;
+		_pending = false;
+		pthread_cond_broadcast(&_done);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+void checkpoint::write_staging(){
+	const std::string temporary = _filename + ".tmp";
+	snapshot::save_chunked(_staging, temporary);
+
+	if(!sync_path(temporary, O_RDONLY))
+		throw std::runtime_error("cannot flush " + temporary + " to disk");
+	if(rename(temporary.c_str(), _filename.c_str()) != 0)
+		throw std::runtime_error("cannot rename " + temporary + " to " + _filename);
+
+	// Make the rename durable as well
+	const std::string::size_type slash = _filename.find_last_of('/');
+	sync_path(slash == std::string::npos ? "." : _filename.substr(0, slash + 1), O_RDONLY | O_DIRECTORY);
+}
+
+}
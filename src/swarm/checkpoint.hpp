@@ -0,0 +1,115 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file checkpoint.hpp
+ *   \brief Defines \ref swarm::checkpoint, periodic snapshots of the
+ *   ensemble that are written in the background during integration.
+ *
+ *   Configuration options:
+ *    - checkpoint_file: path of the checkpoint, enables checkpointing.
+ *    - checkpoint_interval: simulated time between checkpoints, in the
+ *      time units of the ensemble (2 pi per year with G = 1, AU and
+ *      solar masses).
+ *    - checkpoint_wall_interval: wall-clock minutes between checkpoints.
+ *
+ *   If both intervals are given, a checkpoint is written when either of
+ *   them has passed: at every multiple of checkpoint_interval, and in
+ *   between when checkpoint_wall_interval has passed since the last one.
+ *   The wall clock is checked at stops 1/100 of the integration apart.
+ *
+ */
+#pragma once
+
+#include "common.hpp"
+#include "types/config.hpp"
+#include "ensemble_alloc.hpp"
+#include <pthread.h>
+
+namespace swarm {
+
+/*! Asynchronous checkpoints of an ensemble.
+ *
+ *  The integrator (c.f. integrator::integrate) stops at the times
+ *  returned by next_stop and calls reached. When a checkpoint is due,
+ *  the ensemble arrays are copied to a staging ensemble and a background
+ *  thread writes the copy in the chunked binary format (c.f.
+ *  snapshot::save_chunked) while the integration continues. The file
+ *  is written under a temporary name, flushed to disk and renamed, so
+ *  checkpoint_file always holds the latest complete checkpoint. At most
+ *  one checkpoint is being written at any time.
+ *
+ *  To continue an integration from a checkpoint, load checkpoint_file
+ *  with snapshot::load (or use the resume command of the swarm executable).
+ */
+class checkpoint {
+	public:
+	checkpoint(const config& cfg);
+	~checkpoint();
+
+	//! Time to integrate to from time now before the next call to reached
+	double next_stop(const double& now, const double& destination_time);
+
+	//! Notify that ens has been integrated to time, writes a checkpoint if it is due
+	void reached(defaultEnsemble& ens, const double& time);
+
+	//! Start writing a checkpoint of ens in the background
+	void save(defaultEnsemble& ens);
+
+	//! Wait until the checkpoint in progress is written, throws if writing failed
+	void wait();
+
+	//! Path of the checkpoint file
+	const std::string& filename() const { return _filename; }
+
+	//! Number of checkpoints written so far
+	int count() const { return _count; }
+
+	private:
+	static void* writer_main(void* arg);
+	void writer_loop();
+	void write_staging();
+
+	std::string _filename;
+	//! Simulated time between checkpoints, 0 if not set
+	double _interval;
+	//! Wall-clock seconds between checkpoints, 0 if not set
+	double _wall_interval;
+	//! Simulated time between stops to check the wall-clock interval
+	double _step;
+	//! Multiple of the interval that the last next_stop aimed at
+	double _interval_stop;
+	double _last_wall;
+	int _count;
+
+	//! Copy of the ensemble being written
+	hostEnsemble _staging;
+
+	pthread_t _writer;
+	pthread_mutex_t _mutex;
+	pthread_cond_t _wake, _done;
+	bool _pending, _stopping;
+	std::string _error;
+
+	// Not copyable
+	checkpoint(const checkpoint&);
+	checkpoint& operator=(const checkpoint&);
+};
+
+typedef shared_ptr<checkpoint> Pcheckpoint;
+
+}
@@ -0,0 +1,88 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file conservation.cpp
+ *   \brief Implements \ref swarm::conservation_tracker.
+ *
+ */
+
+#include "common.hpp"
+#include "conservation.hpp"
+#include "gravitation_cpu.hpp"
+
+namespace swarm {
+
+//! Read the attribute number called name, -1 if it is not set
+int tracked_attribute(const config& cfg, const std::string& name){
+	const int a = cfg.optional(name, -1);
+	if(a >= ensemble::NUM_SYS_ATTRIBUTES)
+		ERROR(name + " is larger than the number of system attributes");
+	return a;
+}
+
+conservation_tracker::conservation_tracker(const config& cfg){
+	_energy_attribute = tracked_attribute(cfg, "track_energy_attribute");
+	_angular_momentum_attribute = tracked_attribute(cfg, "track_angular_momentum_attribute");
+	_max_energy_error = cfg.optional("max_energy_error", 0.0);
+	if(_max_energy_error < 0) ERROR("max_energy_error cannot be negative");
+}
+
+void conservation_tracker::prepare(ensemble& ens){
+	if(enabled() && _initial.nsys() != ens.nsys())
+		_initial = ensemble_diagnostics(ens);
+}
+
+double conservation_tracker::potential_energy(const ensemble::SystemRef& sys){
+	// The test particles at the end of the system add nothing
+	const int nmassive = cpu::massive_body_count(sys);
+	double U = 0;
+	for(int i = 0; i < nmassive; i++)
+		for(int j = 0; j < i; j++)
+			U -= sys[i].mass() * sys[j].mass() / sys.distance_between(i, j);
+	return U;
+}
+
+void conservation_tracker::update(const ensemble::SystemRef& sys, const double& potential) const {
+	double K = 0, L[3] = { 0, 0, 0 };
+	for(int b = 0; b < sys.nbod(); b++) {
+		const ensemble::Body& p = sys[b];
+		const double m = p.mass();
+		K += 0.5 * m * (square(p[0].vel()) + square(p[1].vel()) + square(p[2].vel()));
+		L[0] += m * (p[1].pos() * p[2].vel() - p[2].pos() * p[1].vel());
+		L[1] += m * (p[2].pos() * p[0].vel() - p[0].pos() * p[2].vel());
+		L[2] += m * (p[0].pos() * p[1].vel() - p[1].pos() * p[0].vel());
+	}
+
+	const int i = sys.number();
+	const double E0 = _initial.energy(i);
+	const double dE = fabs((K + potential - E0) / E0);
+	if(_energy_attribute >= 0)
+		sys.attribute(_energy_attribute) = dE;
+
+	if(_angular_momentum_attribute >= 0) {
+		const double* L0 = _initial.angular_momentum(i);
+		sys.attribute(_angular_momentum_attribute) =
+			sqrt(square(L[0] - L0[0]) + square(L[1] - L0[1]) + square(L[2] - L0[2]))
+			/ sqrt(square(L0[0]) + square(L0[1]) + square(L0[2]));
+	}
+
+	if(_max_energy_error > 0 && dE > _max_energy_error)
+		sys.set_disabled();
+}
+
+}
@@ -0,0 +1,93 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file conservation.hpp
+ *   \brief Defines \ref swarm::conservation_tracker, running energy and
+ *   angular momentum errors maintained by the CPU integrators.
+ *
+ *   Configuration options:
+ *    - track_energy_attribute: system attribute that holds the relative
+ *      energy error |E-E0|/|E0| of the system after every step.
+ *    - track_angular_momentum_attribute: system attribute that holds the
+ *      relative angular momentum error |L-L0|/|L0|.
+ *    - max_energy_error: systems whose relative energy error grows larger
+ *      are disabled (default 0: never).
+ *
+ */
+#pragma once
+
+#include "common.hpp"
+#include "types/config.hpp"
+#include "diagnostics.hpp"
+
+namespace swarm {
+
+/*! Running estimates of the errors of the conserved quantities.
+ *
+ *  The reference values E0 and L0 of every system are recorded by
+ *  prepare() when the integrator starts on a new ensemble (c.f.
+ *  integrator::set_ensemble), using \ref ensemble_diagnostics. After every
+ *  step the integrator calls update() for the system it advanced. The
+ *  kinetic energy and angular momentum take O(nbod) operations. The
+ *  potential energy is a separate pass over the pairs of massive bodies,
+ *  with one square root per pair, which is not folded into the force
+ *  evaluations: it has to be evaluated at the final positions of the
+ *  step, the force evaluations of predictor-corrector schemes are at
+ *  intermediate positions, and mixing the two would bias the error by as
+ *  much as the error itself. Tracking thus costs about as much as an
+ *  extra force evaluation without the jerk per step.
+ *
+ *  The errors are written to the system attributes chosen in the
+ *  configuration, where monitors, stability tests and the logs can read
+ *  them without evaluating the energy of the whole ensemble again.
+ *
+ *  Only the integrators whose integrator::tracks_conservation() is true
+ *  update the errors.
+ */
+class conservation_tracker {
+	public:
+	conservation_tracker():_energy_attribute(-1),_angular_momentum_attribute(-1),_max_energy_error(0){}
+	conservation_tracker(const config& cfg);
+
+	//! True if the integrator should call update() after its steps
+	bool enabled() const { return _energy_attribute >= 0 || _angular_momentum_attribute >= 0 || _max_energy_error > 0; }
+
+	//! Record the reference values of the systems of ens, unless they were recorded already
+	void prepare(ensemble& ens);
+
+	//! Forget the reference values, the next prepare() records them again
+	void reset() { _initial = ensemble_diagnostics(); }
+
+	/*! Update the errors of sys from its current state.
+	 *  potential is the potential energy of sys at its current positions.
+	 */
+	void update(const ensemble::SystemRef& sys, const double& potential) const;
+
+	//! Update the errors of sys, computing its potential energy
+	void update(const ensemble::SystemRef& sys) const { update(sys, potential_energy(sys)); }
+
+	//! Potential energy of sys
+	static double potential_energy(const ensemble::SystemRef& sys);
+
+	private:
+	int _energy_attribute, _angular_momentum_attribute;
+	double _max_energy_error;
+	ensemble_diagnostics _initial;
+};
+
+}
@@ -0,0 +1,226 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file dense_output.hpp
+ *   \brief Defines \ref swarm::step_interpolant, the dense output of an
+ *   integration step, and the functions that pass it to monitors.
+ *
+ */
+#pragma once
+
+#include "types/ensemble.hpp"
+#include "log/log.hpp"
+
+namespace swarm {
+
+/*! Positions and velocities of the bodies of a system at any time
+ *  within the last integration step.
+ *
+ *  The interpolant is built from the values that the integrator holds
+ *  at both ends of the step [t0, t0+h]: positions, velocities and, if
+ *  available, accelerations. With accelerations it is the quintic
+ *  Hermite interpolant (position error O(h^6)), without them the cubic
+ *  Hermite interpolant (O(h^4)). The arrays are owned by the integrator
+ *  and are valid until the next step.
+ *
+ *  Monitors that want to act at exact times (e.g. log_time_interval)
+ *  implement set_step_interpolant(const step_interpolant*), integrators
+ *  that provide dense output call monitors::set_step_interpolant() on
+ *  their monitor after every step.
+ */
+struct step_interpolant {
+	double t0, h;
+	//! Values at the beginning of the step, acc0 may be null
+	const double (*pos0)[3], (*vel0)[3], (*acc0)[3];
+	//! Values at the end of the step, acc1 may be null
+	const double (*pos1)[3], (*vel1)[3], (*acc1)[3];
+
+	GENERIC double t1() const { return t0 + h; }
+
+	//! Position p and velocity v of body b at time t, t0 <= t <= t0+h
+	GENERIC void evaluate(const int& b, const double& t, double p[3], double v[3]) const {
+		const double s = (h > 0) ? (t - t0) / h : 1.0;
+		const double s2 = s * s, s3 = s2 * s, s4 = s3 * s, s5 = s4 * s;
+		if(acc0 && acc1) {
+			// Quintic Hermite basis and its derivative
+			const double H0 = 1 - 10*s3 + 15*s4 - 6*s5, dH0 = -30*s2 + 60*s3 - 30*s4;
+			const double H1 = s - 6*s3 + 8*s4 - 3*s5, dH1 = 1 - 18*s2 + 32*s3 - 15*s4;
+			const double H2 = 0.5*s2 - 1.5*s3 + 1.5*s4 - 0.5*s5, dH2 = s - 4.5*s2 + 6*s3 - 2.5*s4;
+			const double H3 = 0.5*s3 - s4 + 0.5*s5, dH3 = 1.5*s2 - 4*s3 + 2.5*s4;
+			const double H4 = -4*s3 + 7*s4 - 3*s5, dH4 = -12*s2 + 28*s3 - 15*s4;
+			const double H5 = 1 - H0, dH5 = -dH0;
+			for(int c = 0; c < 3; c++) {
+				const double x0 = pos0[b][c], v0 = h * vel0[b][c], a0 = h * h * acc0[b][c];
+				const double x1 = pos1[b][c], v1 = h * vel1[b][c], a1 = h * h * acc1[b][c];
+				p[c] = H0*x0 + H1*v0 + H2*a0 + H3*a1 + H4*v1 + H5*x1;
+				v[c] = h > 0 ? (dH0*x0 + dH1*v0 + dH2*a0 + dH3*a1 + dH4*v1 + dH5*x1) / h : vel1[b][c];
+			}
+		} else {
+			// Cubic Hermite basis and its derivative
+			const double H0 = 2*s3 - 3*s2 + 1, dH0 = 6*s2 - 6*s;
+			const double H1 = s3 - 2*s2 + s, dH1 = 3*s2 - 4*s + 1;
+			const double H2 = s3 - s2, dH2 = 3*s2 - 2*s;
+			const double H3 = 1 - H0, dH3 = -dH0;
+			for(int c = 0; c < 3; c++) {
+				const double x0 = pos0[b][c], v0 = h * vel0[b][c];
+				const double x1 = pos1[b][c], v1 = h * vel1[b][c];
+				p[c] = H0*x0 + H1*v0 + H2*v1 + H3*x1;
+				v[c] = h > 0 ? (dH0*x0 + dH1*v0 + dH2*v1 + dH3*x1) / h : vel1[b][c];
+			}
+		}
+	}
+
+	/*! Lower estimate of the minimum distance between bodies i and j
+	 *  during the step.
+	 *
+	 *  The separation of the pair is modelled by the cubic Hermite
+	 *  interpolant of the relative positions and velocities at both ends.
+	 *  Its minimum is located from five samples and refined by Newton
+	 *  iterations on d(r^2)/ds = 0. With accelerations, the minimum is
+	 *  lowered by the largest deviation of the quintic interpolant from the
+	 *  cubic one, h^2 max(s^2(1-s)^3/2) (|a0 - a_cubic(0)| + |a1 - a_cubic(1)|),
+	 *  so a pair that gets close in the middle of a long step is not missed.
+	 *  There are no branches, so loops over the pairs are vectorized.
+	 */
+	GENERIC double min_distance(const int& i, const int& j) const {
+		const double bound = 0.01728; // max of s^2(1-s)^3/2 on [0,1], at s = 0.4
+		// Power basis coefficients of the relative position, in s = (t - t0)/h
+		double c0[3], c1[3], c2[3], c3[3];
+		for(int c = 0; c < 3; c++) {
+			const double x0 = pos0[i][c] - pos0[j][c], x1 = pos1[i][c] - pos1[j][c];
+			const double v0 = h * (vel0[i][c] - vel0[j][c]), v1 = h * (vel1[i][c] - vel1[j][c]);
+			c0[c] = x0, c1[c] = v0;
+			c2[c] = 3*(x1 - x0) - 2*v0 - v1;
+			c3[c] = 2*(x0 - x1) + v0 + v1;
+		}
+
+		double best_s = 0, best_r2 = c0[0]*c0[0] + c0[1]*c0[1] + c0[2]*c0[2];
+		for(int k = 1; k <= 4; k++) {
+			const double s = 0.25 * k;
+			double r2 = 0;
+			for(int c = 0; c < 3; c++) {
+				const double p = c0[c] + s*(c1[c] + s*(c2[c] + s*c3[c]));
+				r2 += p*p;
+			}
+			best_s = (r2 < best_r2) ? s : best_s;
+			best_r2 = (r2 < best_r2) ? r2 : best_r2;
+		}
+
+		double s = best_s;
+		for(int k = 0; k < 3; k++) {
+			double g = 0, dg = 0;
+			for(int c = 0; c < 3; c++) {
+				const double p = c0[c] + s*(c1[c] + s*(c2[c] + s*c3[c]));
+				const double dp = c1[c] + s*(2*c2[c] + 3*s*c3[c]);
+				const double ddp = 2*c2[c] + 6*s*c3[c];
+				g += p*dp, dg += dp*dp + p*ddp;
+			}
+			// Where r^2 is not convex the step takes s to an end, the samples remain
+			s = s - g / (dg > 1e-300 ? dg : 1e-300);
+			s = (s < 0) ? 0 : ((s > 1) ? 1 : s);
+		}
+		double r2 = 0;
+		for(int c = 0; c < 3; c++) {
+			const double p = c0[c] + s*(c1[c] + s*(c2[c] + s*c3[c]));
+			r2 += p*p;
+		}
+		r2 = (r2 < best_r2) ? r2 : best_r2;
+		const double dmin = sqrt(r2);
+		if(!(acc0 && acc1)) return dmin;
+
+		double da0 = 0, da1 = 0;
+		for(int c = 0; c < 3; c++) {
+			const double x0 = c0[c], x1 = pos1[i][c] - pos1[j][c];
+			const double v0 = c1[c], v1 = h * (vel1[i][c] - vel1[j][c]);
+			// Second derivatives of the cubic at both ends
+			const double cubic0 = 6*(x1 - x0) - 4*v0 - 2*v1, cubic1 = 6*(x0 - x1) + 2*v0 + 4*v1;
+			const double e0 = h * h * (acc0[i][c] - acc0[j][c]) - cubic0;
+			const double e1 = h * h * (acc1[i][c] - acc1[j][c]) - cubic1;
+			da0 += e0*e0, da1 += e1*e1;
+		}
+		const double d = dmin - bound * (sqrt(da0) + sqrt(da1));
+		return (d > 0) ? d : 0;
+	}
+
+	//! Lower estimate of the minimum distance between body i and every body j < i during the step, into dmin[j]
+	GENERIC void min_distances(const int& i, double* dmin) const {
+		for(int j = 0; j < i; j++)
+			dmin[j] = min_distance(i, j);
+	}
+};
+
+namespace log {
+
+/**
+ *	Store a snapshot of the system at time t within the last step (EVT_SNAPSHOT).
+ */
+template<typename L>
+GENERIC void interpolated_system(L &l, ensemble::SystemRefConst sys, const double& t, const step_interpolant& s)
+{
+	body *bodies = swarm::log::event(l, EVT_SNAPSHOT, t, sys.id()
+			, sys.state() , sys.nbod(), gpulog::array<body>(sys.nbod()));
+
+	if(bodies != NULL) // buffer overflow hasn't happened
+	{
+		for(int bod=0; bod < sys.nbod(); bod++)
+		{
+			double p[3], v[3];
+			s.evaluate(bod, t, p, v);
+			bodies[bod].set(bod,sys[bod]);
+			bodies[bod].x = p[0], bodies[bod].y = p[1], bodies[bod].z = p[2];
+			bodies[bod].vx = v[0], bodies[bod].vy = v[1], bodies[bod].vz = v[2];
+		}
+	}
+}
+
+}
+
+namespace monitors {
+
+//! value is true if Monitor has a member set_step_interpolant(const step_interpolant*)
+template<class Monitor>
+struct accepts_step_interpolant {
+	typedef char yes[1];
+	typedef char no[2];
+	template<class U, void (U::*)(const step_interpolant*)> struct check;
+	template<class U> static yes& test(check<U, &U::set_step_interpolant>*);
+	template<class U> static no& test(...);
+	static const bool value = sizeof(test<Monitor>(0)) == sizeof(yes);
+};
+
+template<bool accepts>
+struct step_interpolant_setter {
+	template<class Monitor>
+	GENERIC static void set(Monitor&, const step_interpolant*) {}
+};
+
+template<>
+struct step_interpolant_setter<true> {
+	template<class Monitor>
+	GENERIC static void set(Monitor& m, const step_interpolant* s) { m.set_step_interpolant(s); }
+};
+
+//! Pass the interpolant of the last step to m, if m can use it
+template<class Monitor>
+GENERIC void set_step_interpolant(Monitor& m, const step_interpolant* s) {
+	step_interpolant_setter< accepts_step_interpolant<Monitor>::value >::set(m, s);
+}
+
+}
+
+}
@@ -0,0 +1,162 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file diagnostics.cpp
+ *   \brief Implements \ref swarm::ensemble_diagnostics.
+ *
+ */
+
+#include "common.hpp"
+#include "diagnostics.hpp"
+#include "runtime.hpp"
+
+namespace swarm {
+
+const int CS = ensemble::CHUNK_SIZE;
+
+//! Fused pass over whole ensemble chunks
+struct diagnostics_task : public runtime::task {
+	ensemble& ens;
+	double *E, *L, *C, *V, *T;
+	int* S;
+
+	diagnostics_task(ensemble& ens, double* E, double* L, double* C, double* V, double* T, int* S)
+		:ens(ens),E(E),L(L),C(C),V(V),T(T),S(S){}
+
+	void operator()(const int& begin, const int& end, scratch_arena&){
+		for(int c = begin; c < end; c++)
+			chunk(c);
+	}
+
+	/*! All the loops over w run over the CS systems of the chunk, which
+	 *  are contiguous in memory. Lanes past the end of the ensemble hold
+	 *  whatever is in the padding and are discarded at the end.
+	 */
+	void chunk(const int& c){
+		const int nbod = ens.nbod();
+		const ensemble::Body* b = ens.bodies().begin() + (size_t) c * nbod;
+		const ensemble::Sys& sys = ens.systems().begin()[c];
+
+		double K[CS], U[CS], M[CS], am[3][CS], cm[3][CS], vm[3][CS];
+		for(int w = 0; w < CS; w++) {
+			K[w] = U[w] = M[w] = 0;
+			for(int k = 0; k < 3; k++) am[k][w] = cm[k][w] = vm[k][w] = 0;
+		}
+
+		for(int i = 0; i < nbod; i++) {
+			const double *m = b[i]._mass;
+			const double *x = b[i][0]._pos, *y = b[i][1]._pos, *z = b[i][2]._pos;
+			const double *vx = b[i][0]._vel, *vy = b[i][1]._vel, *vz = b[i][2]._vel;
+			for(int w = 0; w < CS; w++) {
+				K[w] += 0.5 * m[w] * (vx[w]*vx[w] + vy[w]*vy[w] + vz[w]*vz[w]);
+				am[0][w] += m[w] * (y[w]*vz[w] - z[w]*vy[w]);
+				am[1][w] += m[w] * (z[w]*vx[w] - x[w]*vz[w]);
+				am[2][w] += m[w] * (x[w]*vy[w] - y[w]*vx[w]);
+				M[w] += m[w];
+				cm[0][w] += m[w] * x[w], cm[1][w] += m[w] * y[w], cm[2][w] += m[w] * z[w];
+				vm[0][w] += m[w] * vx[w], vm[1][w] += m[w] * vy[w], vm[2][w] += m[w] * vz[w];
+			}
+
+			for(int j = 0; j < i; j++) {
+				const double *mj = b[j]._mass;
+				const double *xj = b[j][0]._pos, *yj = b[j][1]._pos, *zj = b[j][2]._pos;
+				for(int w = 0; w < CS; w++) {
+					const double dx = x[w] - xj[w], dy = y[w] - yj[w], dz = z[w] - zj[w];
+					U[w] -= m[w] * mj[w] / sqrt(dx*dx + dy*dy + dz*dz);
+				}
+			}
+		}
+
+		const int first = c * CS, n = std::min(CS, ens.nsys() - first);
+		for(int w = 0; w < n; w++) {
+			const int s = first + w;
+			E[s] = K[w] + U[w];
+			for(int k = 0; k < 3; k++) {
+				L[3*s+k] = am[k][w];
+				C[3*s+k] = cm[k][w] / M[w];
+				V[3*s+k] = vm[k][w] / M[w];
+			}
+			T[s] = sys._time[w];
+			S[s] = sys._bunch[w].state;
+		}
+	}
+};
+
+ensemble_diagnostics::ensemble_diagnostics(ensemble& ens)
+	:_energy(ens.nsys()),_angular_momentum(3*ens.nsys()),_barycenter(3*ens.nsys())
+	,_barycenter_velocity(3*ens.nsys()),_time(ens.nsys()),_state(ens.nsys())
+{
+	if(ens.nsys() == 0) return;
+	diagnostics_task t(ens, &_energy[0], &_angular_momentum[0], &_barycenter[0]
+			, &_barycenter_velocity[0], &_time[0], &_state[0]);
+	const int chunks = (ens.nsys() + CS - 1) / CS;
+	runtime::instance().parallel_for(chunks, t);
+}
+
+//! Statistics of v, that are zero for an empty ensemble
+ensemble::range_t diagnostics_range(std::vector<double>& v){
+	if(v.empty()) return ensemble::range_t(0, 0, 0, 0);
+	return ensemble::range_t::calculate(v.begin(), v.end());
+}
+
+ensemble::range_t ensemble_diagnostics::time_range() const {
+	std::vector<double> t = _time;
+	return diagnostics_range(t);
+}
+
+int ensemble_diagnostics::count(const int& s) const {
+	return std::count(_state.begin(), _state.end(), s);
+}
+
+void ensemble_diagnostics::check_match(const ensemble_diagnostics& base) const {
+	if(base.nsys() != nsys())
+		ERROR("The diagnostics were computed for different ensembles");
+}
+
+ensemble::range_t ensemble_diagnostics::energy_error(const ensemble_diagnostics& base) const {
+	check_match(base);
+	std::vector<double> e(nsys());
+	for(int i = 0; i < nsys(); i++)
+		e[i] = fabs((_energy[i] - base._energy[i]) / base._energy[i]);
+	return diagnostics_range(e);
+}
+
+ensemble::range_t ensemble_diagnostics::angular_momentum_error(const ensemble_diagnostics& base) const {
+	check_match(base);
+	std::vector<double> e(nsys());
+	for(int i = 0; i < nsys(); i++) {
+		const double *L = angular_momentum(i), *L0 = base.angular_momentum(i);
+		e[i] = sqrt(square(L[0]-L0[0]) + square(L[1]-L0[1]) + square(L[2]-L0[2]))
+			/ sqrt(square(L0[0]) + square(L0[1]) + square(L0[2]));
+	}
+	return diagnostics_range(e);
+}
+
+double ensemble_diagnostics::max_barycenter_drift(const ensemble_diagnostics& base) const {
+	check_match(base);
+	double drift = 0;
+	for(int i = 0; i < nsys(); i++) {
+		const double *c = barycenter(i), *c0 = base.barycenter(i), *v0 = base.barycenter_velocity(i);
+		const double dt = _time[i] - base._time[i];
+		drift = std::max(drift, sqrt(square(c[0] - c0[0] - v0[0]*dt)
+				+ square(c[1] - c0[1] - v0[1]*dt) + square(c[2] - c0[2] - v0[2]*dt)));
+	}
+	return drift;
+}
+
+}
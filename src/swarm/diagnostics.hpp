@@ -0,0 +1,99 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file diagnostics.hpp
+ *   \brief Defines \ref swarm::ensemble_diagnostics, conserved quantities
+ *   and states of all systems of an ensemble computed in one pass.
+ *
+ */
+#pragma once
+
+#include "common.hpp"
+#include "types/ensemble.hpp"
+
+namespace swarm {
+
+/*! Conserved quantities, time and state of every system of an ensemble.
+ *
+ *  All quantities are computed in a single pass over the bodies: total
+ *  energy, total angular momentum, barycenter position and velocity,
+ *  plus the time and state of every system. The pass works on whole
+ *  ensemble chunks with the worker threads of \ref runtime, and inside
+ *  a chunk the systems are processed side by side (the CHUNK_SIZE
+ *  values of a member are contiguous in memory), so the compiler can
+ *  vectorize the loops, including the square root and division of the
+ *  potential energy.
+ *
+ *  Drift of the conserved quantities is measured against the
+ *  diagnostics of the same ensemble at an earlier time, usually the
+ *  initial conditions; systems are matched by their index.
+ *
+ *  Usage:
+ *  \code
+ *  ensemble_diagnostics initial(ens);
+ *  integ->integrate();
+ *  ensemble_diagnostics now(ens);
+ *  double dE = now.energy_error(initial).max;
+ *  \endcode
+ */
+class ensemble_diagnostics {
+	public:
+	ensemble_diagnostics(){}
+
+	//! Compute the diagnostics of every system of ens
+	explicit ensemble_diagnostics(ensemble& ens);
+
+	int nsys() const { return _time.size(); }
+
+	//! Total energy (kinetic + potential) of system i
+	const double& energy(const int& i) const { return _energy[i]; }
+	//! Total angular momentum of system i, 3 components
+	const double* angular_momentum(const int& i) const { return &_angular_momentum[3*i]; }
+	//! Barycenter of system i, 3 components
+	const double* barycenter(const int& i) const { return &_barycenter[3*i]; }
+	//! Velocity of the barycenter of system i, 3 components
+	const double* barycenter_velocity(const int& i) const { return &_barycenter_velocity[3*i]; }
+	const double& time(const int& i) const { return _time[i]; }
+	const int& state(const int& i) const { return _state[i]; }
+
+	//! Range of the times of the systems, c.f. ensemble::time_ranges
+	ensemble::range_t time_range() const;
+
+	//! Number of systems in state s (c.f. ensemble::Sys::ActivationStates)
+	int count(const int& s) const;
+
+	//! Relative energy error |E-E0|/|E0| of the systems against base
+	ensemble::range_t energy_error(const ensemble_diagnostics& base) const;
+
+	//! Relative angular momentum error |L-L0|/|L0| of the systems against base
+	ensemble::range_t angular_momentum_error(const ensemble_diagnostics& base) const;
+
+	/*! Largest drift of a barycenter from its uniform motion since base,
+	 *  |c - (c0 + v0 (t - t0))|
+	 */
+	double max_barycenter_drift(const ensemble_diagnostics& base) const;
+
+	private:
+	//! Verify that base was computed for the same ensemble
+	void check_match(const ensemble_diagnostics& base) const;
+
+	std::vector<double> _energy, _angular_momentum, _barycenter, _barycenter_velocity, _time;
+	std::vector<int> _state;
+};
+
+}
@@ -0,0 +1,154 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file ensemble_alloc.cpp
+ *   \brief Implements the copy-on-write memory of \ref swarm::EnsembleAlloc::cow_clone.
+ *
+ */
+
+#include "common.hpp"
+#include "ensemble_alloc.hpp"
+#include "runtime.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace swarm {
+
+//! Size of the pieces copied by one thread
+const size_t cow_copy_grain = 1 << 20;
+
+//! Copies a byte array in pieces on the worker threads
+struct cow_copy_task : public runtime::task {
+	char* dst;
+	const char* src;
+	size_t size;
+	cow_copy_task(char* dst, const char* src, const size_t& size):dst(dst),src(src),size(size){}
+	void operator()(const int& begin, const int& end, scratch_arena&){
+		const size_t b = begin * cow_copy_grain, e = std::min(end * cow_copy_grain, size);
+		memcpy(dst + b, src + b, e - b);
+	}
+};
+
+size_t page_size(){
+	static const size_t page = sysconf(_SC_PAGESIZE);
+	return page;
+}
+
+size_t whole_pages(const size_t& size){
+	return (size + page_size() - 1) / page_size() * page_size();
+}
+
+/*! The page in front of the array holds the length of the mapping,
+ *  the array itself starts on the next page
+ */
+void* page_alloc(const size_t& size){
+	const size_t length = page_size() + whole_pages(size);
+	void* p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED)
+		return NULL;
+	*(size_t*) p = length;
+	return (char*) p + page_size();
+}
+
+void page_free(void* p){
+	if(p == NULL)
+		return;
+	char* base = (char*) p - page_size();
+	munmap(base, *(size_t*) base);
+}
+
+/*! Map size bytes of the object at offset copy-on-write and move the
+ *  mapping over the pages of dst. mremap replaces the pages of dst
+ *  atomically, if it fails dst keeps its old pages
+ */
+bool cow_map(const int& fd, const size_t& offset, const size_t& size, void* dst){
+	const size_t length = whole_pages(size);
+	void* p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+	if(p == MAP_FAILED)
+		return false;
+	if(mremap(p, length, length, MREMAP_MAYMOVE | MREMAP_FIXED, dst) == MAP_FAILED) {
+		munmap(p, length);
+		return false;
+	}
+	return true;
+}
+
+/*! Unnamed shared memory object. memfd_create does not count against
+ *  the size of /dev/shm, which is often small in containers, shm_open
+ *  is only used where memfd_create is not available
+ */
+int cow_create_object(){
+#ifdef SYS_memfd_create
+	const int memfd = syscall(SYS_memfd_create, "swarm-cow", 0);
+	if(memfd != -1 || errno != ENOSYS)
+		return memfd;
+#endif
+	// The object only needs a name until it is opened
+	static int objects = 0;
+	std::ostringstream name;
+	name << "/swarm-cow-" << getpid() << "-" << __sync_fetch_and_add(&objects, 1);
+	const int fd = shm_open(name.str().c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd != -1)
+		shm_unlink(name.str().c_str());
+	return fd;
+}
+
+bool cow_share(void* bodies, const size_t& body_bytes, void* systems, const size_t& sys_bytes
+		, void* bodies_copy, void* systems_copy){
+	const size_t sys_offset = whole_pages(body_bytes);
+	const size_t length = sys_offset + whole_pages(sys_bytes);
+
+	const int fd = cow_create_object();
+	if(fd == -1)
+		return false;
+	// Reserve the pages now, a sparse object that runs out of memory
+	// would only fail with SIGBUS while it is being written
+	if(ftruncate(fd, length) != 0 || posix_fallocate(fd, 0, length) != 0) {
+		close(fd);
+		return false;
+	}
+
+	void* p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(p == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+	// Copy in parallel so that the pages are spread like the arrays were
+	cow_copy_task tb((char*) p, (const char*) bodies, body_bytes);
+	runtime::instance().parallel_for((body_bytes + cow_copy_grain - 1) / cow_copy_grain, tb);
+	cow_copy_task ts((char*) p + sys_offset, (const char*) systems, sys_bytes);
+	runtime::instance().parallel_for((sys_bytes + cow_copy_grain - 1) / cow_copy_grain, ts);
+	munmap(p, length);
+
+	const bool ok = cow_map(fd, 0, body_bytes, bodies_copy) && cow_map(fd, sys_offset, sys_bytes, systems_copy);
+	// The sources hold the same content as the object, sharing its pages
+	// releases their own. Where that fails they just keep them
+	if(ok) {
+		cow_map(fd, 0, body_bytes, bodies);
+		cow_map(fd, sys_offset, sys_bytes, systems);
+	}
+	close(fd);
+	return ok;
+}
+
+}
@@ -3,6 +3,15 @@
 
 namespace swarm {
 
+/*! Copy the arrays to an unnamed shared memory object and map it
+ *  copy-on-write in place of the page_alloc arrays bodies_copy and
+ *  systems_copy, and of the source arrays as well. Returns false if there
+ *  is not enough shared memory, the copies are then left unusable. The
+ *  sources keep their content either way
+ */
+bool cow_share(void* bodies, const size_t& body_bytes, void* systems, const size_t& sys_bytes
+                , void* bodies_copy, void* systems_copy);
+
 /*! Allocator based version of ensemble containing memory management routines
  * It takes an allocator as a parameter and uses the allocator for 
  * allocate, deallocate and copying the ensemble. The allocated memories are
@@ -25,11 +34,45 @@ struct EnsembleAlloc : public EnsembleBase<W> {
                 return cloneTo<EnsembleAlloc>();
         }
 
+        /*! Copy-on-write clone, for ensembles in host memory.
+         *  The arrays are copied once to a shared memory object, and both
+         *  this ensemble and the clone map it copy-on-write, so memory is
+         *  only duplicated for the pages that one of them writes to
+         *  afterwards, e.g. the systems that an integrator advances. Copies
+         *  are made per page, not per chunk, a page holds a few chunks.
+         *  The arrays of this ensemble are replaced in place, at the same
+         *  addresses and with the same content, so all copies of this
+         *  ensemble object keep working on them and the original pages
+         *  are released.
+         *  Ensembles that were not allocated by NumaAllocator::alloc, or when
+         *  the shared memory cannot be allocated, get a plain clone().
+         */
+        EnsembleAlloc cow_clone() {
+                const size_t body_bytes = Base::bodies().block_count() * sizeof(Body);
+                const size_t sys_bytes = Base::systems().block_count() * sizeof(Sys);
+                if(body_bytes == 0 || sys_bytes == 0 || !page_allocated(BodyAllocator())
+                                || !owned(_body) || !owned(_sys))
+                        return clone();
+
+                PBody b ( (Body*) page_alloc(body_bytes), &BodyAllocator::free );
+                PSys s ( (Sys*) page_alloc(sys_bytes), &SysAllocator::free );
+                if(!b || !s || !cow_share(Base::bodies().begin(), body_bytes, Base::systems().begin(), sys_bytes, b.get(), s.get()))
+                        return clone();
+                return EnsembleAlloc(Base::nbod(),Base::nsys(),b,s);
+        }
+
         //! Create a new ensemble that can accomodate nsys systems with nbod bodies
         //! Arrays are allocated on the heap but ensemble structure is value-copied
         static EnsembleAlloc create(const int& nbod, const int& nsys) {
-                PBody b ( BodyAllocator::alloc( Base::body_element_count(nbod,nsys) ), &BodyAllocator::free );
-                PSys s ( SysAllocator::alloc( Base::sys_element_count(nsys) ), &SysAllocator::free );
+                PBody b ( alloc_chunks( BodyAllocator(), Base::body_element_count(nbod,nsys), nbod ), &BodyAllocator::free );
+                PSys s ( alloc_chunks( SysAllocator(), Base::sys_element_count(nsys), 1 ), &SysAllocator::free );
+                return EnsembleAlloc(nbod,nsys,b,s);
+        }
+
+        //! Create an ensemble on memory that was allocated elsewhere (e.g. a memory mapped file).
+        //! The arrays should be large enough for nbod,nsys and the shared pointers
+        //! decide when they are released
+        static EnsembleAlloc attach(const int& nbod, const int& nsys, PBody b, PSys s) {
                 return EnsembleAlloc(nbod,nsys,b,s);
         }
 
@@ -51,6 +94,14 @@ struct EnsembleAlloc : public EnsembleBase<W> {
 
         EnsembleAlloc(){}
         private:
+        //! Whether the array was allocated by create() and is released by the allocator
+        template< class P >
+        static bool owned(const P& p) {
+                typedef void (*Free)(typename P::element_type*);
+                Free* f = boost::get_deleter<Free>(p);
+                return f != 0 && *f == &_Allocator<typename P::element_type>::free;
+        }
+
         EnsembleAlloc(const int& nbod,const int& nsys, PBody b, PSys s):
                 Base(nbod,nsys,b.get(),s.get())
                 ,_body(b),_sys(s){}
@@ -61,9 +112,10 @@ struct EnsembleAlloc : public EnsembleBase<W> {
 
 
 //! Default ensemble class for most of uses
-typedef EnsembleAlloc< ENSEMBLE_CHUNK_SIZE , DefaultAllocator > defaultEnsemble;
+//! Memory is placed for the CPU worker threads, c.f. NumaAllocator
+typedef EnsembleAlloc< ENSEMBLE_CHUNK_SIZE , NumaAllocator > defaultEnsemble;
 //! Ensemble allocated on host memory
-typedef EnsembleAlloc< ENSEMBLE_CHUNK_SIZE , DefaultAllocator > hostEnsemble;
+typedef EnsembleAlloc< ENSEMBLE_CHUNK_SIZE , NumaAllocator > hostEnsemble;
 //! Ensemble allocated on [GPU] device memory
 typedef EnsembleAlloc< ENSEMBLE_CHUNK_SIZE , DeviceAllocator > deviceEnsemble;
 
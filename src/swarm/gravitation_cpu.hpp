@@ -0,0 +1,187 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file gravitation_cpu.hpp
+ *   \brief Defines \ref swarm::cpu::calc_acc_jerk, the Newtonian
+ *          acceleration and jerk of the bodies of a system on the CPU.
+ *
+ *   This is the force calculation of hermite_cpu; the CPU monitors that
+ *   need accelerations (e.g. log_transit_cpu) use it as well.
+ */
+#pragma once
+
+#include "types/ensemble.hpp"
+
+namespace swarm { namespace cpu {
+
+/*! Number of massive bodies of sys: the bodies with zero mass at the end
+ *  of the system are test particles.
+ *
+ *  Test particles feel the gravity of the massive bodies but not of each
+ *  other, and do not pull on the massive bodies. The CPU force calculations
+ *  skip these pairs, so a system of N massive bodies and M test particles
+ *  costs O(N (N + M)) instead of O((N + M)^2). The GPU kernels still
+ *  evaluate every pair, one thread per pair. The star (body 0) is
+ *  always massive.
+ */
+inline int massive_body_count(const ensemble::SystemRef& sys){
+	int n = sys.nbod();
+	while(n > 1 && sys[n-1].mass() == 0)
+		n--;
+	return n;
+}
+
+/*! Test particles of a system in a structure of arrays.
+ *
+ *  In the ensemble the components of a body are far apart (c.f.
+ *  \ref swarm::EnsembleBase), the block copies the test particles next to
+ *  each other so the force of a massive body on all of them is computed
+ *  in one vectorized loop. Allocated by the integrator, usually from its
+ *  scratch_arena with alloc().
+ */
+struct test_particle_block {
+	//! Index of the first test particle in the system and number of test particles
+	int first, count;
+	double *pos[3], *vel[3], *acc[3], *jerk[3];
+
+	//! Allocate the arrays for systems with at most n test particles
+	template<class Allocator>
+	void alloc(Allocator& a, const int& n) {
+		first = count = 0;
+		for(int c = 0; c < 3; c++) {
+			pos[c] = a.template alloc<double>(n), vel[c] = a.template alloc<double>(n);
+			acc[c] = a.template alloc<double>(n), jerk[c] = a.template alloc<double>(n);
+		}
+	}
+
+	//! Copy the test particles of sys into the block
+	void load(const ensemble::SystemRef& sys) {
+		first = massive_body_count(sys), count = sys.nbod() - first;
+		for(int c = 0; c < 3; c++) for(int t = 0; t < count; t++)
+			pos[c][t] = sys[first+t][c].pos(), vel[c][t] = sys[first+t][c].vel();
+	}
+};
+
+/*! Add the acceleration and jerk from a body of mass m at position x
+ *  and velocity v to n test particles.
+ *
+ *  The arrays do not alias, the loop has no branches and is vectorized
+ *  over the test particles.
+ */
+inline void add_acc_jerk_to_test_particles(const double& m, const double x[3], const double v[3], const int& n
+		, const double* __restrict px, const double* __restrict py, const double* __restrict pz
+		, const double* __restrict vx, const double* __restrict vy, const double* __restrict vz
+		, double* __restrict ax, double* __restrict ay, double* __restrict az
+		, double* __restrict jx, double* __restrict jy, double* __restrict jz){
+	for(int t = 0; t < n; t++) {
+		const double dx = x[0] - px[t], dy = x[1] - py[t], dz = x[2] - pz[t];
+		const double dvx = v[0] - vx[t], dvy = v[1] - vy[t], dvz = v[2] - vz[t];
+		const double r2 = dx*dx + dy*dy + dz*dz;
+		const double scalar = m / ( sqrt(r2) * r2 );
+		const double rv = (dx*dvx + dy*dvy + dz*dvz) * 3. / r2;
+		ax[t] += dx * scalar, ay[t] += dy * scalar, az[t] += dz * scalar;
+		jx[t] += (dvx - dx * rv) * scalar, jy[t] += (dvy - dy * rv) * scalar, jz[t] += (dvz - dz * rv) * scalar;
+	}
+}
+
+/*! Acceleration and jerk of all bodies of sys.
+ *
+ *  Test particles (c.f. massive_body_count) only feel the massive bodies.
+ *  With a test_particle_block, their forces are computed in the block.
+ */
+inline void calc_acc_jerk(const ensemble::SystemRef& sys, double acc[][3], double jerk[][3], test_particle_block* block = 0){
+	const int nbod = sys.nbod();
+	const int nmassive = massive_body_count(sys);
+
+	/// Clear acc and jerk
+	for(int b = 0; b < nbod; b++)	for(int c =0; c < 3; c++) 
+		acc[b][c] = 0, jerk[b][c] = 0;
+
+	/// Loop through all pairs of massive bodies
+	for(int i=0; i < nmassive-1; i++) for(int j = i+1; j < nmassive; j++) {
+
+		double dx[3] = { sys[j][0].pos()-sys[i][0].pos(),
+			sys[j][1].pos()-sys[i][1].pos(),
+			sys[j][2].pos()-sys[i][2].pos()
+		};
+		double dv[3] = { sys[j][0].vel()-sys[i][0].vel(),
+			sys[j][1].vel()-sys[i][1].vel(),
+			sys[j][2].vel()-sys[i][2].vel()
+		};
+
+		/// Calculated the magnitude
+		double r2 = dx[0]*dx[0] + dx[1]*dx[1] + dx[2] * dx[2];
+		double rinv = 1 / ( sqrt(r2) * r2 ) ;
+		double rv =  (dx[0]*dv[0]+dx[1]*dv[1]+dx[2]*dv[2]) * 3. / r2;
+
+		/// Update acc/jerk for i
+		const double scalar_i = +rinv*sys[j].mass();
+		for(int c = 0; c < 3; c++) {
+			acc[i][c] += dx[c]* scalar_i;
+			jerk[i][c] += (dv[c] - dx[c] * rv) * scalar_i;
+		}
+
+		/// Update acc/jerk for j
+		const double scalar_j = -rinv*sys[i].mass();
+		for(int c = 0; c < 3; c++) {
+			acc[j][c] += dx[c]* scalar_j;
+			jerk[j][c] += (dv[c] - dx[c] * rv) * scalar_j;
+		}
+	}
+
+	if(nmassive == nbod) return;
+
+	/// Stream the test particles past every massive body
+	if(block) {
+		block->load(sys);
+		const int n = block->count;
+		for(int c = 0; c < 3; c++) for(int t = 0; t < n; t++)
+			block->acc[c][t] = 0, block->jerk[c][t] = 0;
+		for(int i = 0; i < nmassive; i++) {
+			const double x[3] = { sys[i][0].pos(), sys[i][1].pos(), sys[i][2].pos() };
+			const double v[3] = { sys[i][0].vel(), sys[i][1].vel(), sys[i][2].vel() };
+			add_acc_jerk_to_test_particles(sys[i].mass(), x, v, n
+				, block->pos[0], block->pos[1], block->pos[2], block->vel[0], block->vel[1], block->vel[2]
+				, block->acc[0], block->acc[1], block->acc[2], block->jerk[0], block->jerk[1], block->jerk[2]);
+		}
+		for(int t = 0; t < n; t++) for(int c = 0; c < 3; c++)
+			acc[nmassive+t][c] = block->acc[c][t], jerk[nmassive+t][c] = block->jerk[c][t];
+		return;
+	}
+
+	/// Without a block, loop through the test particles in place
+	for(int t = nmassive; t < nbod; t++) for(int i = 0; i < nmassive; i++) {
+		double dx[3] = { sys[i][0].pos()-sys[t][0].pos(),
+			sys[i][1].pos()-sys[t][1].pos(),
+			sys[i][2].pos()-sys[t][2].pos()
+		};
+		double dv[3] = { sys[i][0].vel()-sys[t][0].vel(),
+			sys[i][1].vel()-sys[t][1].vel(),
+			sys[i][2].vel()-sys[t][2].vel()
+		};
+		double r2 = dx[0]*dx[0] + dx[1]*dx[1] + dx[2] * dx[2];
+		double rv =  (dx[0]*dv[0]+dx[1]*dv[1]+dx[2]*dv[2]) * 3. / r2;
+		const double scalar = sys[i].mass() / ( sqrt(r2) * r2 );
+		for(int c = 0; c < 3; c++) {
+			acc[t][c] += dx[c]* scalar;
+			jerk[t][c] += (dv[c] - dx[c] * rv) * scalar;
+		}
+	}
+}
+
+} } // Close namespaces
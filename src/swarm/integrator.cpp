@@ -51,6 +51,9 @@ namespace swarm {
 		set_log_manager(log::manager::default_log());
 		_max_iterations = cfg.optional("max_iterations", _default_max_iterations );
 		_max_attempts = cfg.optional("max_attempts", _default_max_attempts );
+		if(cfg.valid("checkpoint_file"))
+			_checkpoint.reset(new checkpoint(cfg));
+		_conservation = conservation_tracker(cfg);
 	}
 
 	gpu::integrator::integrator(const config &cfg)
@@ -89,7 +92,37 @@ namespace swarm {
 	}
 
 	void integrator::integrate() {
+		if(!_checkpoint) {
+			integrate_segment();
+			return;
+		}
+
+		// Integrate in segments that end at the checkpoint times
+		const double destination_time = _destination_time;
+		double time = get_ensemble().time_ranges().min;
+		try {
+			do {
+				time = _checkpoint->next_stop(time, destination_time);
+				_destination_time = time;
+				integrate_segment();
+				if(time < destination_time)
+					_checkpoint->reached(get_ensemble(), time);
+			} while(time < destination_time);
+		} catch(...) {
+			_destination_time = destination_time;
+			throw;
+		}
+		_destination_time = destination_time;
+		_checkpoint->wait();
+	}
+
+	void integrator::begin_segment() {
 		activate_inactive_systems(_ens);
+		_conservation.prepare(_ens);
+	}
+
+	void integrator::integrate_segment() {
+		begin_segment();
 		for(int i = 0; i < _max_attempts; i++)
 		  {
 			launch_integrator();
@@ -99,7 +132,7 @@ namespace swarm {
 		}
 	};
 
-	void gpu::integrator::integrate() {
+	void gpu::integrator::integrate_segment() {
 
 		
 
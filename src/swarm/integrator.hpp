@@ -29,6 +29,9 @@
 #include "ensemble_alloc.hpp"
 #include "types/config.hpp"
 #include "log/logmanager.hpp"
+#include "checkpoint.hpp"
+#include "conservation.hpp"
+#include "runtime.hpp"
 
 
 namespace swarm {
@@ -79,6 +82,18 @@ class integrator {
 	//! Integrater implementation provided by derived instance
 	virtual void launch_integrator() = 0 ;
 
+	//! Checkpoints written during integrate, null if checkpointing is disabled
+	Pcheckpoint _checkpoint;
+
+	//! Running energy and angular momentum errors, c.f. \ref conservation_tracker
+	conservation_tracker _conservation;
+
+	/*! Integrate the ensemble up to the destination time, 
+	 *  called by integrate() once, or once per stop when
+	 *  checkpointing is enabled
+	 */
+	virtual void integrate_segment();
+
 	public:
 	//! Inetgrator class should be configurable. 
 	//! Derived instances should also have a constructor with similar signature 
@@ -94,9 +109,41 @@ class integrator {
 	 *
 	 *  To set the parameters for integration use set_ensemble(ens),
 	 *  set_destination_time(t), set_log_manager(l) 
+	 *
+	 *  If checkpointing is configured (checkpoint_file, c.f. \ref checkpoint)
+	 *  the integration stops at the times chosen by the checkpoint object
+	 *  and the checkpoints are written in the background while the
+	 *  integration continues. integrate() returns after the last checkpoint
+	 *  is on disk.
 	 */
 	virtual void integrate();
 
+	/*! Reactivate the inactive systems of the ensemble before the
+	 *  launches of a segment, c.f. integrate_segment()
+	 */
+	void begin_segment();
+
+	/*! Work of one launch_integrator() call as a task over the systems
+	 *  of the ensemble, to be run on the worker threads of \ref runtime
+	 *  together with the work of other integrators (c.f.
+	 *  \ref ragged_integration). Returns null if the integrator does not
+	 *  run on the worker threads. The caller deletes the task.
+	 */
+	virtual runtime::task* create_system_task() { return 0; }
+
+	/*! True if the integrator updates the conservation tracker after
+	 *  its steps, so that the attributes chosen by track_energy_attribute
+	 *  and track_angular_momentum_attribute hold the current errors
+	 *  (c.f. \ref conservation_tracker)
+	 */
+	virtual bool tracks_conservation() const { return false; }
+
+	//! Set the checkpoint object, pass a null pointer to disable checkpointing
+	virtual void set_checkpoint(const Pcheckpoint& c) { _checkpoint = c; }
+
+	//! The checkpoint object, null if checkpointing is disabled
+	virtual Pcheckpoint get_checkpoint() { return _checkpoint; }
+
         //! Flush the host log
         virtual void flush_log() {
 	  _logman->flush();	  
@@ -110,6 +157,7 @@ class integrator {
 	//! Set the ensemble subject to integration
 	virtual void set_ensemble(defaultEnsemble& ens) {
 		_ens = ens;
+		_conservation.reset();
 	}
 
 	//! Set the time marker to end the integration
@@ -187,22 +235,21 @@ class integrator : public swarm::integrator {
 	//! GPU log object obtained from log manager.
 	gpulog::device_log* _log;
 
-	public: 
-
-	//! Pass on constructor
-	integrator(const config &cfg);
-
-	/*! Interfaces function to integrate, for use by general user.
-	 *  Launches the GPU integrator kernel several times up to
+	/*! Launches the GPU integrator kernel several times up to
 	 *  the value specified in \ref _max_attempts until all the
 	 *  systems are inactive. Each kernel call can go through
 	 *  at most a limited number of iterations specified in
-	 *  \ref _max_iterations .
+	 *  \ref _max_iterations . c.f. swarm::integrator::integrate
 	 *
 	 *  To set the parameters for integration use set_ensemble(ens),
 	 *  set_destination_time(t), set_log_manager(l) 
 	 */
-	virtual void integrate();
+	virtual void integrate_segment();
+
+	public: 
+
+	//! Pass on constructor
+	integrator(const config &cfg);
 
 	/** To integrate without any bookkeeping
 	 *
@@ -237,6 +237,18 @@ Pprimary_cursor_t bdb_database::primary_cursor(){
     return c;
 }
 
+Psecondary_cursor_t bdb_database::system_cursor(){
+    shared_ptr<secondary_cursor_t> c(new secondary_cursor_t);
+    system_idx.cursor(0,&c->_c,0);
+    return c;
+}
+
+Psecondary_cursor_t bdb_database::event_cursor(){
+    shared_ptr<secondary_cursor_t> c(new secondary_cursor_t);
+    event_idx.cursor(0,&c->_c,0);
+    return c;
+}
+
 void bdb_database::close(){
 	event_idx.close(0);
 	time_idx.close(0);
@@ -275,6 +287,29 @@ bool primary_cursor_t::position_at(pkey_t& key,lrw_t& lr){
     return _c->get(&k,&d,DB_SET_RANGE) == 0;
 }
 
+void secondary_cursor_t::close(){
+    _c->close();
+}
+
+bool secondary_cursor_t::get(pkey_t& key, lrw_t& lr, uint32_t flags){
+    // The secondary key is not returned, it can be
+    // extracted from the primary key.
+    char skey[sizeof(sysid_t)];
+    Dbt k;
+    Dbt p;
+    Dbt d;
+    k.set_data(skey);
+    p.set_data(&key);
+    d.set_data(lr.ptr);
+    k.set_ulen(sizeof(skey));
+    p.set_ulen(sizeof(key));
+    d.set_ulen(lr.len);
+    k.set_flags(DB_DBT_USERMEM);
+    p.set_flags(DB_DBT_USERMEM);
+    d.set_flags(DB_DBT_USERMEM);
+    return _c->pget(&k,&p,&d,flags) == 0;
+}
+
 
 void bdb_database::flush()
 {
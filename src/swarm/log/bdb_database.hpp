@@ -8,6 +8,7 @@
 namespace swarm { namespace log {
 
 struct primary_cursor_t;
+struct secondary_cursor_t;
 
 class bdb_database {
 
@@ -34,6 +35,8 @@ public:
     void close(); 
 
     shared_ptr<primary_cursor_t> primary_cursor();
+    shared_ptr<secondary_cursor_t> system_cursor();
+    shared_ptr<secondary_cursor_t> event_cursor();
     
     // Methods for accessing metadata
     void addMetaData(const std::string name, const std::string value);
@@ -94,5 +97,41 @@ struct primary_cursor_t {
 };
 typedef shared_ptr<primary_cursor_t> Pprimary_cursor_t;
 
+/*!
+ * Cursor over one of the secondary indices (system_idx, event_idx).
+ * Records are visited in the order of the secondary key, duplicates
+ * are sorted by the primary key (time then system). The primary key
+ * and the record are returned, the secondary key can be recovered
+ * from the primary key.
+ */
+struct secondary_cursor_t {
+    Dbc* _c;
+    void close();
+    bool get(pkey_t& key,lrw_t& lr, uint32_t flags);
+    bool next(pkey_t& key,lrw_t& lr){ return get(key,lr,DB_NEXT); }
+  /*!
+   * Position at the first record whose secondary key is not less
+   * than skey. K should be the type of the secondary key, i.e.
+   * sysid_t or evtid_t.
+   */
+    template<typename K>
+    bool position_at(const K& skey, pkey_t& key,lrw_t& lr){
+        K sk = skey;
+        Dbt k, p, d;
+        k.set_data(&sk);
+        k.set_size(sizeof(sk));
+        k.set_ulen(sizeof(sk));
+        k.set_flags(DB_DBT_USERMEM);
+        p.set_data(&key);
+        p.set_ulen(sizeof(key));
+        p.set_flags(DB_DBT_USERMEM);
+        d.set_data(lr.ptr);
+        d.set_ulen(lr.len);
+        d.set_flags(DB_DBT_USERMEM);
+        return _c->pget(&k,&p,&d,DB_SET_RANGE) == 0;
+    }
+};
+typedef shared_ptr<secondary_cursor_t> Psecondary_cursor_t;
+
 
 } } // close namespace log :: swarm
@@ -23,6 +23,7 @@
 
 #include "../common.hpp"
 #include "io.hpp"
+#include <queue>
 
 
 using namespace swarm::log;
@@ -263,6 +264,85 @@ bool sort_binary_log_file(const std::string &outfn, const std::string &infn)
 	return true;
 }
 
+//! Next record of one of the files being merged
+struct merge_head
+{
+	gpulog::logrecord lr;
+	double T;
+	int sys, input;
+
+	// reversed, std::priority_queue returns the largest element
+	bool operator <(const merge_head &a) const
+	{
+		return T > a.T || (T == a.T && (sys > a.sys || (sys == a.sys && input > a.input)));
+	}
+};
+
+/*
+	The inputs are merged as they are read, so only one record of
+	every input is held in memory. Unsorted inputs are sorted into
+	a temporary file first.
+*/
+
+//! Merge log files into one sorted log file
+bool merge_binary_log_files(const std::string &outfn, const std::vector<std::string> &infns)
+{
+	std::vector<std::string> temporary;
+	std::vector<boost::shared_ptr<mmapped_swarm_file> > mm;
+	uint64_t datalen = 0;
+	for(int i = 0; i != infns.size(); i++)
+	{
+		std::string fn = infns[i];
+		{
+			mmapped_swarm_file check(fn, "", MemoryMap::ro, false);
+			if(!swarm_header(SORTED_HEADER_CHECK).is_compatible(check.hdr()))
+			{
+				fn = outfn + ".sorting";
+				std::ostringstream o; o << i; fn += o.str();
+				if(!sort_binary_log_file(fn, infns[i])) return false;
+				temporary.push_back(fn);
+			}
+		}
+		mm.push_back(boost::shared_ptr<mmapped_swarm_file>(new mmapped_swarm_file(fn, SORTED_HEADER_CHECK)));
+		datalen += mm.back()->size();
+	}
+
+	std::vector<gpulog::ilogstream> streams;
+	std::priority_queue<merge_head> heads;
+	for(int i = 0; i != mm.size(); i++)
+		streams.push_back(gpulog::ilogstream(mm[i]->data(), mm[i]->size()));
+	for(int i = 0; i != streams.size(); i++)
+	{
+		merge_head h;
+		h.input = i;
+		if(h.lr = streams[i].next())
+		{
+			get_Tsys(h.lr, h.T, h.sys);
+			heads.push(h);
+		}
+	}
+
+	std::ofstream out(outfn.c_str());
+	swarm_header fh(SORTED_HEADER_FULL, 0, datalen);
+	out.write((char*)&fh, sizeof(fh));
+	while(!heads.empty())
+	{
+		merge_head h = heads.top();
+		heads.pop();
+		out.write(h.lr.ptr, h.lr.len());
+		if(h.lr = streams[h.input].next())
+		{
+			get_Tsys(h.lr, h.T, h.sys);
+			heads.push(h);
+		}
+	}
+	out.close();
+
+	for(int i = 0; i != temporary.size(); i++)
+		unlink(temporary[i].c_str());
+	return !out.fail();
+}
+
 //! Define structure sysinfo 
 struct sysinfo
 {
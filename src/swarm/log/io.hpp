@@ -196,6 +196,7 @@ namespace swarm {
 	};
 
 	bool sort_binary_log_file(const std::string &outfn, const std::string &infn);
+	bool merge_binary_log_files(const std::string &outfn, const std::vector<std::string> &infns);
 
 } } // end namespace query:: swarm
 
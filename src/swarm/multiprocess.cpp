@@ -0,0 +1,200 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file multiprocess.cpp
+ *   \brief Implements \ref swarm::multiprocess_integration.
+ *
+ */
+
+#include "common.hpp"
+#include "multiprocess.hpp"
+#include "integrator.hpp"
+#include "runtime.hpp"
+#include "log/io.hpp"
+
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+namespace swarm {
+
+//! Name of the log file of a worker
+std::string worker_log_name(const std::string& name, const int& k){
+	std::ostringstream o;
+	o << name << ".worker" << k;
+	return o.str();
+}
+
+//! Wall-clock time in seconds
+double worker_clock(){
+	timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+multiprocess_integration::multiprocess_integration(const config& cfg):_cfg(cfg){
+	_processes = cfg.require("shard_processes", 0);
+	if(_processes < 1) ERROR("shard_processes should be at least 1");
+	_threads = cfg.optional("shard_threads", std::max(1, runtime::instance().thread_count() / _processes));
+	if(_threads < 1) ERROR("shard_threads should be at least 1");
+	cfg.require("destination_time", 0.0);
+}
+
+int multiprocess_integration::run_worker(const config& cfg, const shared_ensemble& seg, const int& k, const defaultEnsemble* initial){
+	shared_ensemble::worker_status& status = seg.status(k);
+	status.state = shared_ensemble::RUNNING;
+	const double start = worker_clock();
+	try {
+		const int nworkers = seg.info().nworkers;
+		runtime::instance().restart_after_fork(cfg.optional("shard_threads", 1), k, nworkers);
+
+		defaultEnsemble ens = seg.chunk_range(status.first_chunk, status.chunks);
+		if(initial) {
+			defaultEnsemble source = *initial;
+			const defaultEnsemble::Body* b = source.bodies().begin() + (size_t) status.first_chunk * ens.nbod();
+			const defaultEnsemble::Sys* s = source.systems().begin() + status.first_chunk;
+			memcpy(ens.bodies().begin(), b, ens.bodies().block_count() * sizeof(defaultEnsemble::Body));
+			memcpy(ens.systems().begin(), s, ens.systems().block_count() * sizeof(defaultEnsemble::Sys));
+		}
+
+		config worker_cfg = cfg;
+		if(worker_cfg.valid("log_output")) worker_cfg["log_output"] = worker_log_name(worker_cfg["log_output"], k);
+		if(worker_cfg.valid("log_output_db")) worker_cfg["log_output_db"] = worker_log_name(worker_cfg["log_output_db"], k);
+
+		Pintegrator integ = integrator::create(worker_cfg);
+		integ->set_checkpoint(Pcheckpoint());
+		integ->set_destination_time(cfg.require("destination_time", 0.0));
+		{
+			// The log is written out when its manager goes away
+			log::Pmanager m(new log::manager());
+			m->init(worker_cfg);
+			integ->set_log_manager(m);
+			integ->set_ensemble(ens);
+			integ->integrate();
+			integ->set_log_manager(log::manager::default_log());
+		}
+	} catch(const std::exception& e) {
+		strncpy(status.error, e.what(), sizeof(status.error) - 1);
+		status.error[sizeof(status.error) - 1] = 0;
+		status.seconds = worker_clock() - start;
+		status.state = shared_ensemble::FAILED;
+		return 1;
+	}
+	status.seconds = worker_clock() - start;
+	status.state = shared_ensemble::DONE;
+	return 0;
+}
+
+//! Merge the binary logs of the workers into the log of the calling process
+void merge_worker_logs(const config& cfg, const int& nworkers){
+	if(cfg.optional("log_writer", std::string("null")) != "binary" || !cfg.valid("log_output"))
+		return;
+
+	const std::string output = cfg.at("log_output");
+	std::vector<std::string> logs;
+	for(int k = 0; k < nworkers; k++) {
+		const std::string name = worker_log_name(output, k);
+		if(access(name.c_str(), R_OK) == 0) logs.push_back(name);
+	}
+	if(!query::merge_binary_log_files(output, logs))
+		ERROR("Cannot merge the logs of the workers into " + output);
+
+	for(size_t i = 0; i < logs.size(); i++) {
+		unlink(logs[i].c_str());
+		unlink((logs[i] + ".time.idx").c_str());
+		unlink((logs[i] + ".sys.idx").c_str());
+	}
+	// Generate the indices, c.f. binary_writer
+	query::swarmdb db(output);
+}
+
+multiprocess_integration::result multiprocess_integration::run(const defaultEnsemble& initial){
+	// The pool of the children is started again from this one
+	runtime::instance();
+
+	std::ostringstream name;
+	static int segments = 0;
+	name << "/swarm-" << getpid() << "-" << segments++;
+
+	const int chunks = (initial.nsys() + defaultEnsemble::CHUNK_SIZE - 1) / defaultEnsemble::CHUNK_SIZE;
+	const int nworkers = std::max(1, std::min(_processes, chunks));
+	shared_ensemble seg = shared_ensemble::create(name.str(), initial.nbod(), initial.nsys(), nworkers);
+	seg.unlink();  // The workers inherit the mapping, the name is not needed any more
+
+	config worker_cfg = _cfg;
+	{
+		std::ostringstream t;
+		t << _threads;
+		worker_cfg["shard_threads"] = t.str();
+	}
+
+	// Output buffered before fork() would be written by every child
+	std::cout.flush(), std::cerr.flush();
+	fflush(NULL);
+
+	std::vector<pid_t> children;
+	for(int k = 0; k < nworkers; k++) {
+		const pid_t pid = fork();
+		if(pid == 0) {
+			const int code = run_worker(worker_cfg, seg, k, &initial);
+			std::cout.flush(), std::cerr.flush();
+			fflush(NULL);
+			_exit(code);
+		}
+		if(pid == -1) {
+			for(size_t i = 0; i < children.size(); i++) {
+				kill(children[i], SIGTERM);
+				waitpid(children[i], NULL, 0);
+			}
+			ERROR("Cannot start worker processes");
+		}
+		children.push_back(pid);
+	}
+
+	std::ostringstream errors;
+	for(int k = 0; k < nworkers; k++) {
+		int code = 0;
+		while(waitpid(children[k], &code, 0) == -1 && errno == EINTR);
+		const shared_ensemble::worker_status& s = seg.status(k);
+		if(s.state == shared_ensemble::FAILED)
+			errors << "\nworker " << k << ": " << s.error;
+		else if(s.state != shared_ensemble::DONE) {
+			errors << "\nworker " << k << " did not finish";
+			if(WIFSIGNALED(code)) errors << " (signal " << WTERMSIG(code) << ")";
+		}
+	}
+	if(!errors.str().empty())
+		ERROR("Integration failed in worker processes:" + errors.str());
+
+	merge_worker_logs(_cfg, nworkers);
+
+	result r;
+	r.ens = seg.ensemble();
+	r.workers = nworkers;
+	r.active = 0;
+	for(int i = 0; i < r.ens.nsys(); i++)
+		if(r.ens[i].is_active()) r.active++;
+	r.seconds = 0;
+	for(int k = 0; k < nworkers; k++)
+		r.seconds = std::max(r.seconds, seg.status(k).seconds);
+	return r;
+}
+
+}
@@ -0,0 +1,93 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file multiprocess.hpp
+ *   \brief Defines \ref swarm::multiprocess_integration, integration of
+ *   an ensemble by several processes on one machine.
+ *
+ *   Configuration options:
+ *    - shard_processes: number of worker processes, at most one per
+ *      ensemble chunk.
+ *    - shard_threads: CPU threads of every worker process (default: the
+ *      threads of the calling process divided by the number of workers).
+ *    - destination_time: time to integrate the systems to.
+ *
+ */
+#pragma once
+
+#include "common.hpp"
+#include "types/config.hpp"
+#include "shared_ensemble.hpp"
+
+namespace swarm {
+
+/*! Integrate an ensemble with several worker processes.
+ *
+ *  The ensemble is placed in a shared memory segment (c.f.
+ *  \ref shared_ensemble) and every worker process integrates its own
+ *  range of ensemble chunks in place, with its own integrator, worker
+ *  threads and log. Worker k copies its initial conditions into the
+ *  segment itself, so the memory is placed close to the CPUs it runs
+ *  on (with cpu_affinity, every worker is restricted to its share of
+ *  the CPUs). This avoids contention on locks and allocators of a single
+ *  process and lets Python users integrate on all cores without
+ *  holding the interpreter lock.
+ *
+ *  A worker reports its progress and errors in its status record in the
+ *  segment. The calling process waits for all workers, fails if any of
+ *  them failed and merges the logs: with the binary log writer the logs
+ *  of the workers (log_output with the suffix .worker<k>) are merged
+ *  into log_output, other writers leave one log per worker.
+ *
+ *  The workers only need the name of the segment and their number
+ *  (c.f. run_worker), so they could also be started by other means than
+ *  fork(), e.g. on other nodes that share the memory.
+ *
+ *  The workers are created with fork(), which does not carry GPU state
+ *  to the children; this mode is meant for the CPU integrators.
+ */
+class multiprocess_integration {
+	public:
+	//! Summary of a run
+	struct result {
+		//! The integrated ensemble, stays in the shared memory segment
+		defaultEnsemble ens;
+		int workers;
+		//! Systems that are still active
+		int active;
+		//! Wall-clock time of the slowest worker
+		double seconds;
+	};
+
+	multiprocess_integration(const config& cfg);
+
+	//! Integrate a copy of initial in worker processes
+	result run(const defaultEnsemble& initial);
+
+	/*! Body of worker k: integrate its chunks of the segment and fill its status record.
+	 *  If initial is not null, the chunks are first copied from initial.
+	 *  Returns 0 on success, 1 if the integration failed.
+	 */
+	static int run_worker(const config& cfg, const shared_ensemble& seg, const int& k, const defaultEnsemble* initial);
+
+	private:
+	config _cfg;
+	int _processes, _threads;
+};
+
+}
@@ -240,6 +240,24 @@ body center_of_mass(const body* bodies, const int nbod ){
 }
 
 
+// EVT_ENCOUNTER, EVT_COLLISION and EVT_COLLISION_CENTRAL
+std::ostream& record_output_3(std::ostream &out, gpulog::logrecord &lr, body_range_t &body_range)
+{
+	double T;
+	int sys, body_id1, body_id2;
+	double dmin;
+	lr >> T >> sys >> body_id1 >> body_id2 >> dmin;
+	if(!body_range.in(body_id1) && !body_range.in(body_id2)) return out;
+
+        size_t bufsize = 1000;
+        char buf[bufsize];
+	snprintf(buf, bufsize, "%10d %lg  %6d %6d %6d  %lg", lr.msgid(), T, sys, body_id1, body_id2, dmin);
+	out << buf;
+
+	return out;
+}
+
+
 // EVT_TRANSIT
 std::ostream& record_output_15(std::ostream &out, gpulog::logrecord &lr, body_range_t &body_range)
 {
@@ -305,8 +323,10 @@ std::ostream& record_output_16(std::ostream &out, gpulog::logrecord &lr, body_ra
 	  return record_output_1(out,lr,bod);
 	case 2: // data one body upon ejection
 	  return record_output_2(out,lr,bod);
-	case 3: // reserved for data for one pair of bodies upon close encounter/collision
-	  return record_output_default(out,lr); // feature still missing
+	case 3: // one pair of bodies upon close encounter/collision
+	case 4:
+	case 5:
+	  return record_output_3(out,lr,bod);
 	case 11: // star v_z at observation time
 	  return record_output_11(out,lr,bod);
 	case 15: // near a transit of planet in front of star
@@ -0,0 +1,141 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file ragged.cpp
+ *   \brief Implements \ref swarm::ragged_ensemble and \ref swarm::ragged_integration.
+ *
+ */
+
+#include "common.hpp"
+#include "ragged.hpp"
+#include "runtime.hpp"
+
+#include <map>
+
+namespace swarm {
+
+ragged_ensemble ragged_ensemble::create(const std::vector<int>& nbods){
+	std::map<int,int> count;
+	for(size_t i = 0; i < nbods.size(); i++) {
+		if(nbods[i] < 1) ERROR("Systems should have at least one body");
+		count[nbods[i]]++;
+	}
+
+	ragged_ensemble r;
+	std::map<int,int> bucket_of;
+	for(std::map<int,int>::const_iterator i = count.begin(); i != count.end(); i++) {
+		bucket_of[i->first] = r._buckets.size();
+		r._buckets.push_back(defaultEnsemble::create(i->first, i->second));
+	}
+
+	std::vector<int> used(r._buckets.size(), 0);
+	r._systems.resize(nbods.size());
+	for(size_t i = 0; i < nbods.size(); i++) {
+		location& l = r._systems[i];
+		l.bucket = bucket_of[nbods[i]];
+		l.index = used[l.bucket]++;
+	}
+	return r;
+}
+
+ragged_ensemble ragged_ensemble::group(const std::vector<defaultEnsemble>& parts){
+	std::vector<int> nbods;
+	for(size_t p = 0; p < parts.size(); p++)
+		nbods.insert(nbods.end(), parts[p].nsys(), parts[p].nbod());
+
+	ragged_ensemble r = create(nbods);
+	int k = 0;
+	for(size_t p = 0; p < parts.size(); p++) {
+		defaultEnsemble part = parts[p];
+		for(int i = 0; i < part.nsys(); i++, k++)
+			part[i].copyTo(r[k]);
+	}
+	return r;
+}
+
+/*! The chunks of several system tasks as one range.
+ *  Chunk c of the range is chunk c - first_chunk[k] of task k.
+ */
+struct ragged_task : public runtime::task {
+	std::vector<runtime::task*> tasks;
+	std::vector<int> first_chunk, nsys;
+
+	ragged_task():first_chunk(1, 0){}
+
+	void add(runtime::task* t, const int& n){
+		const int CS = defaultEnsemble::CHUNK_SIZE;
+		tasks.push_back(t);
+		nsys.push_back(n);
+		first_chunk.push_back(first_chunk.back() + (n + CS - 1) / CS);
+	}
+
+	int chunks() const { return first_chunk.back(); }
+
+	void operator()(const int& begin, const int& end, scratch_arena& scratch){
+		const int CS = defaultEnsemble::CHUNK_SIZE;
+		for(int c = begin; c < end; c++) {
+			const int k = std::upper_bound(first_chunk.begin(), first_chunk.end(), c) - first_chunk.begin() - 1;
+			const int first = (c - first_chunk[k]) * CS;
+			(*tasks[k])(first, std::min(first + CS, nsys[k]), scratch);
+		}
+	}
+};
+
+ragged_integration::ragged_integration(const config& cfg):_cfg(cfg){
+	_destination_time = cfg.require("destination_time", 0.0);
+	_max_attempts = cfg.optional("max_attempts", integrator::_default_max_attempts);
+}
+
+void ragged_integration::run(ragged_ensemble& ens){
+	std::vector<Pintegrator> integs;
+	std::vector< shared_ptr<runtime::task> > tasks;
+	ragged_task work;
+
+	// Buckets with more bodies take longer per chunk, they are handed out first
+	for(int k = ens.bucket_count() - 1; k >= 0; k--) {
+		Pintegrator integ = integrator::create(_cfg);
+		integ->set_checkpoint(Pcheckpoint());
+		integ->set_ensemble(ens.bucket(k));
+		integ->set_destination_time(_destination_time);
+
+		shared_ptr<runtime::task> t(integ->create_system_task());
+		if(!t) {
+			integ->integrate();
+			continue;
+		}
+		integs.push_back(integ);
+		tasks.push_back(t);
+		work.add(t.get(), ens.bucket(k).nsys());
+	}
+	if(integs.empty()) return;
+
+	for(size_t k = 0; k < integs.size(); k++)
+		integs[k]->begin_segment();
+
+	for(int a = 0; a < _max_attempts; a++) {
+		runtime::instance().parallel_for(work.chunks(), work);
+		int active = 0;
+		for(size_t k = 0; k < integs.size(); k++) {
+			integs[k]->flush_log();
+			active += number_of_active_systems(integs[k]->get_ensemble());
+		}
+		if(active == 0) break;
+	}
+}
+
+}
@@ -0,0 +1,115 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file ragged.hpp
+ *   \brief Defines \ref swarm::ragged_ensemble, an ensemble of systems
+ *   with different numbers of bodies, and \ref swarm::ragged_integration.
+ *
+ *   Configuration options of ragged_integration:
+ *    - integrator: the integrator used for all buckets.
+ *    - destination_time: time to integrate the systems to.
+ *    - max_attempts: as for the integrators.
+ *
+ */
+#pragma once
+
+#include "common.hpp"
+#include "types/config.hpp"
+#include "integrator.hpp"
+
+namespace swarm {
+
+/*! Ensemble of systems with different numbers of bodies.
+ *
+ *  Systems with the same number of bodies are stored together in a
+ *  bucket, an ordinary defaultEnsemble with its own chunked storage, so
+ *  no memory or force evaluations are spent on padding bodies. The
+ *  buckets are ordered by the number of bodies. Systems keep the index
+ *  they were created with, operator[] finds their bucket.
+ *
+ *  Usage:
+ *  \code
+ *  std::vector<int> nbods;   // number of bodies of every system
+ *  ...
+ *  ragged_ensemble ens = ragged_ensemble::create(nbods);
+ *  ens[i][j][0].pos() = ...;
+ *  ragged_integration(cfg).run(ens);
+ *  \endcode
+ */
+class ragged_ensemble {
+	public:
+	ragged_ensemble(){}
+
+	//! Create an ensemble where system i has nbods[i] bodies
+	static ragged_ensemble create(const std::vector<int>& nbods);
+
+	//! Copy the systems of several ensembles into one ensemble, in order
+	static ragged_ensemble group(const std::vector<defaultEnsemble>& parts);
+
+	int nsys() const { return _systems.size(); }
+	int bucket_count() const { return _buckets.size(); }
+
+	//! Systems with bucket_nbod(k) bodies
+	defaultEnsemble& bucket(const int& k) { return _buckets[k]; }
+	int bucket_nbod(const int& k) const { return _buckets[k].nbod(); }
+
+	//! Number of bodies of system i
+	int nbod(const int& i) const { return _buckets[_systems[i].bucket].nbod(); }
+
+	//! System i, in the order of creation
+	ensemble::SystemRef operator[] (const int& i) { return _buckets[_systems[i].bucket][_systems[i].index]; }
+
+	//! Index of system i in its bucket
+	int index_in_bucket(const int& i) const { return _systems[i].index; }
+
+	private:
+	//! Place of a system
+	struct location {
+		int bucket, index;
+	};
+	std::vector<defaultEnsemble> _buckets;
+	std::vector<location> _systems;
+};
+
+/*! Integrate all buckets of a ragged ensemble at once.
+ *
+ *  Every bucket has its own integrator, created from the same
+ *  configuration. For the integrators that run on the CPU worker threads
+ *  (c.f. integrator::create_system_task), the ensemble chunks of all
+ *  buckets are handed out to the threads from one work list, the chunks
+ *  with most bodies first, so the threads stay busy until the end even
+ *  if the buckets are small. Other integrators, e.g. the GPU
+ *  integrators, which select a kernel for the number of bodies of every
+ *  bucket, integrate the buckets one after the other.
+ *
+ *  Checkpointing is not used in this mode.
+ */
+class ragged_integration {
+	public:
+	ragged_integration(const config& cfg);
+
+	//! Integrate the systems of ens to destination_time
+	void run(ragged_ensemble& ens);
+
+	private:
+	config _cfg;
+	double _destination_time;
+	int _max_attempts;
+};
+
+}
@@ -0,0 +1,381 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file runtime.cpp
+ *   \brief Implements the worker pool of \ref swarm::runtime and
+ *   \ref swarm::scratch_arena.
+ *
+ */
+
+#include "common.hpp"
+#include "runtime.hpp"
+
+#include <unistd.h>
+#include <sched.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace swarm {
+
+//! Alignment of scratch allocations, one cache line
+const size_t scratch_alignment = 64;
+//! Size of the first block of a scratch arena
+const size_t scratch_block_size = 64*1024;
+
+//! Index of the current thread in the pool, c.f. runtime::current_thread
+static __thread int tls_thread_id = -1;
+
+
+scratch_arena::~scratch_arena(){
+	for(size_t i = 0; i < _blocks.size(); i++)
+		free(_blocks[i].ptr);
+}
+
+void* scratch_arena::alloc_bytes(size_t s){
+	s = (s + scratch_alignment - 1) / scratch_alignment * scratch_alignment;
+
+	// Find the first block that can hold s bytes after the current position
+	while(_current < _blocks.size()) {
+		block& b = _blocks[_current];
+		if(_used + s <= b.size) {
+			void* p = b.ptr + _used;
+			_used += s;
+			return p;
+		}
+		_current++, _used = 0;
+	}
+
+	// No block is big enough, add a new one
+	block b;
+	b.size = std::max(s, _blocks.empty() ? scratch_block_size : 2 * _blocks.back().size);
+	if(posix_memalign((void**)&b.ptr, scratch_alignment, b.size) != 0)
+		ERROR("Cannot allocate scratch memory");
+	_blocks.push_back(b);
+	_current = _blocks.size() - 1;
+	_used = s;
+	return b.ptr;
+}
+
+
+runtime& runtime::instance(){
+	static runtime r;
+	return r;
+}
+
+//! Default number of threads: OpenMP setting or number of available CPUs
+int default_thread_count(){
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (int) n : 1;
+#endif
+}
+
+runtime::runtime():_nthreads(0),_pin(false),_static_schedule(true),_generation(0),_running(0),_stopping(false)
+	,_task(0),_n(0),_grain(1),_fixed(false),_next(0),_failed(0) {
+	pthread_mutex_init(&_submit, NULL);
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_wake, NULL);
+	pthread_cond_init(&_done, NULL);
+	start(default_thread_count(), false);
+}
+
+runtime::~runtime(){
+	stop();
+	pthread_cond_destroy(&_done);
+	pthread_cond_destroy(&_wake);
+	pthread_mutex_destroy(&_mutex);
+	pthread_mutex_destroy(&_submit);
+}
+
+void runtime::configure(const config& cfg){
+	const int nthreads = cfg.optional("cpu_threads", default_thread_count());
+	const bool pin = cfg.optional("cpu_affinity", 0) != 0;
+	const std::string schedule = cfg.optional("cpu_schedule", std::string("static"));
+	if(nthreads < 1) ERROR("cpu_threads should be at least 1");
+	if(schedule != "static" && schedule != "dynamic")
+		ERROR("cpu_schedule should be either static or dynamic");
+
+	pthread_mutex_lock(&_submit);
+	_static_schedule = (schedule == "static");
+	if(nthreads != _nthreads || pin != _pin) {
+		stop();
+		start(nthreads, pin);
+	}
+	pthread_mutex_unlock(&_submit);
+}
+
+int runtime::current_thread(){
+	return tls_thread_id;
+}
+
+//! Arguments passed to a new worker thread
+struct worker_args {
+	runtime* r;
+	int id;
+};
+
+void* runtime::worker_main(void* arg){
+	worker_args a = *(worker_args*) arg;
+	delete (worker_args*) arg;
+	tls_thread_id = a.id;
+	a.r->worker_loop(a.id);
+	return 0;
+}
+
+//! Pin the calling thread to the i-th CPU that this process is allowed to run on
+void pin_to_cpu(const int& i){
+#ifdef __linux__
+	cpu_set_t allowed;
+	if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+	const int count = CPU_COUNT(&allowed);
+	if(count == 0) return;
+	for(int cpu = 0, k = 0; cpu < CPU_SETSIZE; cpu++) if(CPU_ISSET(cpu, &allowed)) {
+		if(k++ == i % count) {
+			cpu_set_t s;
+			CPU_ZERO(&s);
+			CPU_SET(cpu, &s);
+			pthread_setaffinity_np(pthread_self(), sizeof(s), &s);
+			return;
+		}
+	}
+#endif
+}
+
+//! Restrict the calling thread to the slice-th of slices parts of the CPUs it may run on
+void restrict_to_cpu_slice(const int& slice, const int& slices){
+#ifdef __linux__
+	cpu_set_t allowed;
+	if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+	const int count = CPU_COUNT(&allowed);
+	const int begin = slice * count / slices, end = (slice + 1) * count / slices;
+	if(begin == end) return;
+	cpu_set_t s;
+	CPU_ZERO(&s);
+	for(int cpu = 0, k = 0; cpu < CPU_SETSIZE; cpu++) if(CPU_ISSET(cpu, &allowed)) {
+		if(k >= begin && k < end) CPU_SET(cpu, &s);
+		k++;
+	}
+	sched_setaffinity(0, sizeof(s), &s);
+#endif
+}
+
+//! Affinity of the calling thread, restored when the object is destroyed
+struct saved_affinity {
+#ifdef __linux__
+	cpu_set_t set;
+	bool valid;
+	saved_affinity():valid(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0){}
+	~saved_affinity(){ if(valid) pthread_setaffinity_np(pthread_self(), sizeof(set), &set); }
+#endif
+};
+
+void runtime::restart_after_fork(const int& nthreads, const int& slice, const int& slices){
+	if(nthreads < 1) ERROR("cpu_threads should be at least 1");
+	if(_pin && slices > 1) restrict_to_cpu_slice(slice, slices);
+
+	// The copies of the locks may be in any state, their owners do not exist here
+	pthread_mutex_init(&_submit, NULL);
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_wake, NULL);
+	pthread_cond_init(&_done, NULL);
+	_threads.clear();
+	for(size_t i = 0; i < _arenas.size(); i++)
+		delete _arenas[i];
+	_arenas.clear();
+	_generation = 0, _task = 0, _failed = 0;
+	_error.clear();
+
+	start(nthreads, _pin);
+}
+
+void runtime::start(const int& nthreads, const bool& pin){
+	_nthreads = nthreads;
+	_pin = pin;
+	_stopping = false;
+	_running = 0;
+	_arenas.resize(nthreads);
+	for(int i = 0; i < nthreads; i++)
+		_arenas[i] = new scratch_arena;
+
+	// Thread 0 is the thread that calls parallel_for
+	_threads.resize(nthreads - 1);
+	for(int i = 1; i < nthreads; i++) {
+		worker_args* a = new worker_args;
+		a->r = this, a->id = i;
+		if(pthread_create(&_threads[i-1], NULL, &runtime::worker_main, a) != 0)
+			ERROR("Cannot start worker threads");
+	}
+}
+
+void runtime::stop(){
+	pthread_mutex_lock(&_mutex);
+	_stopping = true;
+	pthread_cond_broadcast(&_wake);
+	pthread_mutex_unlock(&_mutex);
+
+	for(size_t i = 0; i < _threads.size(); i++)
+		pthread_join(_threads[i], NULL);
+	_threads.clear();
+
+	for(size_t i = 0; i < _arenas.size(); i++)
+		delete _arenas[i];
+	_arenas.clear();
+}
+
+void runtime::worker_loop(const int& id){
+	if(_pin) pin_to_cpu(id);
+
+	unsigned long seen = 0;
+	pthread_mutex_lock(&_mutex);
+	while(true) {
+		while(_generation == seen && !_stopping)
+			pthread_cond_wait(&_wake, &_mutex);
+		if(_stopping) break;
+		seen = _generation;
+		pthread_mutex_unlock(&_mutex);
+
+		process(id);
+
+		pthread_mutex_lock(&_mutex);
+		if(--_running == 0)
+			pthread_cond_signal(&_done);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+void runtime::process(const int& id){
+	scratch_arena& scratch = *_arenas[id];
+
+	// Static schedule: one contiguous range of pieces per thread
+	const long pieces = (_n + _grain - 1) / _grain;
+	const int fixed_begin = (int) std::min((long) _n, pieces * id / _nthreads * _grain);
+	const int fixed_end = (int) std::min((long) _n, pieces * (id + 1) / _nthreads * _grain);
+	bool fixed_done = false;
+
+	while(true) {
+		int begin, end;
+		if(_fixed) {
+			if(fixed_done || fixed_begin >= fixed_end) break;
+			begin = fixed_begin, end = fixed_end, fixed_done = true;
+		} else {
+			begin = __sync_fetch_and_add(&_next, _grain);
+			if(begin >= _n) break;
+			end = std::min(begin + _grain, _n);
+		}
+		try {
+			(*_task)(begin, end, scratch);
+		} catch(const std::exception& e) {
+			if(__sync_bool_compare_and_swap(&_failed, 0, 1))
+				_error = e.what();
+		} catch(...) {
+			if(__sync_bool_compare_and_swap(&_failed, 0, 1))
+				_error = "Unknown error in worker thread";
+		}
+	}
+}
+
+void runtime::parallel_for(const int& n, task& t, const int& grain){
+	run(n, t, grain, false);
+}
+
+void runtime::parallel_for_static(const int& n, task& t, const int& grain){
+	run(n, t, grain, true);
+}
+
+void runtime::run(const int& n, task& t, const int& grain, const bool& fixed){
+	if(n <= 0) return;
+
+	// Nested call from inside a task: run serially on this thread
+	if(tls_thread_id >= 0) {
+		scratch_arena& scratch = *_arenas[tls_thread_id];
+		scratch_arena::marker m = scratch.mark();
+		t(0, n, scratch);
+		scratch.release(m);
+		return;
+	}
+
+	pthread_mutex_lock(&_submit);
+	tls_thread_id = 0;
+
+	// The caller does the share of thread 0, it is pinned like the workers until the work is done
+	saved_affinity* caller = 0;
+	if(_pin) {
+		caller = new saved_affinity;
+		pin_to_cpu(0);
+	}
+
+	_task = &t;
+	_n = n;
+	_grain = std::max(grain, 1);
+	_next = 0;
+	_failed = 0;
+
+	// Only wake up the workers if there is more than one piece of work,
+	// otherwise thread 0 processes everything
+	const bool wake = (_nthreads > 1) && (n > _grain);
+	_fixed = fixed && wake;
+	if(wake) {
+		pthread_mutex_lock(&_mutex);
+		_running = _nthreads - 1;
+		_generation++;
+		pthread_cond_broadcast(&_wake);
+		pthread_mutex_unlock(&_mutex);
+	}
+
+	process(0);
+
+	if(wake) {
+		pthread_mutex_lock(&_mutex);
+		while(_running > 0)
+			pthread_cond_wait(&_done, &_mutex);
+		pthread_mutex_unlock(&_mutex);
+	}
+
+	_task = 0;
+	tls_thread_id = -1;
+	delete caller;
+	const bool failed = _failed;
+	const std::string error = _error;
+	pthread_mutex_unlock(&_submit);
+
+	if(failed) ERROR(error);
+}
+
+//! Zero the chunks of a newly allocated array, c.f. first_touch
+struct first_touch_task : public runtime::task {
+	char* p;
+	size_t chunk_bytes;
+	void operator()(const int& begin, const int& end, scratch_arena& scratch){
+		std::memset(p + begin * chunk_bytes, 0, (end - begin) * chunk_bytes);
+	}
+};
+
+void first_touch(void* p, const size_t& element_size, const size_t& count, const size_t& per_chunk){
+	first_touch_task t;
+	t.p = (char*) p;
+	t.chunk_bytes = element_size * per_chunk;
+	if(per_chunk == 0) return;
+	// One piece per chunk: the same pieces, in the same order, as integrate_systems
+	runtime::instance().parallel_for_static((int) (count / per_chunk), t);
+}
+
+}
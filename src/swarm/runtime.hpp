@@ -0,0 +1,231 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file runtime.hpp
+ *   \brief Defines \ref swarm::runtime, the process-wide pool of worker
+ *   threads used by CPU integrators, and \ref swarm::scratch_arena.
+ *
+ *   The worker threads are started once and reused for every
+ *   integration, optionally pinned to CPUs. Every worker owns a
+ *   scratch arena for temporary arrays so that integrators do not need
+ *   to allocate memory (or use variable-length arrays on the stack)
+ *   inside the integration loop.
+ *
+ *   Configuration options (passed to swarm::init):
+ *    - cpu_threads: number of threads, including the calling thread.
+ *      Defaults to the OpenMP thread count (OMP_NUM_THREADS) or the
+ *      number of available CPUs.
+ *    - cpu_affinity: 1 to pin the worker threads to CPUs, 0 to let the
+ *      operating system schedule them (default). The thread that submits
+ *      the work is pinned too while it takes part in it.
+ *    - cpu_schedule: "static" (default) gives every thread a fixed,
+ *      contiguous range of ensemble chunks, the same range that the
+ *      thread placed in memory (c.f. NumaAllocator). "dynamic" hands
+ *      out chunks on demand, which balances the load better when
+ *      systems take very different times to integrate.
+ *
+ */
+#pragma once
+
+#include "common.hpp"
+#include "types/config.hpp"
+#include "ensemble_alloc.hpp"
+#include <pthread.h>
+
+namespace swarm {
+
+/*! Stack-like allocator for temporary arrays owned by one thread.
+ *
+ *  Memory is obtained in blocks that are kept for the lifetime of the
+ *  arena, so after the first few integration steps no more allocation
+ *  happens. Blocks are allocated by the thread that uses the arena,
+ *  which places the memory close to that thread on NUMA systems.
+ *
+ *  Usage:
+ *  \code
+ *  scratch_arena::marker m = scratch.mark();
+ *  double (*acc)[3] = scratch.alloc<double[3]>(nbod);
+ *  ...
+ *  scratch.release(m);
+ *  \endcode
+ */
+class scratch_arena {
+	public:
+	//! Position in the arena, c.f. mark() and release()
+	struct marker {
+		size_t block, used;
+	};
+
+	scratch_arena():_current(0),_used(0){}
+	~scratch_arena();
+
+	//! Allocate an array of n objects of type T, valid until release()
+	template<class T>
+	T* alloc(const size_t& n) { return (T*) alloc_bytes(n * sizeof(T)); }
+
+	//! Allocate s bytes aligned to a cache line
+	void* alloc_bytes(size_t s);
+
+	//! Current position, to be passed to release()
+	marker mark() const { marker m = { _current, _used }; return m; }
+
+	//! Free everything that was allocated after m was taken
+	void release(const marker& m) { _current = m.block, _used = m.used; }
+
+	//! Free everything that was allocated from this arena
+	void reset() { _current = 0, _used = 0; }
+
+	private:
+	struct block {
+		char* ptr;
+		size_t size;
+	};
+	std::vector<block> _blocks;
+	size_t _current, _used;
+
+	// Not copyable
+	scratch_arena(const scratch_arena&);
+	scratch_arena& operator=(const scratch_arena&);
+};
+
+/*! Process-wide pool of worker threads for CPU integrators.
+ *
+ *  There is only one instance, obtained by runtime::instance(). The
+ *  pool is started lazily with default settings (no pinning), swarm::init
+ *  reconfigures it from the configuration.
+ *
+ *  Work is submitted as a range [0,n) that is split into pieces of
+ *  grain items. parallel_for hands out the pieces dynamically to the
+ *  workers and the calling thread, parallel_for_static gives thread k
+ *  of T the pieces [k*P/T,(k+1)*P/T) of P pieces, so the same range is
+ *  always processed by the same (pinned) thread. Only one range is processed at a time,
+ *  concurrent callers wait for their turn. A parallel_for issued from
+ *  inside a task runs serially on the calling worker.
+ *
+ */
+class runtime {
+	public:
+	//! Work item for parallel_for
+	struct task {
+		//! Process items [begin,end) using the scratch arena of the current thread
+		virtual void operator()(const int& begin, const int& end, scratch_arena& scratch) = 0;
+		virtual ~task(){}
+	};
+
+	//! The process-wide instance
+	static runtime& instance();
+
+	//! Restart the worker threads according to cpu_threads and cpu_affinity
+	void configure(const config& cfg);
+
+	/*! Start the pool again in a child process created by fork().
+	 *  Only the forking thread exists in the child, so the copied worker
+	 *  threads are abandoned instead of joined. The pool must have existed
+	 *  in the parent, call instance() before forking. If slices > 1 and
+	 *  threads are pinned, the process is restricted to the slice-th of
+	 *  slices equal parts of the CPUs it was allowed to run on.
+	 */
+	void restart_after_fork(const int& nthreads, const int& slice = 0, const int& slices = 1);
+
+	//! Number of threads that process the work, including the caller
+	int thread_count() const { return _nthreads; }
+
+	//! Index of the current thread in the pool, 0 is the submitting thread and -1 is outside of the pool
+	static int current_thread();
+
+	/*! Run t on [0,n) in pieces of grain items and wait for completion.
+	 *  If any piece throws an exception, the remaining pieces are still
+	 *  processed and a swarm::runtime_error is thrown afterwards.
+	 */
+	void parallel_for(const int& n, task& t, const int& grain = 1);
+
+	//! Same as parallel_for with a fixed assignment of pieces to threads
+	void parallel_for_static(const int& n, task& t, const int& grain = 1);
+
+	/*! Call integ.integrate_system(ens[i], scratch) for every system of the ensemble.
+	 *  Systems are handed out by whole ensemble chunks so that no two threads
+	 *  write to the same chunk. The schedule is chosen by cpu_schedule.
+	 */
+	template<class Integrator>
+	void integrate_systems(Integrator& integ, defaultEnsemble& ens) {
+		system_task<Integrator> t(integ, ens);
+		const int grain = defaultEnsemble::CHUNK_SIZE;
+		if(_static_schedule)
+			parallel_for_static(ens.nsys(), t, grain);
+		else
+			parallel_for(ens.nsys(), t, grain);
+	}
+
+	~runtime();
+
+	/*! Task that calls integ.integrate_system(ens[i], scratch) for the systems
+	 *  in its range. Used by integrate_systems, and to run the systems of
+	 *  several integrators in one parallel_for (c.f. integrator::create_system_task).
+	 */
+	template<class Integrator>
+	struct system_task : public task {
+		Integrator& integ;
+		defaultEnsemble& ens;
+		system_task(Integrator& integ, defaultEnsemble& ens):integ(integ),ens(ens){}
+		void operator()(const int& begin, const int& end, scratch_arena& scratch){
+			for(int i = begin; i < end; i++) {
+				scratch_arena::marker m = scratch.mark();
+				integ.integrate_system(ens[i], scratch);
+				scratch.release(m);
+			}
+		}
+	};
+
+	private:
+	runtime();
+	void start(const int& nthreads, const bool& pin);
+	void stop();
+	void run(const int& n, task& t, const int& grain, const bool& fixed);
+	void process(const int& id);
+	static void* worker_main(void* arg);
+	void worker_loop(const int& id);
+
+	int _nthreads;
+	bool _pin;
+	bool _static_schedule;
+	std::vector<pthread_t> _threads;
+	std::vector<scratch_arena*> _arenas;
+
+	//! Serializes parallel_for and configure calls
+	pthread_mutex_t _submit;
+	//! Protects the fields below
+	pthread_mutex_t _mutex;
+	pthread_cond_t _wake, _done;
+	unsigned long _generation;
+	int _running;
+	bool _stopping;
+
+	// Current job
+	task* _task;
+	int _n, _grain;
+	bool _fixed;
+	volatile int _next;
+	volatile int _failed;
+	std::string _error;
+
+	// Not copyable
+	runtime(const runtime&);
+	runtime& operator=(const runtime&);
+};
+
+}
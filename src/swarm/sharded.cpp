@@ -0,0 +1,246 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file sharded.cpp
+ *   \brief Implements \ref swarm::sharded_integration.
+ *
+ */
+
+#include "common.hpp"
+#include "sharded.hpp"
+#include "snapshot.hpp"
+#include "utils.hpp"
+#include <deque>
+#include <pthread.h>
+
+namespace swarm {
+
+//! A part of the ensemble on its way through the pipeline
+struct shard {
+	int index, first, count;
+	defaultEnsemble ens;
+	//! Copy of the initial conditions for the energy conservation check
+	defaultEnsemble initial;
+};
+typedef shared_ptr<shard> Pshard;
+
+/*! State shared by the stages of the pipeline.
+ *
+ *  The loader thread fills loaded, the calling thread integrates the
+ *  shards and moves them to integrated, the saver thread writes them
+ *  out. in_memory counts the shards between loading and saving.
+ */
+struct shard_pipeline {
+	std::string input, output;
+	int nsys, shard_size, max_in_memory;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;
+	std::deque<Pshard> loaded, integrated;
+	int in_memory;
+	bool loading_done, integrating_done, failed;
+	std::string error;
+	double max_deltaE;
+
+	shard_pipeline():in_memory(0),loading_done(false),integrating_done(false),failed(false),max_deltaE(0){
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&changed, NULL);
+	}
+	~shard_pipeline(){
+		pthread_cond_destroy(&changed);
+		pthread_mutex_destroy(&mutex);
+	}
+
+	int shard_count() const { return (nsys + shard_size - 1) / shard_size; }
+
+	//! Stop all stages because of an error, must be called with the mutex held
+	void fail(const std::string& message){
+		if(!failed) error = message;
+		failed = true;
+		pthread_cond_broadcast(&changed);
+	}
+
+	void load(){
+		for(int k = 0; k < shard_count(); k++) {
+			pthread_mutex_lock(&mutex);
+			while(in_memory >= max_in_memory && !failed)
+				pthread_cond_wait(&changed, &mutex);
+			if(failed) { pthread_mutex_unlock(&mutex); break; }
+			in_memory++;
+			pthread_mutex_unlock(&mutex);
+
+			Pshard s(new shard);
+			s->index = k;
+			s->first = k * shard_size;
+			s->count = std::min(shard_size, nsys - s->first);
+			std::string message;
+			try {
+				s->ens = snapshot::load_range(input, s->first, s->count);
+				s->initial = s->ens.clone();
+			} catch(const std::exception& e) {
+				message = e.what();
+			}
+
+			pthread_mutex_lock(&mutex);
+			if(!message.empty()) fail(message); else loaded.push_back(s);
+			pthread_cond_broadcast(&changed);
+			pthread_mutex_unlock(&mutex);
+		}
+		pthread_mutex_lock(&mutex);
+		loading_done = true;
+		pthread_cond_broadcast(&changed);
+		pthread_mutex_unlock(&mutex);
+	}
+
+	//! Next shard to integrate, null if there are no more
+	Pshard next_loaded(){
+		pthread_mutex_lock(&mutex);
+		while(loaded.empty() && !loading_done && !failed)
+			pthread_cond_wait(&changed, &mutex);
+		Pshard s;
+		if(!failed && !loaded.empty()) {
+			s = loaded.front();
+			loaded.pop_front();
+		}
+		pthread_mutex_unlock(&mutex);
+		return s;
+	}
+
+	void finished_integration(const Pshard& s){
+		pthread_mutex_lock(&mutex);
+		if(s) integrated.push_back(s); else integrating_done = true;
+		pthread_cond_broadcast(&changed);
+		pthread_mutex_unlock(&mutex);
+	}
+
+	void save(){
+		pthread_mutex_lock(&mutex);
+		while(true) {
+			while(integrated.empty() && !integrating_done && !failed)
+				pthread_cond_wait(&changed, &mutex);
+			if(failed || integrated.empty()) break;
+			Pshard s = integrated.front();
+			integrated.pop_front();
+			pthread_mutex_unlock(&mutex);
+
+			std::string message;
+			double deltaE = 0;
+			try {
+				snapshot::save_range(s->ens, output, s->first);
+				deltaE = find_max_energy_conservation_error(s->ens, s->initial);
+			} catch(const std::exception& e) {
+				message = e.what();
+			}
+			s.reset();
+
+			pthread_mutex_lock(&mutex);
+			if(!message.empty()) { fail(message); break; }
+			max_deltaE = std::max(max_deltaE, deltaE);
+			in_memory--;
+			pthread_cond_broadcast(&changed);
+		}
+		pthread_mutex_unlock(&mutex);
+	}
+
+	static void* loader_main(void* p){ ((shard_pipeline*) p)->load(); return 0; }
+	static void* saver_main(void* p){ ((shard_pipeline*) p)->save(); return 0; }
+};
+
+sharded_integration::sharded_integration(const config& cfg):_cfg(cfg){
+	const int chunk_size = defaultEnsemble::CHUNK_SIZE;
+	const int size = cfg.require("shard_size", 0);
+	if(size < 1) ERROR("shard_size should be at least 1");
+	_shard_size = (size + chunk_size - 1) / chunk_size * chunk_size;
+	_inflight = cfg.optional("shard_inflight", 3);
+	if(_inflight < 1) ERROR("shard_inflight should be at least 1");
+	_destination_time = cfg.require("destination_time", 0.0);
+
+	const std::string format = cfg.optional("binary_format", std::string("flat"));
+	if(format != "flat" && format != "chunked")
+		ERROR("binary_format should be either flat or chunked");
+	_chunked_output = (format == "chunked");
+}
+
+//! Name of the log file of a shard
+std::string shard_log_name(const std::string& name, const int& index){
+	std::ostringstream o;
+	o << name << ".shard" << index;
+	return o.str();
+}
+
+sharded_integration::result sharded_integration::run(const std::string& input, const std::string& output){
+	const snapshot::header h = snapshot::read_header(input);
+	snapshot::create_binary(output, h.nsys, h.nbod, _chunked_output);
+
+	Pintegrator integ = integrator::create(_cfg);
+	integ->set_checkpoint(Pcheckpoint());
+	integ->set_destination_time(_destination_time);
+	const bool logging = _cfg.optional("log_writer", std::string("null")) != "null";
+
+	shard_pipeline p;
+	p.input = input, p.output = output;
+	p.nsys = h.nsys, p.shard_size = _shard_size, p.max_in_memory = _inflight;
+
+	pthread_t loader, saver;
+	if(pthread_create(&loader, NULL, &shard_pipeline::loader_main, &p) != 0)
+		ERROR("Cannot start the shard loader thread");
+	if(pthread_create(&saver, NULL, &shard_pipeline::saver_main, &p) != 0) {
+		pthread_mutex_lock(&p.mutex);
+		p.fail("Cannot start the shard saver thread");
+		pthread_mutex_unlock(&p.mutex);
+		pthread_join(loader, NULL);
+		ERROR(p.error);
+	}
+
+	while(Pshard s = p.next_loaded()) {
+		try {
+			if(logging) {
+				config log_cfg = _cfg;
+				if(log_cfg.valid("log_output")) log_cfg["log_output"] = shard_log_name(log_cfg["log_output"], s->index);
+				if(log_cfg.valid("log_output_db")) log_cfg["log_output_db"] = shard_log_name(log_cfg["log_output_db"], s->index);
+				log::Pmanager m(new log::manager());
+				m->init(log_cfg);
+				integ->set_log_manager(m);
+			}
+			integ->set_ensemble(s->ens);
+			integ->integrate();
+		} catch(const std::exception& e) {
+			pthread_mutex_lock(&p.mutex);
+			p.fail(e.what());
+			pthread_mutex_unlock(&p.mutex);
+			break;
+		}
+		p.finished_integration(s);
+	}
+	p.finished_integration(Pshard());
+
+	pthread_join(loader, NULL);
+	pthread_join(saver, NULL);
+	if(logging)
+		integ->set_log_manager(log::manager::default_log());
+	if(p.failed)
+		ERROR(p.error);
+
+	result r;
+	r.shards = p.shard_count();
+	r.systems = h.nsys;
+	r.max_deltaE = p.max_deltaE;
+	return r;
+}
+
+}
@@ -0,0 +1,79 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file sharded.hpp
+ *   \brief Defines \ref swarm::sharded_integration, integration of
+ *   ensembles that do not fit in memory.
+ *
+ *   Configuration options:
+ *    - shard_size: number of systems per shard, rounded up to a
+ *      multiple of the ensemble CHUNK_SIZE.
+ *    - shard_inflight: maximum number of shards in memory (default 3,
+ *      at least 1). With 3 shards, one is loaded, one is integrated and
+ *      one is saved at the same time.
+ *    - destination_time: time to integrate the systems to.
+ *    - binary_format: format of the output file, flat (default) or chunked.
+ *
+ */
+#pragma once
+
+#include "common.hpp"
+#include "types/config.hpp"
+#include "integrator.hpp"
+
+namespace swarm {
+
+/*! Integrate an ensemble stored in a binary file in shards.
+ *
+ *  The input file (flat or chunked binary, c.f. \ref snapshot) is read
+ *  shard_size systems at a time. The shards go through a pipeline:
+ *  a loader thread reads the next shards while the current shard is
+ *  integrated and a saver thread writes the finished shards to their
+ *  place in the output file. At most shard_inflight shards are in
+ *  memory, so the size of the ensemble is only limited by the disk.
+ *
+ *  If a log writer is configured, every shard is logged to its own
+ *  file: log_output (or log_output_db) with the suffix .shard<N>,
+ *  where N is the number of the shard starting from 0.
+ *
+ *  Checkpointing is not used in this mode, the output file holds all
+ *  shards that were saved.
+ */
+class sharded_integration {
+	public:
+	//! Summary of a run
+	struct result {
+		int shards;
+		int systems;
+		//! Worst relative energy conservation error among all systems
+		double max_deltaE;
+	};
+
+	sharded_integration(const config& cfg);
+
+	//! Integrate the systems of the input file and write them to the output file
+	result run(const std::string& input, const std::string& output);
+
+	private:
+	config _cfg;
+	int _shard_size, _inflight;
+	double _destination_time;
+	bool _chunked_output;
+};
+
+}
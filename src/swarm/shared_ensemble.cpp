@@ -0,0 +1,156 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file shared_ensemble.cpp
+ *   \brief Implements \ref swarm::shared_ensemble.
+ *
+ */
+
+#include "common.hpp"
+#include "shared_ensemble.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace swarm {
+
+const char SHARED_TAG[8] = { 'S','W','A','R','M','S','H','M' };
+const int SHARED_VERSION = 1;
+//! Alignment of the arrays in the segment
+const int64_t SHARED_ALIGNMENT = 4096;
+
+int64_t shared_align(const int64_t& x){
+	return (x + SHARED_ALIGNMENT - 1) / SHARED_ALIGNMENT * SHARED_ALIGNMENT;
+}
+
+//! Unmaps the segment when the last reference is gone
+struct segment_unmapper {
+	size_t length;
+	void operator()(char* p){ munmap(p, length); }
+};
+
+//! Deleter for arrays inside the segment, keeps the mapping alive
+struct segment_owner {
+	shared_ptr<char> base;
+	void operator()(void*){}
+};
+
+//! Map length bytes of the shared memory object fd
+shared_ptr<char> map_segment(const int& fd, const size_t& length, const std::string& name){
+	void* p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED)
+		ERROR("Cannot map shared memory segment " + name);
+	segment_unmapper d;
+	d.length = length;
+	return shared_ptr<char>((char*) p, d);
+}
+
+shared_ensemble shared_ensemble::create(const std::string& name, const int& nbod, const int& nsys, const int& nworkers){
+	header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.tag, SHARED_TAG, sizeof(h.tag));
+	h.version = SHARED_VERSION;
+	h.chunk_size = defaultEnsemble::CHUNK_SIZE;
+	h.nsys = nsys, h.nbod = nbod;
+	h.nsysattr = defaultEnsemble::NUM_SYS_ATTRIBUTES;
+	h.nbodattr = defaultEnsemble::NUM_BODY_ATTRIBUTES;
+	h.nworkers = nworkers;
+	h.body_offset = shared_align(sizeof(header));
+	h.sys_offset = shared_align(h.body_offset + (int64_t) defaultEnsemble::body_element_count(nbod, nsys) * sizeof(defaultEnsemble::Body));
+	h.status_offset = shared_align(h.sys_offset + (int64_t) defaultEnsemble::sys_element_count(nsys) * sizeof(defaultEnsemble::Sys));
+	h.length = h.status_offset + (int64_t) nworkers * sizeof(worker_status);
+
+	const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd == -1)
+		ERROR("Cannot create shared memory segment " + name);
+	if(ftruncate(fd, h.length) != 0) {
+		close(fd);
+		shm_unlink(name.c_str());
+		ERROR("Cannot allocate shared memory segment " + name);
+	}
+
+	shared_ensemble s(name, map_segment(fd, h.length, name));
+	// Only the header and the status records are written here, the arrays
+	// are placed in memory by the first process that touches them
+	memcpy(s._base.get(), &h, sizeof(h));
+	for(int k = 0; k < nworkers; k++) {
+		worker_status& w = s.status(k);
+		w.state = PENDING;
+		s.worker_chunks(k, w.first_chunk, w.chunks);
+	}
+	return s;
+}
+
+shared_ensemble shared_ensemble::attach(const std::string& name){
+	const int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if(fd == -1)
+		ERROR("Cannot open shared memory segment " + name);
+
+	header h;
+	if(pread(fd, &h, sizeof(h), 0) != (ssize_t) sizeof(h) || memcmp(h.tag, SHARED_TAG, sizeof(h.tag)) != 0
+			|| h.version != SHARED_VERSION) {
+		close(fd);
+		ERROR("Shared memory segment " + name + " does not hold an ensemble");
+	}
+	if(h.chunk_size != defaultEnsemble::CHUNK_SIZE || h.nsysattr != defaultEnsemble::NUM_SYS_ATTRIBUTES
+			|| h.nbodattr != defaultEnsemble::NUM_BODY_ATTRIBUTES) {
+		close(fd);
+		ERROR("Shared memory segment " + name + " was created with a different ensemble layout");
+	}
+	return shared_ensemble(name, map_segment(fd, h.length, name));
+}
+
+void shared_ensemble::unlink(){
+	shm_unlink(_name.c_str());
+}
+
+defaultEnsemble shared_ensemble::ensemble() const {
+	return chunk_range(0, chunk_count());
+}
+
+defaultEnsemble shared_ensemble::chunk_range(const int& first_chunk, const int& chunks) const {
+	const header& h = info();
+	const int first = first_chunk * h.chunk_size;
+	const int nsys = std::min(chunks * h.chunk_size, h.nsys - first);
+	if(first_chunk < 0 || chunks < 0 || nsys < 0)
+		ERROR("Chunk range is outside of the shared ensemble");
+
+	// Chunks are stored one after the other, a range of chunks is an ensemble by itself
+	segment_owner owner;
+	owner.base = _base;
+	defaultEnsemble::Body* bodies = (defaultEnsemble::Body*) (_base.get() + h.body_offset) + (size_t) first_chunk * h.nbod;
+	defaultEnsemble::Sys* systems = (defaultEnsemble::Sys*) (_base.get() + h.sys_offset) + first_chunk;
+	return defaultEnsemble::attach(h.nbod, nsys, defaultEnsemble::PBody(bodies, owner), defaultEnsemble::PSys(systems, owner));
+}
+
+void shared_ensemble::worker_chunks(const int& k, int& first_chunk, int& chunks) const {
+	const int c = chunk_count(), n = info().nworkers;
+	first_chunk = (int) ((int64_t) k * c / n);
+	chunks = (int) ((int64_t) (k + 1) * c / n) - first_chunk;
+}
+
+shared_ensemble::worker_status& shared_ensemble::status(const int& k) const {
+	if(k < 0 || k >= info().nworkers)
+		ERROR("Invalid worker number");
+	return ((worker_status*) (_base.get() + info().status_offset))[k];
+}
+
+}
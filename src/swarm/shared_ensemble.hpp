@@ -0,0 +1,102 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file shared_ensemble.hpp
+ *   \brief Defines \ref swarm::shared_ensemble, an ensemble in a POSIX
+ *   shared memory segment that several processes work on.
+ *
+ */
+#pragma once
+
+#include "common.hpp"
+#include "ensemble_alloc.hpp"
+
+namespace swarm {
+
+/*! Ensemble in a named POSIX shared memory segment.
+ *
+ *  The segment starts with a header, followed by the body and system
+ *  arrays laid out exactly like the arrays of a defaultEnsemble, and a
+ *  status record for every worker process. Every array starts at a page
+ *  boundary. Any process that knows the name of the segment can attach
+ *  to it and obtain a defaultEnsemble for the whole ensemble or for a
+ *  range of ensemble chunks without copying. The segment stays mapped
+ *  as long as an ensemble that refers to it exists.
+ *
+ *  The chunk range of worker k of n is
+ *  [k*C/n, (k+1)*C/n) where C is the number of chunks, so the workers
+ *  never write to the same chunk.
+ */
+class shared_ensemble {
+	public:
+	//! Layout of the segment, stored at its beginning
+	struct header {
+		char tag[8];
+		int version, chunk_size, nsys, nbod, nsysattr, nbodattr, nworkers;
+		int64_t body_offset, sys_offset, status_offset, length;
+	};
+
+	//! State of a worker process
+	enum worker_state { PENDING, RUNNING, DONE, FAILED };
+
+	//! Status record of a worker, written by the worker and read by the parent
+	struct worker_status {
+		int state;
+		//! Chunks assigned to the worker
+		int first_chunk, chunks;
+		//! Wall-clock time of the integration
+		double seconds;
+		char error[512];
+	};
+
+	shared_ensemble(){}
+
+	//! Create a new segment for nsys systems of nbod bodies processed by nworkers workers
+	static shared_ensemble create(const std::string& name, const int& nbod, const int& nsys, const int& nworkers);
+
+	//! Map an existing segment
+	static shared_ensemble attach(const std::string& name);
+
+	//! Remove the name of the segment, the memory is freed when all processes unmap it
+	void unlink();
+
+	const std::string& name() const { return _name; }
+	const header& info() const { return *(header*) _base.get(); }
+	int chunk_count() const { return (info().nsys + info().chunk_size - 1) / info().chunk_size; }
+
+	//! The whole ensemble
+	defaultEnsemble ensemble() const;
+
+	//! Systems in the chunks [first_chunk, first_chunk+chunks)
+	defaultEnsemble chunk_range(const int& first_chunk, const int& chunks) const;
+
+	//! Chunks assigned to worker k, c.f. the class description
+	void worker_chunks(const int& k, int& first_chunk, int& chunks) const;
+
+	//! Status record of worker k
+	worker_status& status(const int& k) const;
+
+	private:
+	shared_ensemble(const std::string& name, const shared_ptr<char>& base):_name(name),_base(base){}
+
+	std::string _name;
+	//! Beginning of the mapping, unmapped with the last reference
+	shared_ptr<char> _base;
+};
+
+}
@@ -23,6 +23,11 @@
 */
 
 #include "snapshot.hpp"
+#include "runtime.hpp"
+
+#include <unistd.h>
+#include <cstdarg>
+#include <queue>
 
 namespace swarm {
 
@@ -42,6 +47,9 @@ void writetoFILE(FILE*f,const T& t,const string& filename = ""){
 }
 
 defaultEnsemble load(const string& filename) throw (readfileexception){
+	if(is_chunked(filename))
+		return load_chunked(filename);
+
 	FILE* f = fopen(filename.c_str(),"rb");
 
 	header h; sys s; body b;
@@ -88,22 +96,198 @@ defaultEnsemble load(const string& filename) throw (readfileexception){
 const char* DEFAULT_IO_TAG = "SwarmDataFile";
 const int CURRENT_IO_VERSION = 2;
 
-defaultEnsemble load_text(const string& filename) throw (readfileexception){
-	FILE* f = fopen(filename.c_str(),"r");
+//! Whitespace characters, the same as skipped by fscanf
+inline bool is_space(const char& c){
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
 
-	header h; sys s; body b;
+//! Find the next whitespace separated token in [p,end), returns false at the end of the text
+inline bool next_token(const char*& p, const char* end, const char*& begin, const char*& finish){
+	while(p < end && is_space(*p)) p++;
+	if(p == end) return false;
+	begin = p;
+	while(p < end && !is_space(*p)) p++;
+	finish = p;
+	return true;
+}
+
+//! Parse a token that is not handled by parse_double's fast path with strtod/strtol
+template<class T, class Parse>
+bool parse_slow(const char* begin, const char* end, T& v, Parse parse){
+	char buffer[128];
+	const size_t n = end - begin;
+	if(n >= sizeof(buffer)) return false;
+	memcpy(buffer, begin, n);
+	buffer[n] = 0;
+	char* e;
+	v = parse(buffer, &e);
+	return e == buffer + n;
+}
+
+double strtod_adapter(const char* s, char** e){ return strtod(s, e); }
+int strtol_adapter(const char* s, char** e){ return (int) strtol(s, e, 0); }
+
+/*! Parse a floating point number occupying the whole token.
+ *
+ *  Decimal numbers with a mantissa below 2^53 and a decimal exponent of at
+ *  most 22 are computed with one multiplication or division of exact
+ *  values, which is correctly rounded and gives the same result as strtod.
+ *  This covers the numbers written by save_text. Everything else
+ *  (long mantissas, large exponents, inf, nan, hexadecimal) is passed to strtod.
+ */
+bool parse_double(const char* begin, const char* end, double& v){
+	static const double exact_powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10
+		, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const uint64_t max_exact_mantissa = uint64_t(1) << 53;
+
+	const char* s = begin;
+	bool negative = false;
+	if(s < end && (*s == '-' || *s == '+')) negative = (*s++ == '-');
+
+	uint64_t m = 0;
+	int digits = 0, exponent = 0;
+	bool any = false;
+	for(; s < end && *s >= '0' && *s <= '9'; s++, any = true)
+		if(digits < 19) { m = m * 10 + (*s - '0'); if(m) digits++; } else exponent++;
+	if(s < end && *s == '.')
+		for(s++; s < end && *s >= '0' && *s <= '9'; s++, any = true)
+			if(digits < 19) { m = m * 10 + (*s - '0'); if(m) digits++; exponent--; }
+
+	if(any && s < end && (*s == 'e' || *s == 'E')) {
+		s++;
+		bool negative_exponent = false;
+		if(s < end && (*s == '-' || *s == '+')) negative_exponent = (*s++ == '-');
+		int e = 0;
+		bool any_exponent = false;
+		for(; s < end && *s >= '0' && *s <= '9'; s++, any_exponent = true)
+			if(e < 10000) e = e * 10 + (*s - '0');
+		if(!any_exponent) any = false;
+		exponent += negative_exponent ? -e : e;
+	}
 
-	char tag[1024];
+	if(!any || s != end || digits >= 19 || m > max_exact_mantissa || exponent < -22 || exponent > 22)
+		return parse_slow(begin, end, v, strtod_adapter);
+
+	v = (exponent < 0) ? double(m) / exact_powers_of_ten[-exponent] : double(m) * exact_powers_of_ten[exponent];
+	if(negative) v = -v;
+	return true;
+}
+
+//! Smallest size of a piece of text that is parsed by one thread
+const size_t text_piece_size = 256 * 1024;
+
+/*! Parse the systems of a text file in parallel.
+ *
+ *  The text is split into pieces at arbitrary positions, a token belongs
+ *  to the piece where it starts. The first pass counts the tokens in every
+ *  piece, which gives the index of the first token of each piece. Since
+ *  every system has the same number of tokens, the index determines the
+ *  system and the quantity, so the second pass can parse the pieces
+ *  independently.
+ */
+struct parse_text_task : public runtime::task {
+	const char* text;
+	const char* text_end;
+	size_t piece_size;
+	int nbod, nsysattr, nbodattr;
+	defaultEnsemble& ens;
+	//! true for the first pass, false for the second
+	bool counting;
+	std::vector<int64_t> first_token;
+	//! First token that could not be parsed, -1 if none
+	int64_t error;
+
+	parse_text_task(const char* text, const char* text_end, const header& h, defaultEnsemble& ens)
+		:text(text),text_end(text_end),nbod(h.nbod),nsysattr(h.nsysattr),nbodattr(h.nbodattr),ens(ens),counting(true),error(-1) {
+		const int threads = runtime::instance().thread_count();
+		const size_t length = text_end - text;
+		piece_size = std::max(text_piece_size, length / (4 * threads) + 1);
+		first_token.resize(length / piece_size + 2, 0);
+	}
+
+	int piece_count() const { return (int) first_token.size() - 1; }
+
+	void operator()(const int& begin, const int& end, scratch_arena& scratch){
+		for(int i = begin; i < end; i++)
+			process(i);
+	}
+
+	void process(const int& i){
+		const char* p = std::min(text + i * piece_size, text_end);
+		const char* piece_end = std::min(p + piece_size, text_end);
+		// Skip the rest of a token that started in the previous piece
+		if(p > text && !is_space(p[-1]))
+			while(p < piece_end && !is_space(*p)) p++;
+
+		int64_t index = counting ? 0 : first_token[i];
+		const char* b, * e;
+		while(next_token(p, text_end, b, e) && b < piece_end) {
+			if(counting) 
+				index++;
+			else if(!store(index++, b, e))
+				record_error(index - 1);
+			// Next token might start in the next piece
+			if(p >= piece_end) break;
+		}
+		if(counting) first_token[i+1] = index;
+	}
+
+	void record_error(const int64_t& index){
+		int64_t current = error;
+		while((current == -1 || index < current) && !__sync_bool_compare_and_swap(&error, current, index))
+			current = error;
+	}
+
+	//! Parse the token and store it in the ensemble
+	bool store(const int64_t& index, const char* b, const char* e){
+		const int per_body = 7 + nbodattr;
+		const int64_t per_system = 3 + nsysattr + (int64_t) nbod * per_body;
+		const int64_t sys = index / per_system;
+		if(sys >= ens.nsys()) return true;
+
+		ensemble::SystemRef sr = ens[(int) sys];
+		const int r = (int) (index % per_system);
+		switch(r) {
+			case 0: return parse_slow(b, e, sr.id(), strtol_adapter);
+			case 1: return parse_double(b, e, sr.time());
+			case 2: return parse_slow(b, e, sr.state(), strtol_adapter);
+		}
+		if(r < 3 + nsysattr)
+			return parse_double(b, e, sr.attribute(r - 3));
+
+		const int j = (r - 3 - nsysattr) / per_body, f = (r - 3 - nsysattr) % per_body;
+		if(f == 0) return parse_double(b, e, sr[j].mass());
+		if(f < 4)  return parse_double(b, e, sr[j][f - 1].pos());
+		if(f < 7)  return parse_double(b, e, sr[j][f - 4].vel());
+		return parse_double(b, e, sr[j].attribute(f - 7));
+	}
+};
+
+defaultEnsemble load_text(const string& filename) throw (readfileexception){
+	using peyton::system::MemoryMap;
+	boost::shared_ptr<MemoryMap> m;
+	try {
+		m.reset(new MemoryMap(filename));
+	} catch(const peyton::system::MemoryMapError& e) {
+		throw readfileexception(filename, e.what());
+	}
+	const char* p = (const char*) (void*) *m, * text_end = p + m->size();
+
+	header h;
 	int version = 0;
+	const char* b, * e;
 
-	fscanf(f, "%s %i\n" , tag, &version);
-	if(strcmp( DEFAULT_IO_TAG, tag ) != 0)
+	if(!next_token(p, text_end, b, e) || string(b, e) != DEFAULT_IO_TAG)
 		throw readfileexception(filename,"Invalid file, header doesn't match");
 
-	if(version != CURRENT_IO_VERSION )
+	if(!next_token(p, text_end, b, e) || !parse_slow(b, e, version, strtol_adapter) || version != CURRENT_IO_VERSION )
 		throw readfileexception(filename, "Incorrect version");
 
-	fscanf(f,"%i %i %i %i\n\n\n",&h.nbod,&h.nsys,&h.nsysattr, &h.nbodattr);
+	int* fields[] = { &h.nbod, &h.nsys, &h.nsysattr, &h.nbodattr };
+	for(int i = 0; i < 4; i++)
+		if(!next_token(p, text_end, b, e) || !parse_slow(b, e, *fields[i], strtol_adapter))
+			throw readfileexception(filename, "Invalid file, header doesn't match");
+
 	if(h.nsysattr > ensemble::NUM_SYS_ATTRIBUTES)
 		throw readfileexception(filename, "The file requires more system attributes than the library can handle");
 	if(h.nbodattr > ensemble::NUM_BODY_ATTRIBUTES)
@@ -111,30 +295,27 @@ defaultEnsemble load_text(const string& filename) throw (readfileexception){
 
 	hostEnsemble ens = hostEnsemble::create(h.nbod,h.nsys);
 
+	parse_text_task t(p, text_end, h, ens);
+	try {
+		runtime::instance().parallel_for(t.piece_count(), t);
+		for(int i = 0; i < t.piece_count(); i++)
+			t.first_token[i+1] += t.first_token[i];
 
-	for(int i = 0; i < h.nsys; i++){
-		ensemble::SystemRef sr = ens[i];
-
-		fscanf(f,"%i %le %i\n", &sr.id(), &sr.time(), &sr.state());
+		const int64_t expected = h.nsys * (3 + h.nsysattr + (int64_t) h.nbod * (7 + h.nbodattr));
+		if(t.first_token.back() < expected)
+			throw readfileexception(filename, "Unexpected end of file");
 
-		for(int l = 0; l < h.nsysattr; l++)
-			fscanf(f, "%le ", &sr.attribute(l));
-
-		for(int j = 0; j < h.nbod; j++){
-			fscanf(f,"\t%le\n\t%le %le %le\n\t%le %le %le\n\n",
-					&sr[j].mass(),
-					&sr[j][0].pos(),
-					&sr[j][1].pos(),
-					&sr[j][2].pos(),
-					&sr[j][0].vel(),
-					&sr[j][1].vel(),
-					&sr[j][2].vel()
-				   );
-			for(int l = 0; l < h.nbodattr; l++)
-				fscanf(f, "%le", &sr[j].attribute(l));
-		}
+		t.counting = false;
+		runtime::instance().parallel_for(t.piece_count(), t);
+	} catch(const runtime_error& e) {
+		throw readfileexception(filename, e.what());
 	}
-	fclose(f);
+	if(t.error >= 0) {
+		std::ostringstream msg;
+		msg << "Invalid number for system " << t.error / (3 + h.nsysattr + (int64_t) h.nbod * (7 + h.nbodattr));
+		throw readfileexception(filename, msg.str());
+	}
+
 	return ens;
 }
 
@@ -178,24 +359,49 @@ void save(defaultEnsemble& ens, const string& filename)  throw (writefileexcepti
 	fclose(f);
 }
 
-void save_text(defaultEnsemble& ens, const string& filename)  throw (writefileexception){
-	FILE* f = fopen(filename.c_str(),"w");
-
-
-	fprintf(f, "%s %i\n" , DEFAULT_IO_TAG, CURRENT_IO_VERSION );
-	fprintf(f,"%i %i %i %i\n\n\n", ens.nbod(), ens.nsys(), ensemble::NUM_SYS_ATTRIBUTES, ensemble::NUM_BODY_ATTRIBUTES );
+//! Number of systems formatted by one task in save_text
+const int text_systems_per_piece = 64;
+
+//! Format systems in the text format into one buffer per piece
+struct format_text_task : public runtime::task {
+	defaultEnsemble& ens;
+	int first_system;
+	std::vector<string>& buffers;
+
+	format_text_task(defaultEnsemble& ens, std::vector<string>& buffers)
+		:ens(ens),first_system(0),buffers(buffers){}
+
+	void operator()(const int& begin, const int& end, scratch_arena& scratch){
+		for(int p = begin; p < end; p++) {
+			string& out = buffers[p];
+			out.clear();
+			const int from = first_system + p * text_systems_per_piece;
+			const int to = std::min(from + text_systems_per_piece, ens.nsys());
+			for(int i = from; i < to; i++)
+				format_system(i, out);
+		}
+	}
 
-	for(int i = 0; i < ens.nsys(); i++){
+	//! snprintf into the buffer
+	static void append(string& out, const char* format, ...){
+		char line[512];
+		va_list args;
+		va_start(args, format);
+		const int n = vsnprintf(line, sizeof(line), format, args);
+		va_end(args);
+		out.append(line, std::min(n, (int) sizeof(line) - 1));
+	}
 
+	void format_system(const int& i, string& out){
 		ensemble::SystemRef sr = ens[i];
-		fprintf(f,"%i %.15le %i\n", sr.id(), sr.time(), sr.state()); 
+		append(out,"%i %.15le %i\n", sr.id(), sr.time(), sr.state()); 
 
 		for(int l = 0; l < ensemble::NUM_SYS_ATTRIBUTES; l++)
-			fprintf(f,"%.15le ", sr.attribute(l));
-		fprintf(f, "\n");
+			append(out,"%.15le ", sr.attribute(l));
+		out += "\n";
 
 		for(int j = 0; j < ens.nbod(); j++){
-			fprintf(f,"\t%.15le\n\t%.15le %.15le %.15le\n\t%.15le %.15le %.15le\n\t",
+			append(out,"\t%.15le\n\t%.15le %.15le %.15le\n\t%.15le %.15le %.15le\n\t",
 					sr[j].mass(),
 					sr[j][0].pos(),
 					sr[j][1].pos(),
@@ -205,16 +411,607 @@ void save_text(defaultEnsemble& ens, const string& filename)  throw (writefileex
 					sr[j][2].vel()
 				   );
 			for(int l = 0; l < ensemble::NUM_BODY_ATTRIBUTES; l++)
-				fprintf(f,"%.15le ", sr[j].attribute(l));
-			fprintf(f, "\n\n");
+				append(out,"%.15le ", sr[j].attribute(l));
+			out += "\n\n";
+		}
+
+		out += "\n";
+	}
+};
+
+void save_text(defaultEnsemble& ens, const string& filename)  throw (writefileexception){
+	FILE* f = fopen(filename.c_str(),"w");
+	if(f == NULL)
+		throw writefileexception(filename, "Cannot open the file");
+
+	fprintf(f, "%s %i\n" , DEFAULT_IO_TAG, CURRENT_IO_VERSION );
+	fprintf(f,"%i %i %i %i\n\n\n", ens.nbod(), ens.nsys(), ensemble::NUM_SYS_ATTRIBUTES, ensemble::NUM_BODY_ATTRIBUTES );
+
+	// Systems are formatted in batches of a few pieces per thread
+	// and written in order
+	const int pieces = 4 * runtime::instance().thread_count();
+	std::vector<string> buffers(pieces);
+	format_text_task t(ens, buffers);
+	bool ok = true;
+	try {
+		for(; t.first_system < ens.nsys() && ok; t.first_system += pieces * text_systems_per_piece){
+			const int remaining = ens.nsys() - t.first_system;
+			const int n = std::min(pieces, (remaining + text_systems_per_piece - 1) / text_systems_per_piece);
+			runtime::instance().parallel_for(n, t);
+			for(int p = 0; p < n && ok; p++)
+				ok = fwrite(buffers[p].data(), 1, buffers[p].size(), f) == buffers[p].size();
+		}
+	} catch(const runtime_error& e) {
+		fclose(f);
+		throw writefileexception(filename, e.what());
+	}
+
+	if(fclose(f) != 0 || !ok)
+		throw writefileexception(filename,"File I/O error");
+}
+
+bool is_chunked(const string& filename){
+	char tag[sizeof(CHUNKED_TAG)];
+	FILE* f = fopen(filename.c_str(),"rb");
+	if(f == NULL) return false;
+	const bool r = fread(tag,1,sizeof(tag),f) == sizeof(tag) 
+		&& memcmp(tag,CHUNKED_TAG,sizeof(tag)) == 0;
+	fclose(f);
+	return r;
+}
+
+//! Round up the offset to the alignment of arrays in a chunked file
+int64_t chunked_align(const int64_t& offset){
+	return (offset + CHUNKED_ALIGNMENT - 1) / CHUNKED_ALIGNMENT * CHUNKED_ALIGNMENT;
+}
+
+//! Read and validate the header of a chunked binary file
+chunked_header read_chunked_header(const string& filename){
+	FILE* f = fopen(filename.c_str(),"rb");
+	if(f == NULL)
+		throw readfileexception(filename, "Cannot open the file");
+
+	chunked_header h;
+	try {
+		readfromFILE(f,h,filename);
+	} catch(...) { fclose(f); throw; }
+
+	struct stat st;
+	const bool stat_ok = fstat(fileno(f), &st) == 0;
+	fclose(f);
+
+	if(memcmp(h.tag,CHUNKED_TAG,sizeof(h.tag)) != 0)
+		throw readfileexception(filename, "Invalid file, header doesn't match");
+	if(h.byte_order != CHUNKED_BYTE_ORDER)
+		throw readfileexception(filename, "The file was written on a machine with a different byte order");
+	if(h.version != CHUNKED_VERSION)
+		throw readfileexception(filename, "Incorrect version");
+
+	if(h.nsysattr > ensemble::NUM_SYS_ATTRIBUTES)
+		throw readfileexception(filename, "The file requires more system attributes than the library can handle");
+	if(h.nbodattr > ensemble::NUM_BODY_ATTRIBUTES)
+		throw readfileexception(filename, "The file requires more planet attributes than the library can handle");
+
+	// The chunks consist of arrays of chunk_size doubles: 
+	// 3 positions, 3 velocities, mass and the attributes for bodies;
+	// time, state/id pairs and the attributes for systems
+	const int64_t nchunks = (h.nsys + h.chunk_size - 1) / std::max(h.chunk_size, 1);
+	if(h.chunk_size < 1 || h.nsys < 0 || h.nbod < 0 || h.nsysattr < 0 || h.nbodattr < 0
+			|| h.body_chunk_size != (7 + h.nbodattr) * h.chunk_size * (int) sizeof(double)
+			|| h.sys_chunk_size != (2 + h.nsysattr) * h.chunk_size * (int) sizeof(double)
+			|| h.body_length != nchunks * h.nbod * h.body_chunk_size
+			|| h.sys_length != nchunks * h.sys_chunk_size
+			|| h.body_offset < (int64_t) sizeof(h) || h.sys_offset < h.body_offset + h.body_length )
+		throw readfileexception(filename, "Unsupported array layout");
+
+	if(!stat_ok || st.st_size < h.sys_offset + h.sys_length)
+		throw readfileexception(filename, "The file is truncated");
+
+	return h;
+}
+
+//! Check whether the arrays in the file can be used by this library as they are
+bool chunked_layout_matches(const chunked_header& h){
+	return h.chunk_size == ensemble::CHUNK_SIZE
+		&& h.nsysattr == ensemble::NUM_SYS_ATTRIBUTES
+		&& h.nbodattr == ensemble::NUM_BODY_ATTRIBUTES
+		&& h.body_chunk_size == (int) sizeof(ensemble::Body)
+		&& h.sys_chunk_size == (int) sizeof(ensemble::Sys);
+}
+
+/*! Copy systems from chunked arrays with a different layout
+ *  (chunk size or number of attributes) into the ensemble.
+ */
+struct convert_chunked_task : public runtime::task {
+	const chunked_header& h;
+	const char* body;
+	const char* sys;
+	defaultEnsemble& ens;
+	//! System of the file that is copied to ens[0]
+	int first;
+
+	convert_chunked_task(const chunked_header& h, const char* body, const char* sys, defaultEnsemble& ens, const int& first = 0)
+		:h(h),body(body),sys(sys),ens(ens),first(first){}
+
+	void operator()(const int& begin, const int& end, scratch_arena& scratch){
+		const int C = h.chunk_size;
+		for(int i = begin; i < end; i++){
+			ensemble::SystemRef sr = ens[i];
+			const int chunk = (first + i) / C, lane = (first + i) % C;
+
+			const char* sc = sys + (size_t) chunk * h.sys_chunk_size;
+			const double* sd = (const double*) sc;
+			const int* bunch = (const int*) (sc + C * sizeof(double));
+			sr.time() = sd[lane];
+			sr.state() = bunch[2*lane];
+			sr.id() = bunch[2*lane+1];
+			for(int l = 0; l < h.nsysattr; l++)
+				sr.attribute(l) = sd[(2 + l) * C + lane];
+
+			for(int j = 0; j < h.nbod; j++){
+				const double* bd = (const double*) (body + ((size_t) chunk * h.nbod + j) * h.body_chunk_size) + lane;
+				for(int c = 0; c < 3; c++){
+					sr[j][c].pos() = bd[(2 * c) * C];
+					sr[j][c].vel() = bd[(2 * c + 1) * C];
+				}
+				sr[j].mass() = bd[6 * C];
+				for(int l = 0; l < h.nbodattr; l++)
+					sr[j].attribute(l) = bd[(7 + l) * C];
+			}
+		}
+	}
+};
+
+defaultEnsemble load_chunked(const string& filename) throw (readfileexception){
+	const chunked_header h = read_chunked_header(filename);
+
+	hostEnsemble ens = hostEnsemble::create(h.nbod,h.nsys);
+
+	if(chunked_layout_matches(h)) {
+		// Same layout, read the arrays directly
+		FILE* f = fopen(filename.c_str(),"rb");
+		if(f == NULL)
+			throw readfileexception(filename, "Cannot open the file");
+		const bool ok = fseeko(f, h.body_offset, SEEK_SET) == 0
+			&& fread(ens.bodies().begin(), 1, h.body_length, f) == (size_t) h.body_length
+			&& fseeko(f, h.sys_offset, SEEK_SET) == 0
+			&& fread(ens.systems().begin(), 1, h.sys_length, f) == (size_t) h.sys_length;
+		fclose(f);
+		if(!ok)
+			throw readfileexception(filename,"File I/O error");
+	} else {
+		// Different layout, convert the systems one by one
+		try {
+			peyton::system::MemoryMap m(filename, h.sys_offset + h.sys_length, 0, peyton::system::MemoryMap::ro);
+			const char* base = (const char*) (void*) m;
+			convert_chunked_task t(h, base + h.body_offset, base + h.sys_offset, ens);
+			const int grain = ensemble::CHUNK_SIZE;
+			runtime::instance().parallel_for(h.nsys, t, grain);
+		} catch(const peyton::system::MemoryMapError& e) {
+			throw readfileexception(filename, e.what());
+		} catch(const runtime_error& e) {
+			throw readfileexception(filename, e.what());
 		}
+	}
 
-		fprintf(f,"\n");
+	return ens;
+}
 
+//! Deleter for arrays inside a memory mapped file, the mapping
+//! is released with the last array that refers to it.
+struct mapping_owner {
+	boost::shared_ptr<peyton::system::MemoryMap> map;
+	void operator()(void*){}
+};
+
+defaultEnsemble map_chunked(const string& filename, const bool& writeback) throw (readfileexception){
+	const chunked_header h = read_chunked_header(filename);
+
+	if(!chunked_layout_matches(h))
+		return load_chunked(filename);
+
+	using peyton::system::MemoryMap;
+	mapping_owner owner;
+	try {
+		// A private mapping needs write permission for the memory only
+		const int fd = open(filename.c_str(), writeback ? O_RDWR : O_RDONLY);
+		if(fd == -1)
+			throw readfileexception(filename, "Cannot open the file");
+		owner.map.reset(new MemoryMap);
+		owner.map->open(fd, h.sys_offset + h.sys_length, 0, MemoryMap::rw
+				, writeback ? MemoryMap::shared : MemoryMap::priv, true);
+	} catch(const peyton::system::MemoryMapError& e) {
+		throw readfileexception(filename, e.what());
 	}
+
+	char* base = (char*) (void*) *owner.map;
+	defaultEnsemble::PBody b( (defaultEnsemble::Body*) (base + h.body_offset), owner );
+	defaultEnsemble::PSys s( (defaultEnsemble::Sys*) (base + h.sys_offset), owner );
+	return defaultEnsemble::attach(h.nbod, h.nsys, b, s);
+}
+
+//! Write zeros up to the offset
+void pad_chunked(FILE* f, const int64_t& offset, const string& filename){
+	static const char zeros[CHUNKED_ALIGNMENT] = {};
+	const int64_t at = ftello(f);
+	if(at < 0 || at > offset || fwrite(zeros, 1, offset - at, f) != (size_t) (offset - at))
+		throw writefileexception(filename,"File I/O error");
+}
+
+void save_chunked(defaultEnsemble& ens, const string& filename)  throw (writefileexception){
+	chunked_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.tag, CHUNKED_TAG, sizeof(h.tag));
+	h.version = CHUNKED_VERSION;
+	h.byte_order = CHUNKED_BYTE_ORDER;
+	h.chunk_size = ensemble::CHUNK_SIZE;
+	h.nsys = ens.nsys(), h.nbod = ens.nbod();
+	h.nsysattr = ensemble::NUM_SYS_ATTRIBUTES, h.nbodattr = ensemble::NUM_BODY_ATTRIBUTES;
+	h.body_chunk_size = sizeof(ensemble::Body), h.sys_chunk_size = sizeof(ensemble::Sys);
+	h.body_offset = chunked_align(sizeof(h));
+	h.body_length = (int64_t) ens.bodies().block_count() * sizeof(ensemble::Body);
+	h.sys_offset = chunked_align(h.body_offset + h.body_length);
+	h.sys_length = (int64_t) ens.systems().block_count() * sizeof(ensemble::Sys);
+
+	FILE* f = fopen(filename.c_str(),"wb");
+	if(f == NULL)
+		throw writefileexception(filename, "Cannot open the file");
+
+	try {
+		writetoFILE(f,h,filename);
+		pad_chunked(f, h.body_offset, filename);
+		if(fwrite(ens.bodies().begin(), 1, h.body_length, f) != (size_t) h.body_length)
+			throw writefileexception(filename,"File I/O error");
+		pad_chunked(f, h.sys_offset, filename);
+		if(fwrite(ens.systems().begin(), 1, h.sys_length, f) != (size_t) h.sys_length)
+			throw writefileexception(filename,"File I/O error");
+	} catch(...) { fclose(f); throw; }
+
+	if(fclose(f) != 0)
+		throw writefileexception(filename,"File I/O error");
+}
+
+
+//! Size of the records of one system in a flat binary file
+size_t flat_record_size(const int& nbod){
+	return sizeof(sys) + nbod * sizeof(body);
+}
+
+header read_header(const string& filename) throw (readfileexception){
+	header h;
+	if(is_chunked(filename)) {
+		const chunked_header c = read_chunked_header(filename);
+		h.nsys = c.nsys, h.nbod = c.nbod, h.nsysattr = c.nsysattr, h.nbodattr = c.nbodattr;
+	} else {
+		FILE* f = fopen(filename.c_str(),"rb");
+		if(f == NULL)
+			throw readfileexception(filename, "Cannot open the file");
+		try {
+			readfromFILE(f,h,filename);
+		} catch(...) { fclose(f); throw; }
+		fclose(f);
+	}
+	return h;
+}
+
+//! Read from an open file at the offset
+bool pread_all(const int& fd, void* p, const size_t& length, const int64_t& offset){
+	size_t done = 0;
+	while(done < length) {
+		const ssize_t n = pread(fd, (char*) p + done, length - done, offset + done);
+		if(n <= 0) return false;
+		done += n;
+	}
+	return true;
+}
+
+//! Write to an open file at the offset
+bool pwrite_all(const int& fd, const void* p, const size_t& length, const int64_t& offset){
+	size_t done = 0;
+	while(done < length) {
+		const ssize_t n = pwrite(fd, (const char*) p + done, length - done, offset + done);
+		if(n <= 0) return false;
+		done += n;
+	}
+	return true;
+}
+
+defaultEnsemble load_range(const string& filename, const int& first, const int& count) throw (readfileexception){
+	const header h = read_header(filename);
+	if(first < 0 || count < 0 || first + count > h.nsys)
+		throw readfileexception(filename, "The range of systems is outside of the file");
+	if(h.nsysattr > ensemble::NUM_SYS_ATTRIBUTES)
+		throw readfileexception(filename, "The file requires more system attributes than the library can handle");
+	if(h.nbodattr > ensemble::NUM_BODY_ATTRIBUTES)
+		throw readfileexception(filename, "The file requires more planet attributes than the library can handle");
+
+	hostEnsemble ens = hostEnsemble::create(h.nbod,count);
+
+	if(is_chunked(filename)) {
+		const chunked_header c = read_chunked_header(filename);
+		const int chunk_size = ensemble::CHUNK_SIZE;
+		if(chunked_layout_matches(c) && first % chunk_size == 0) {
+			// Whole chunks, read the arrays directly
+			const int fd = open(filename.c_str(), O_RDONLY);
+			if(fd == -1)
+				throw readfileexception(filename, "Cannot open the file");
+			const int64_t chunk = first / chunk_size;
+			const bool ok = pread_all(fd, ens.bodies().begin(), ens.bodies().block_count() * sizeof(ensemble::Body)
+					, c.body_offset + chunk * c.nbod * sizeof(ensemble::Body))
+				&& pread_all(fd, ens.systems().begin(), ens.systems().block_count() * sizeof(ensemble::Sys)
+					, c.sys_offset + chunk * sizeof(ensemble::Sys));
+			close(fd);
+			if(!ok)
+				throw readfileexception(filename,"File I/O error");
+		} else {
+			try {
+				peyton::system::MemoryMap m(filename, c.sys_offset + c.sys_length, 0, peyton::system::MemoryMap::ro);
+				const char* base = (const char*) (void*) m;
+				convert_chunked_task t(c, base + c.body_offset, base + c.sys_offset, ens, first);
+				const int grain = ensemble::CHUNK_SIZE;
+				runtime::instance().parallel_for(count, t, grain);
+			} catch(const peyton::system::MemoryMapError& e) {
+				throw readfileexception(filename, e.what());
+			} catch(const runtime_error& e) {
+				throw readfileexception(filename, e.what());
+			}
+		}
+		return ens;
+	}
+
+	FILE* f = fopen(filename.c_str(),"rb");
+	if(f == NULL)
+		throw readfileexception(filename, "Cannot open the file");
+	if(fseeko(f, sizeof(header) + first * (int64_t) flat_record_size(h.nbod), SEEK_SET) != 0) {
+		fclose(f);
+		throw readfileexception(filename,"File I/O error");
+	}
+
+	sys s; body b;
+	try {
+		for(int i = 0; i < count; i++){
+			ensemble::SystemRef sr = ens[i];
+
+			readfromFILE(f,s,filename);
+
+			sr.id() = s.id;
+			sr.time() = s.time; sr.state() = s.state;
+
+			for(int l = 0; l < h.nsysattr ; l++)
+				sr.attribute(l) = s.attribute[l];
+
+			for(int j = 0; j < h.nbod; j++){
+				readfromFILE(f,b,filename);
+
+				sr[j].mass() = b.mass;
+				for(int c = 0; c < 3; c++)
+					sr[j][c].pos() = b.pos[c], sr[j][c].vel() = b.vel[c];
+				for(int l = 0; l < h.nbodattr ; l++)
+					sr[j].attribute(l) = b.attribute[l];
+			}
+		}
+	} catch(...) { fclose(f); throw; }
 	fclose(f);
+	return ens;
+}
+
+void create_binary(const string& filename, const int& nsys, const int& nbod, const bool& chunked) throw (writefileexception){
+	chunked_header c;
+	header h;
+	int64_t length;
+	if(chunked) {
+		memset(&c, 0, sizeof(c));
+		memcpy(c.tag, CHUNKED_TAG, sizeof(c.tag));
+		c.version = CHUNKED_VERSION;
+		c.byte_order = CHUNKED_BYTE_ORDER;
+		c.chunk_size = ensemble::CHUNK_SIZE;
+		c.nsys = nsys, c.nbod = nbod;
+		c.nsysattr = ensemble::NUM_SYS_ATTRIBUTES, c.nbodattr = ensemble::NUM_BODY_ATTRIBUTES;
+		c.body_chunk_size = sizeof(ensemble::Body), c.sys_chunk_size = sizeof(ensemble::Sys);
+		c.body_offset = chunked_align(sizeof(c));
+		c.body_length = (int64_t) ensemble::body_element_count(nbod, nsys) * sizeof(ensemble::Body);
+		c.sys_offset = chunked_align(c.body_offset + c.body_length);
+		c.sys_length = (int64_t) ensemble::sys_element_count(nsys) * sizeof(ensemble::Sys);
+		length = c.sys_offset + c.sys_length;
+	} else {
+		h.nsys = nsys, h.nbod = nbod;
+		h.nsysattr = ensemble::NUM_SYS_ATTRIBUTES, h.nbodattr = ensemble::NUM_BODY_ATTRIBUTES;
+		length = sizeof(h) + nsys * (int64_t) flat_record_size(nbod);
+	}
+
+	const int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(fd == -1)
+		throw writefileexception(filename, "Cannot open the file");
+	const bool ok = (chunked ? pwrite_all(fd, &c, sizeof(c), 0) : pwrite_all(fd, &h, sizeof(h), 0))
+		&& ftruncate(fd, length) == 0;
+	if(close(fd) != 0 || !ok)
+		throw writefileexception(filename,"File I/O error");
+}
+
+void save_range(defaultEnsemble& ens, const string& filename, const int& first) throw (writefileexception){
+	header h;
+	chunked_header c;
+	const bool chunked = is_chunked(filename);
+	try {
+		h = read_header(filename);
+		if(chunked) c = read_chunked_header(filename);
+	} catch(const readfileexception& e) {
+		throw writefileexception(filename, e.message);
+	}
+	const int chunk_size = ensemble::CHUNK_SIZE;
+	if(first < 0 || first + ens.nsys() > h.nsys || ens.nbod() != h.nbod)
+		throw writefileexception(filename, "The systems do not fit in the file");
+	if(chunked && (!chunked_layout_matches(c) || first % chunk_size != 0))
+		throw writefileexception(filename, "The systems should start at a chunk boundary of the same layout");
+
+	const int fd = open(filename.c_str(), O_WRONLY);
+	if(fd == -1)
+		throw writefileexception(filename, "Cannot open the file");
+
+	bool ok = true;
+	if(chunked) {
+		const int64_t chunk = first / chunk_size;
+		ok = pwrite_all(fd, ens.bodies().begin(), ens.bodies().block_count() * sizeof(ensemble::Body)
+				, c.body_offset + chunk * c.nbod * sizeof(ensemble::Body))
+			&& pwrite_all(fd, ens.systems().begin(), ens.systems().block_count() * sizeof(ensemble::Sys)
+				, c.sys_offset + chunk * sizeof(ensemble::Sys));
+	} else {
+		// Format the records in memory and write them at once
+		std::vector<char> records(ens.nsys() * flat_record_size(h.nbod) + 1);
+		char* p = &records[0];
+		for(int i = 0; i < ens.nsys(); i++){
+			ensemble::SystemRef sr = ens[i];
+			sys s; 
+			memset(&s, 0, sizeof(s));
+			s.id = sr.id();
+			s.time = sr.time(), s.state = sr.state(); 
+			for(int l = 0; l < ensemble::NUM_SYS_ATTRIBUTES ; l++)
+				s.attribute[l] = sr.attribute(l);
+			memcpy(p, &s, sizeof(s)), p += sizeof(s);
+
+			for(int j = 0; j < h.nbod; j++){
+				body b;
+				memset(&b, 0, sizeof(b));
+				for(int c = 0; c < 3; c++)
+					b.pos[c] = sr[j][c].pos(), b.vel[c] = sr[j][c].vel();
+				b.mass = sr[j].mass();
+				for(int l = 0; l < ensemble::NUM_BODY_ATTRIBUTES ; l++)
+					b.attribute[l] = sr[j].attribute(l);
+				memcpy(p, &b, sizeof(b)), p += sizeof(b);
+			}
+		}
+		ok = pwrite_all(fd, &records[0], p - &records[0], sizeof(h) + first * (int64_t) flat_record_size(h.nbod));
+	}
+
+	if(close(fd) != 0 || !ok)
+		throw writefileexception(filename,"File I/O error");
 }
 
+//! Round the batch up to whole chunks, so that every write starts at a chunk boundary
+int partition_batch(const int& batch){
+	const int chunk_size = ensemble::CHUNK_SIZE;
+	if(batch < 1) ERROR("The batch should be at least one system");
+	return (batch + chunk_size - 1) / chunk_size * chunk_size;
+}
+
+//! Systems on their way to one of the files written by split or merge
+struct partition_output {
+	string filename;
+	int written, filled;
+	hostEnsemble buffer;
+
+	void open(const string& name, const int& nsys, const int& nbod, const bool& chunked, const int& batch){
+		const int chunk_size = ensemble::CHUNK_SIZE;
+		filename = name, written = 0, filled = 0;
+		create_binary(filename, nsys, nbod, chunked);
+		// A file without systems is only a header and never needs the buffer
+		if(nsys > 0)
+			buffer = hostEnsemble::create(nbod, std::max(chunk_size, std::min(batch, partition_batch(nsys))));
+	}
+
+	void add(ensemble::SystemRef s){
+		s.copyTo(buffer[filled++]);
+		if(filled == buffer.nsys()) flush();
+	}
+
+	void flush(){
+		if(filled == 0) return;
+		if(filled == buffer.nsys()) {
+			save_range(buffer, filename, written);
+		} else {
+			hostEnsemble rest = hostEnsemble::create(buffer.nbod(), filled);
+			for(int i = 0; i < filled; i++)
+				buffer[i].copyTo(rest[i]);
+			save_range(rest, filename, written);
+		}
+		written += filled, filled = 0;
+	}
+};
+
+void split(const string& input, const std::vector<string>& outputs, const split_method& method
+		, const bool& chunked, const int& batch_size){
+	const int batch = partition_batch(batch_size);
+	const int n = outputs.size();
+	if(n < 1) ERROR("split needs at least one output file");
+
+	const header h = read_header(input);
+	// First system of every piece for SPLIT_RANGE
+	std::vector<int> first_of(n + 1);
+	for(int k = 0; k <= n; k++)
+		first_of[k] = (int) ((int64_t) k * h.nsys / n);
+
+	std::vector<partition_output> out(n);
+	for(int k = 0; k < n; k++) {
+		const int count = (method == SPLIT_RANGE) ? first_of[k+1] - first_of[k] : (h.nsys - k + n - 1) / n;
+		out[k].open(outputs[k], count, h.nbod, chunked, batch);
+	}
+
+	for(int first = 0, k = 0; first < h.nsys; first += batch) {
+		defaultEnsemble ens = load_range(input, first, std::min(batch, h.nsys - first));
+		for(int i = 0; i < ens.nsys(); i++) {
+			const int g = first + i;
+			if(method == SPLIT_RANGE) {
+				while(g >= first_of[k+1]) k++;
+			} else {
+				k = g % n;
+			}
+			out[k].add(ens[i]);
+		}
+	}
+	for(int k = 0; k < n; k++)
+		out[k].flush();
+}
+
+//! One of the files read by merge
+struct partition_input {
+	string filename;
+	int nsys, loaded, at;
+	defaultEnsemble batch;
+
+	void fill(const int& size){
+		const int count = std::min(size, nsys - loaded);
+		batch = (count > 0) ? load_range(filename, loaded, count) : defaultEnsemble();
+		loaded += count, at = 0;
+	}
+	bool valid() const { return at < batch.nsys(); }
+	int id() { return batch[at].id(); }
+};
+
+void merge(const std::vector<string>& inputs, const string& output, const bool& chunked, const int& batch_size){
+	const int batch = partition_batch(batch_size);
+	const int n = inputs.size();
+	if(n < 1) ERROR("merge needs at least one input file");
+
+	std::vector<partition_input> in(n);
+	int nsys = 0, nbod = -1;
+	for(int k = 0; k < n; k++) {
+		const header h = read_header(inputs[k]);
+		if(nbod != -1 && h.nbod != nbod)
+			ERROR("Cannot merge " + inputs[k] + ", the number of bodies differs from " + inputs[0]);
+		nbod = h.nbod;
+		nsys += h.nsys;
+		in[k].filename = inputs[k], in[k].nsys = h.nsys, in[k].loaded = 0;
+	}
+
+	// Smallest id first, ties are taken in the order of the inputs
+	typedef std::pair<int,int> head;
+	std::priority_queue<head, std::vector<head>, std::greater<head> > heads;
+	for(int k = 0; k < n; k++) {
+		in[k].fill(batch);
+		if(in[k].valid()) heads.push(head(in[k].id(), k));
+	}
+
+	partition_output out;
+	out.open(output, nsys, nbod, chunked, batch);
+	while(!heads.empty()) {
+		partition_input& i = in[heads.top().second];
+		heads.pop();
+		out.add(i.batch[i.at++]);
+		if(!i.valid()) i.fill(batch);
+		if(i.valid()) heads.push(head(i.id(), &i - &in[0]));
+	}
+	out.flush();
+}
 
 }
 }
@@ -26,6 +26,7 @@
 #include "common.hpp"
 #include "types/ensemble.hpp"
 #include "ensemble_alloc.hpp"
+#include "peyton/memorymap.hpp"
 
 using std::string;
 
@@ -145,6 +146,22 @@ namespace swarm {
  *
  *   For text format refere to \ref TextFormat
  *
+ *  Chunked binary format (c.f. save_chunked, load_chunked, map_chunked):
+ *    CHUNKED_HEADER | padding | BODY ARRAY | padding | SYS ARRAY
+ *
+ *   The body and system arrays are stored exactly as they are laid out in
+ *   memory by the ensemble (BodyArray and SysArray, CHUNK_SIZE systems per
+ *   chunk), each starting at a multiple of CHUNKED_ALIGNMENT bytes. A file
+ *   written by a library with the same CHUNK_SIZE and the same number of
+ *   attributes can be loaded with a single read per array or memory mapped
+ *   and integrated in place. Files with a different layout are converted
+ *   system by system while loading. The numbers are stored in the byte
+ *   order of the machine that wrote the file, files from a machine with a
+ *   different byte order are rejected.
+ *
+ *   The binary loader (load) recognizes chunked files by their tag, so
+ *   they can be used anywhere a binary snapshot is expected.
+ *
  */
 namespace snapshot {
 
@@ -169,17 +186,44 @@ namespace snapshot {
 		double pos[3], vel[3], mass, attribute[ensemble::NUM_BODY_ATTRIBUTES];
 	};
 
+	//! Tag at the start of a chunked binary file
+	const char CHUNKED_TAG[8] = { 'S', 'W', 'A', 'R', 'M', 'C', 'H', 'K' };
+	//! Version of the chunked binary format
+	const int CHUNKED_VERSION = 1;
+	//! Alignment of the arrays inside a chunked binary file
+	const int CHUNKED_ALIGNMENT = 4096;
+	//! Value of chunked_header::byte_order as written by the machine
+	const int CHUNKED_BYTE_ORDER = 0x01020304;
+
+	//! Header of chunked binary files. This is meant to be found at
+	//! offset 0 of the file, followed by the raw body and system arrays.
+	struct chunked_header {
+		char tag[8];
+		int version;
+		int byte_order;
+		//! Number of systems per chunk
+		int chunk_size;
+		int nsys, nbod, nsysattr, nbodattr;
+		//! Size of one chunk of the body and system arrays in bytes
+		int body_chunk_size, sys_chunk_size;
+		//! Location of the arrays in the file in bytes
+		int64_t body_offset, body_length, sys_offset, sys_length;
+	};
+
 	//! Raised when an error encountered reading a text or binary file.
 	//! Used in load and load_text
 	struct readfileexception : public std::exception {
 		string filename;
 		int lineno;
 		string message;
-		readfileexception( const string& filename, const string& message, const int& lineno = 0): filename(filename),message(message),lineno(lineno) {}
+		readfileexception( const string& filename, const string& message, const int& lineno = 0): filename(filename),message(message),lineno(lineno)
+			,description("Error reading " + filename + " : " + message) {}
 		virtual ~readfileexception()throw(){}
 		virtual const char* what() const throw() {
-			return ("Error reading " + filename + " : " + message).c_str();
+			return description.c_str();
 		}
+		private:
+		string description;
 	};
 
 	//! Raised when an error encountered writing to a text or binary file.
@@ -188,18 +232,26 @@ namespace snapshot {
 		string filename;
 		int lineno;
 		string message;
-		writefileexception( const string& filename, const string& message, const int& lineno = 0): filename(filename),message(message),lineno(lineno) {}
+		writefileexception( const string& filename, const string& message, const int& lineno = 0): filename(filename),message(message),lineno(lineno)
+			,description("Error writing " + filename + " : " + message) {}
 		virtual ~writefileexception()throw(){}
 		virtual const char* what() const throw() {
-			return ("Error writing " + filename + " : " + message).c_str();
+			return description.c_str();
 		}
+		private:
+		string description;
 	};
 
 	//! Load binary snapshot file
 	defaultEnsemble load(const string& filename) 
 		throw (readfileexception);
 
-	//! Loads textual snapshot file
+	/*! Loads textual snapshot file
+	 *
+	 *  The file is memory mapped and parsed by the worker threads of
+	 *  \ref runtime. Numbers are separated by any whitespace, as with
+	 *  scanf.
+	 */
 	defaultEnsemble load_text(const string& filename) 
 		throw (readfileexception);
 
@@ -207,10 +259,100 @@ namespace snapshot {
 	void save(defaultEnsemble& ens, const string& filename) 
 		throw (writefileexception);
 
-	//! Save the ensemble as a text file
+	//! Save the ensemble as a text file, systems are formatted by the
+	//! worker threads of \ref runtime and written in order
 	void save_text(defaultEnsemble& ens, const string& filename) 
 		throw (writefileexception);
 
+	//! Check whether the file starts with a chunked binary header
+	bool is_chunked(const string& filename);
+
+	//! Load chunked binary file, converting the layout if necessary
+	defaultEnsemble load_chunked(const string& filename) 
+		throw (readfileexception);
+
+	/*! Memory map a chunked binary file and use it as the ensemble memory.
+	 *
+	 *  If writeback is true, changes made to the ensemble are written to the
+	 *  file, otherwise the mapping is private and the file is left intact.
+	 *  The mapping is released when the last copy of the ensemble is
+	 *  destroyed. If the layout in the file does not match this library
+	 *  (different CHUNK_SIZE or number of attributes), the file cannot be
+	 *  used in place and it is loaded with load_chunked instead.
+	 */
+	defaultEnsemble map_chunked(const string& filename, const bool& writeback = false) 
+		throw (readfileexception);
+
+	//! Save the ensemble to a chunked binary file
+	void save_chunked(defaultEnsemble& ens, const string& filename) 
+		throw (writefileexception);
+
+	/*! \name Partial access to binary files
+	 *  Used to process ensembles that do not fit in memory, c.f. 
+	 *  \ref sharded_integration. These functions work with both the
+	 *  flat and the chunked binary formats.
+	 *  @{
+	 */
+
+	//! Read the number of systems, bodies and attributes of a binary file
+	header read_header(const string& filename) 
+		throw (readfileexception);
+
+	//! Load the systems [first,first+count) of a binary file
+	defaultEnsemble load_range(const string& filename, const int& first, const int& count) 
+		throw (readfileexception);
+
+	//! Create a binary file for nsys systems of nbod bodies, 
+	//! the systems are written with save_range
+	void create_binary(const string& filename, const int& nsys, const int& nbod, const bool& chunked = false) 
+		throw (writefileexception);
+
+	/*! Write the systems of ens as systems [first,first+ens.nsys()) of
+	 *  a file made by create_binary. For chunked files first should be a
+	 *  multiple of CHUNK_SIZE. Different ranges of the same file can be
+	 *  written concurrently.
+	 */
+	void save_range(defaultEnsemble& ens, const string& filename, const int& first) 
+		throw (writefileexception);
+
+	//! @}
+
+	/*! \name Splitting and merging binary files
+	 *  Used to distribute an ensemble over independent batch jobs. The
+	 *  files are processed batch systems at a time, so the memory used
+	 *  is about (number of files + 1) * batch systems regardless of the
+	 *  size of the ensemble.
+	 *  @{
+	 */
+
+	//! How split assigns systems to the pieces
+	enum split_method {
+		//! Contiguous ranges of equal size, i.e. ranges of system ids for ensembles stored in id order
+		SPLIT_RANGE,
+		//! System i goes to piece i mod N
+		SPLIT_ROUND_ROBIN
+	};
+
+	//! Default number of systems processed at a time by split and merge
+	const int PARTITION_BATCH = 4096;
+
+	/*! Write the systems of a binary file to N = outputs.size() binary files.
+	 *  When there are more outputs than systems, the outputs left without
+	 *  systems are written as files that only have a header (nsys = 0),
+	 *  which merge accepts.
+	 */
+	void split(const string& input, const std::vector<string>& outputs, const split_method& method = SPLIT_RANGE
+			, const bool& chunked = false, const int& batch = PARTITION_BATCH);
+
+	/*! Combine binary files into one, ordered by system id.
+	 *  Every input file should be in id order, like the pieces written
+	 *  by split (or the same pieces after integration).
+	 */
+	void merge(const std::vector<string>& inputs, const string& output
+			, const bool& chunked = false, const int& batch = PARTITION_BATCH);
+
+	//! @}
+
 }
 
 }
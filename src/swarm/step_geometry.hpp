@@ -0,0 +1,172 @@
+/*************************************************************************
+ * Copyright (C) 2011 by Saleh Dindar and the Swarm-NG Development Team  *
+ *                                                                       *
+ * This program is free software; you can redistribute it and/or modify  *
+ * it under the terms of the GNU General Public License as published by  *
+ * the Free Software Foundation; either version 3 of the License.        *
+ *                                                                       *
+ * This program is distributed in the hope that it will be useful,       *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program; if not, write to the                         *
+ * Free Software Foundation, Inc.,                                       *
+ * 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ************************************************************************/
+
+/*! \file step_geometry.hpp
+ *   \brief Defines \ref swarm::step_geometry, distances and speeds of the
+ *   bodies of a system after a step, shared by all monitors.
+ *
+ */
+#pragma once
+
+#include "types/ensemble.hpp"
+
+namespace swarm {
+
+/*! Geometry of a system after the last step.
+ *
+ *  The stopping monitors test the same quantities: stop_on_close_encounter
+ *  the distance between every pair of bodies and the distance of the
+ *  bodies to the origin, stop_on_ejection and stop_on_crossing_orbit the
+ *  distance to the origin and the speed of every body. Combined, every
+ *  one of them computes these again, with a square root for each.
+ *
+ *  An integrator that supports the cache calls reset() after every step
+ *  and hands the cache to its monitor with monitors::set_step_geometry().
+ *  Monitors that implement set_step_geometry(const step_geometry*) read
+ *  the values from the cache instead of the system; without a cache (e.g.
+ *  on the GPU) they compute them as before.
+ *
+ *  The values are computed when a monitor first reads them after a step,
+ *  in two independent parts: the per-body values in one pass over the
+ *  bodies and the pair separations in one pass over the pairs. Steps on
+ *  which no monitor tests anything (c.f. \ref monitors::check_cadence)
+ *  cost nothing, and monitors that only read per-body values never pay
+ *  for the O(nbod^2) pairs.
+ *
+ *  The arrays are owned by the integrator, usually allocated from its
+ *  scratch_arena with alloc().
+ */
+struct step_geometry {
+	int nbod;
+	//! Squared distance and inverse distance of pair (i,j), i > j, at index pair(i,j)
+	double *pair_r2, *pair_rinv;
+	//! Distance to the origin and speed squared of every body
+	double *body_r, *body_v2;
+
+	GENERIC step_geometry():nbod(0),_sys(0),_bodies_valid(false),_pairs_valid(false){}
+
+	//! Index of the pair (i,j) in pair_r2 and pair_rinv
+	GENERIC static int pair(const int& i, const int& j) {
+		return (i > j) ? i * (i - 1) / 2 + j : j * (j - 1) / 2 + i;
+	}
+
+	//! Number of pairs of a system with nbod bodies
+	GENERIC static int pair_count(const int& nbod) { return nbod * (nbod - 1) / 2; }
+
+	GENERIC double distance_squared_between(const int& i, const int& j) const {
+		if(!_pairs_valid) compute_pairs();
+		return pair_r2[pair(i, j)];
+	}
+	GENERIC double distance_between(const int& i, const int& j) const {
+		if(!_pairs_valid) compute_pairs();
+		const int k = pair(i, j);
+		return pair_r2[k] * pair_rinv[k];
+	}
+	GENERIC double distance_to_origin(const int& b) const {
+		if(!_bodies_valid) compute_bodies();
+		return body_r[b];
+	}
+	GENERIC double speed_squared(const int& b) const {
+		if(!_bodies_valid) compute_bodies();
+		return body_v2[b];
+	}
+
+	//! Allocate the arrays for systems with n bodies from a scratch_arena or similar allocator
+	template<class Allocator>
+	void alloc(Allocator& a, const int& n) {
+		nbod = n;
+		pair_r2 = a.template alloc<double>(pair_count(n));
+		pair_rinv = a.template alloc<double>(pair_count(n));
+		body_r = a.template alloc<double>(n);
+		body_v2 = a.template alloc<double>(n);
+	}
+
+	/*! Forget the values of the last step, they are computed again from
+	 *  the current state of sys when they are read. sys should stay valid
+	 *  while the monitors use the cache.
+	 */
+	GENERIC void reset(const ensemble::SystemRef& sys) {
+		_sys = &sys;
+		_bodies_valid = _pairs_valid = false;
+	}
+
+	private:
+	const ensemble::SystemRef* _sys;
+	mutable bool _bodies_valid, _pairs_valid;
+
+	GENERIC void compute_bodies() const {
+		const ensemble::SystemRef& sys = *_sys;
+		for(int i = 0; i < nbod; i++) {
+			const double x = sys[i][0].pos(), y = sys[i][1].pos(), z = sys[i][2].pos();
+			body_r[i] = sqrt(x*x + y*y + z*z);
+			body_v2[i] = sys[i].speed_squared();
+		}
+		_bodies_valid = true;
+	}
+
+	GENERIC void compute_pairs() const {
+		const ensemble::SystemRef& sys = *_sys;
+		for(int i = 1; i < nbod; i++) {
+			double* r2 = pair_r2 + pair(i, 0);
+			double* rinv = pair_rinv + pair(i, 0);
+			for(int j = 0; j < i; j++) {
+				const double dx = sys[i][0].pos() - sys[j][0].pos();
+				const double dy = sys[i][1].pos() - sys[j][1].pos();
+				const double dz = sys[i][2].pos() - sys[j][2].pos();
+				r2[j] = dx*dx + dy*dy + dz*dz;
+				rinv[j] = 1 / sqrt(r2[j]);
+			}
+		}
+		_pairs_valid = true;
+	}
+};
+
+namespace monitors {
+
+//! value is true if Monitor has a member set_step_geometry(const step_geometry*)
+template<class Monitor>
+struct accepts_step_geometry {
+	typedef char yes[1];
+	typedef char no[2];
+	template<class U, void (U::*)(const step_geometry*)> struct check;
+	template<class U> static yes& test(check<U, &U::set_step_geometry>*);
+	template<class U> static no& test(...);
+	static const bool value = sizeof(test<Monitor>(0)) == sizeof(yes);
+};
+
+template<bool accepts>
+struct step_geometry_setter {
+	template<class Monitor>
+	GENERIC static void set(Monitor&, const step_geometry*) {}
+};
+
+template<>
+struct step_geometry_setter<true> {
+	template<class Monitor>
+	GENERIC static void set(Monitor& m, const step_geometry* g) { m.set_step_geometry(g); }
+};
+
+//! Pass the geometry cache of the integrator to m, if m can use it
+template<class Monitor>
+GENERIC void set_step_geometry(Monitor& m, const step_geometry* g) {
+	step_geometry_setter< accepts_step_geometry<Monitor>::value >::set(m, g);
+}
+
+}
+
+}
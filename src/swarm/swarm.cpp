@@ -35,6 +35,8 @@
 #include "swarm.h"
 #include "query.hpp"
 #include "snapshot.hpp"
+#include "sharded.hpp"
+#include "multiprocess.hpp"
 #include "stopwatch.h"
 #include "gpu/device_settings.hpp"
 
@@ -53,6 +55,8 @@ string command;
 config cfg;
 config base_cfg;
 defaultEnsemble initial_ens;
+//! Energies of initial_ens for the energy conservation checks
+energy_baseline initial_energy;
 defaultEnsemble current_ens;
 defaultEnsemble reference_ens;
 po::variables_map argvars_map;
@@ -67,6 +71,7 @@ void stability_test() {
 	double interval = cfg.optional("interval", (destination_time-begin_time) ) ; 
 	double logarithmic = cfg.optional("logarithmic", 0 ) ; 
 	double allowed_deltaE =  cfg.optional("allowed_deltaE", 0.01 );
+	int energy_attribute = cfg.optional("track_energy_attribute", -1 );
 
 	if(destination_time < begin_time ) ERROR("Destination time should be larger than begin time");
 	if(interval < 0) ERROR("Interval cannot be negative");
@@ -90,9 +95,17 @@ void stability_test() {
 
 		SYNC;
 		DEBUG_OUTPUT(2, "Check energy conservation" );
-                ensemble::range_t deltaE_range = energy_conservation_error_range(ens, initial_ens );
-
-		int active_systems = ens.nsys() - number_of_disabled_systems( ens );
+		ensemble::range_t deltaE_range(0, 0, 0, 0);
+		int active_systems;
+		if(energy_attribute >= 0 && integ->tracks_conservation()) {
+			// Maintained by the integrator, c.f. conservation_tracker
+			deltaE_range = system_attribute_range(ens, energy_attribute);
+			active_systems = ens.nsys() - number_of_disabled_systems( ens );
+		}else{
+			ensemble_diagnostics diagnostics(ens);
+			deltaE_range = diagnostics.energy_error(initial_energy.diagnostics());
+			active_systems = ens.nsys() - diagnostics.count(ensemble::Sys::SYSTEM_DISABLED);
+		}
 		std::cout << effective_time << ", " << deltaE_range.max << ", " << deltaE_range.median << ", " << active_systems << std::endl;
 		
 		if(deltaE_range.median > allowed_deltaE){
@@ -158,7 +171,13 @@ bool save_ensemble(){
 	if(cfg.valid("output")) {
 		INFO_OUTPUT(1, "Saving as binary  " << cfg["output"]);
 		INFO_OUTPUT(1, ", time = " << current_ens.time_ranges() << endl);
-		swarm::snapshot::save(current_ens,cfg["output"]);	
+		const string format = cfg.optional("binary_format", string("flat"));
+		if(format == "chunked")
+			swarm::snapshot::save_chunked(current_ens,cfg["output"]);	
+		else if(format == "flat")
+			swarm::snapshot::save(current_ens,cfg["output"]);	
+		else
+			ERROR("binary_format should be either flat or chunked");
 		return true;
 
 	}else if(cfg.valid("text_output")) {
@@ -194,13 +213,113 @@ void generic_integrate () {
 	integ->integrate();
 }
 
+void run_sharded_integration(){
+	if(!cfg.valid("input") || !cfg.valid("output"))
+		ERROR("Sharded integration needs binary input and output files");
+
+	sharded_integration sharded(cfg);
+	stopwatch swatch; swatch.start();
+	sharded_integration::result r = sharded.run(cfg["input"], cfg["output"]);
+	swatch.stop();
+
+	INFO_OUTPUT( 1, "Integrated " << r.systems << " systems in " << r.shards << " shards, max dE/E = " << r.max_deltaE << std::endl);
+	INFO_OUTPUT( 1, "Integration time: " << swatch.getTime()*1000 << " ms " << std::endl);
+}
+
+void run_multiprocess_integration(){
+	if(!validate_configuration(cfg) ) ERROR( "Invalid configuration" );
+
+	load_generate_ensemble();
+	if(!cfg.valid("destination_time")) {
+		std::ostringstream t;
+		t << initial_ens.time_ranges().average + 10 * M_PI;
+		cfg["destination_time"] = t.str();
+	}
+
+	multiprocess_integration m(cfg);
+	stopwatch swatch; swatch.start();
+	multiprocess_integration::result r = m.run(initial_ens);
+	swatch.stop();
+	current_ens = r.ens;
+
+	save_ensemble();
+
+	INFO_OUTPUT( 1, "Integrated " << current_ens.nsys() << " systems in " << r.workers << " processes, " << r.active << " still active, max dE/E = "
+			<< find_max_energy_conservation_error(current_ens, initial_ens) << std::endl);
+	INFO_OUTPUT( 1, "Integration time: " << swatch.getTime()*1000 << " ms " << std::endl);
+}
+
+//! Name of the k-th piece of a split file
+string piece_name(const string& base, const int& k){
+	std::ostringstream o;
+	o << base << "." << k;
+	return o.str();
+}
+
+std::vector<string> piece_names(const string& base){
+	const int pieces = cfg.require("pieces", 0);
+	if(pieces < 1) ERROR("pieces should be at least 1");
+	std::vector<string> names;
+	for(int k = 0; k < pieces; k++)
+		names.push_back(piece_name(base, k));
+	return names;
+}
+
+bool chunked_output(){
+	const string format = cfg.optional("binary_format", string("flat"));
+	if(format != "flat" && format != "chunked")
+		ERROR("binary_format should be either flat or chunked");
+	return format == "chunked";
+}
+
+void split_ensemble(){
+	if(!cfg.valid("input") || !cfg.valid("output"))
+		ERROR("split needs binary input and output files");
+	const string method = cfg.optional("split_method", string("range"));
+	if(method != "range" && method != "round_robin")
+		ERROR("split_method should be either range or round_robin");
+
+	const std::vector<string> pieces = piece_names(cfg["output"]);
+	snapshot::split(cfg["input"], pieces, method == "range" ? snapshot::SPLIT_RANGE : snapshot::SPLIT_ROUND_ROBIN
+			, chunked_output(), cfg.optional("partition_batch", snapshot::PARTITION_BATCH));
+	INFO_OUTPUT(1, "Split " << cfg["input"] << " into " << pieces.size() << " files " << pieces.front() << " ... " << pieces.back() << endl);
+}
+
+void merge_ensembles(){
+	if(!cfg.valid("input") || !cfg.valid("output"))
+		ERROR("merge needs binary input and output files");
+
+	const std::vector<string> pieces = piece_names(cfg["input"]);
+	snapshot::merge(pieces, cfg["output"], chunked_output(), cfg.optional("partition_batch", snapshot::PARTITION_BATCH));
+	INFO_OUTPUT(1, "Merged " << pieces.size() << " files into " << cfg["output"] << endl);
+
+	if(cfg.valid("log_output")) {
+		std::vector<string> logs;
+		const std::vector<string> names = piece_names(cfg["log_output"]);
+		for(size_t k = 0; k < names.size(); k++)
+			if(access(names[k].c_str(), R_OK) == 0) logs.push_back(names[k]);
+		if(!query::merge_binary_log_files(cfg["log_output"], logs))
+			ERROR("Cannot merge the logs into " + cfg["log_output"]);
+		// Generate the indices
+		query::swarmdb db(cfg["log_output"]);
+		INFO_OUTPUT(1, "Merged " << logs.size() << " logs into " << cfg["log_output"] << endl);
+	}
+}
+
 void run_integration(){
+	if(cfg.valid("shard_size")) {
+		run_sharded_integration();
+		return;
+	}
+
 	if(!validate_configuration(cfg) ) ERROR( "Invalid configuration" );
 
 	load_generate_ensemble();
 
-	DEBUG_OUTPUT(2, "Make a copy of ensemble for energy conservation test" );
-	current_ens = initial_ens.clone();
+	DEBUG_OUTPUT(2, "Record the initial energies for energy conservation test" );
+	initial_energy = energy_baseline(initial_ens);
+	// The initial conditions are not needed afterwards, integrate them in place
+	current_ens = initial_ens;
 
 	prepare_integrator();
 
@@ -214,7 +333,7 @@ void run_integration(){
 
 void reference_integration() {
 	DEBUG_OUTPUT(2, "Make a copy of ensemble for reference ensemble" );
-	reference_ens = initial_ens.clone();
+	reference_ens = initial_ens.cow_clone();
 	DEBUG_OUTPUT(1, "Reference integration" );
 	prepare_integrator();
 	integ->set_ensemble( reference_ens );
@@ -242,8 +361,9 @@ void output_test() {
 		ERROR("you should have a tested input file");
 	}
 
-	DEBUG_OUTPUT(2, "Make a copy of ensemble for energy conservation test" );
-	current_ens = initial_ens.clone();
+	DEBUG_OUTPUT(2, "Record the initial energies for energy conservation test" );
+	initial_energy = energy_baseline(initial_ens);
+	current_ens = initial_ens;
 
 	prepare_integrator();
 
@@ -282,13 +402,14 @@ void benchmark_item(const string& param, const string& value) {
 		load_generate_ensemble();
 
 	DEBUG_OUTPUT(2, "Make a copy of ensemble for energy conservation test" );
-	current_ens = initial_ens.clone();
+	initial_energy = energy_baseline(initial_ens);
+	current_ens = initial_ens.cow_clone();
 
 	double init_time = watch_time( prepare_integrator );
 
 	double integration_time = watch_time( generic_integrate );
 
-	double max_deltaE = find_max_energy_conservation_error(current_ens, initial_ens );
+	double max_deltaE = initial_energy.max_error(current_ens);
 
 	// Compare with reneference ensemble for integrator verification
 	double pos_diff = 0, vel_diff = 0, time_diff = 0;
@@ -447,6 +568,10 @@ void parse_commandline_and_config(int argc, char* argv[]){
 			"\ttest      :  Test a configuration against input/output files\n"
 			"\tgenerate  :  Generate a new ensemble and save it to output file\n"
 			"\tconvert   :  Read input file and write it to output file (converts to/from text)\n"
+			"\tresume    :  Continue an integration from the checkpoint file\n"
+			"\tshard     :  Integrate with several worker processes (shard_processes)\n"
+			"\tsplit     :  Split the input file into pieces output.0, output.1, ...\n"
+			"\tmerge     :  Merge the pieces input.0, input.1, ... (and their logs) into output\n"
 			"\nOptions"
 		);
 
@@ -652,6 +777,30 @@ int main(int argc, char* argv[]){
 		save_ensemble();
 	} 
 	
+	else if(command == "resume" ) {
+		if(!cfg.valid("checkpoint_file")) {
+			cerr << "Name of the checkpoint file (checkpoint_file) is missing \n"; return 1;
+		}
+		INFO_OUTPUT(1, "Resuming from checkpoint " << cfg["checkpoint_file"] << endl);
+		cfg["input"] = cfg["checkpoint_file"];
+		init_cuda();
+		run_integration();
+	}
+
+	else if(command == "shard" ) {
+		// CUDA is not initialized, the worker processes are forked
+		runtime::instance().configure(cfg);
+		run_multiprocess_integration();
+	}
+
+	else if(command == "split" ) {
+		split_ensemble();
+	}
+
+	else if(command == "merge" ) {
+		merge_ensembles();
+	}
+
 	else if(command == "convert" ) {
 		if( read_input_file(current_ens,cfg) && save_ensemble() ) {
 			INFO_OUTPUT(1,"Converted!");
@@ -662,7 +811,7 @@ int main(int argc, char* argv[]){
 	} 
 	
 	else
-		std::cerr << "Valid commands are: integrate, benchmark, verify, test, query, generate " << std::endl;
+		std::cerr << "Valid commands are: integrate, benchmark, verify, test, query, generate, convert, resume, shard, split, merge " << std::endl;
 
 	return 0;
 }
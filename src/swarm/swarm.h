@@ -35,6 +35,8 @@
 #include "utils.hpp"
 #include "gpu/device_settings.hpp"
 #include "snapshot.hpp"
+#include "runtime.hpp"
+#include "diagnostics.hpp"
 
 /*! Swarm-NG library
  *
@@ -74,6 +76,9 @@ inline void init(const config &cfg) {
 
 	/// initialize the config
 	swarm::log::manager::default_log()->init(cfg);
+
+	/// start the worker threads for CPU integrators
+	runtime::instance().configure(cfg);
 }
 
 
@@ -38,6 +38,7 @@
  *
  *  Current allocators are:
  *   - C++ new/delete
+ *   - NUMA-aware host memory, placed by the CPU worker threads
  *   - CUDA [GPU] device memory 
  *   - CUDA host memory
  *   - CUDA device-mapped host memory
@@ -45,6 +46,30 @@
  */
 
 #pragma once
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+
+namespace swarm {
+	/*! Zero an array of count elements of element_size bytes using the
+	 *  worker threads of swarm::runtime. The array is made of ensemble
+	 *  chunks of per_chunk elements each, and the chunks are split between
+	 *  the threads like runtime::integrate_systems splits them, so every
+	 *  thread writes to the part of the array that it will later integrate
+	 *  and on NUMA systems the memory pages are placed on the node of that
+	 *  thread (first touch). Implemented in runtime.cpp.
+	 */
+	void first_touch(void* p, const size_t& element_size, const size_t& count, const size_t& per_chunk = 1);
+
+	/*! Map whole pages for an array of size bytes, or return NULL. The
+	 *  array is page aligned and no other data shares its pages, so they
+	 *  can be remapped in place, c.f. EnsembleAlloc::cow_clone. Release it
+	 *  with page_free. Implemented in ensemble_alloc.cpp.
+	 */
+	void* page_alloc(const size_t& size);
+	//! Unmap an array allocated by page_alloc
+	void page_free(void* p);
+}
 
 //! Default allocator that uses C++ new/delete
 //! This class uses standard C++ routines for allocation
@@ -66,6 +91,35 @@ struct DefaultAllocator {
 	}
 };
 
+//! NUMA-aware host memory allocator
+//! Memory is mapped in whole pages (swarm::page_alloc) and is first written by the worker threads
+//! of swarm::runtime, following the same partition that the CPU integrators
+//! use. On Linux this places every page on the NUMA node of the thread
+//! that integrates the systems stored in it. The memory is zero-initialized.
+template< class T >
+struct NumaAllocator {
+	typedef T Elem;
+	static void free(T * p) { swarm::page_free(p); }
+	//! Allocate s elements, per_chunk of which belong to one ensemble chunk, c.f. swarm::first_touch
+	static T *  alloc(size_t s, size_t per_chunk = 1) {
+		void* p = swarm::page_alloc(std::max(s,(size_t)1) * sizeof(T));
+		if( p == NULL )
+			throw std::bad_alloc();
+		swarm::first_touch(p, sizeof(T), s, per_chunk);
+		return (T*)p;
+	}
+
+	static void copy( T* begin, T* end, T* dst ) {
+		std::copy ( begin, end, dst );
+	}
+
+	static T* clone (T* begin, T* end)  { 
+		T* p = alloc( end - begin );
+		copy( begin, end, p );
+		return p;
+	}
+};
+
 //! CUDA device memory allocator that uses cudaMalloc,cudaMemcpy,cudaFree
 //! It creates a pointer that is allocated on the device. The pointer
 //! cannot be used by the caller and should only be passed to a CUDA 
@@ -146,6 +200,26 @@ struct MappedHostAllocator : public HostAllocator<T> {
 };
 
 
+//! Allocate the array of an ensemble, count elements of which per_chunk
+//! belong to one ensemble chunk. Only the NUMA-aware allocator uses the layout.
+template< class A >
+typename A::Elem* alloc_chunks(A, const size_t& count, const size_t& per_chunk){
+	return A::alloc(count);
+}
+
+//! Allocate the array of an ensemble so that its chunks are first touched by the threads that integrate them
+template< class T >
+T* alloc_chunks(NumaAllocator<T>, const size_t& count, const size_t& per_chunk){
+	return NumaAllocator<T>::alloc(count, per_chunk);
+}
+
+//! Whether the arrays of an allocator come from swarm::page_alloc
+template< class A >
+bool page_allocated(A){ return false; }
+
+template< class T >
+bool page_allocated(NumaAllocator<T>){ return true; }
+
 //! Simple copy between the same allocator. Uses the copy
 //! method of the allocator.
 template< class A, class T> 
@@ -165,3 +239,27 @@ void alloc_copy(DeviceAllocator<T>,DefaultAllocator<T>, T* begin, T* end, T* dst
 	cudaMemcpy(dst, begin, (end-begin)*sizeof(T), cudaMemcpyDeviceToHost);
 }
 
+//! Copy from NUMA-aware host memory to device memory
+template< class T>
+void alloc_copy(NumaAllocator<T>,DeviceAllocator<T>, T* begin, T* end, T* dst){
+	cudaMemcpy(dst, begin, (end-begin)*sizeof(T), cudaMemcpyHostToDevice);
+}
+
+//! Copy from device memory to NUMA-aware host memory
+template< class T>
+void alloc_copy(DeviceAllocator<T>,NumaAllocator<T>, T* begin, T* end, T* dst){
+	cudaMemcpy(dst, begin, (end-begin)*sizeof(T), cudaMemcpyDeviceToHost);
+}
+
+//! Copy from host memory to NUMA-aware host memory
+template< class T>
+void alloc_copy(DefaultAllocator<T>,NumaAllocator<T>, T* begin, T* end, T* dst){
+	std::copy(begin, end, dst);
+}
+
+//! Copy from NUMA-aware host memory to host memory
+template< class T>
+void alloc_copy(NumaAllocator<T>,DefaultAllocator<T>, T* begin, T* end, T* dst){
+	std::copy(begin, end, dst);
+}
+
@@ -24,6 +24,8 @@
  */
 #include "common.hpp"
 #include "utils.hpp"
+#include "runtime.hpp"
+#include "diagnostics.hpp"
 
 using std::max;
 using namespace swarm;
@@ -106,18 +108,23 @@ double find_max_energy_conservation_error(ensemble& ens, ensemble& reference_ens
     return energy_conservation_error_range(ens,reference_ensemble).max;
 }
 ensemble::range_t energy_conservation_error_range(ensemble& ens, ensemble& reference_ensemble ) {
-	std::vector<double> 
-            energy_init(reference_ensemble.nsys())
-            ,energy_final(ens.nsys())
-            ,deltaE(ens.nsys());
+	return energy_baseline(reference_ensemble).error_range(ens);
+}
 
-	reference_ensemble.calc_total_energy(&energy_init[0]);
-	ens.calc_total_energy(&energy_final[0]);
+energy_baseline::energy_baseline(ensemble& ens):_initial(ens){}
 
-	for(int sysid=0;sysid<ens.nsys();++sysid)
-		deltaE[sysid] =  fabs ((energy_final[sysid]-energy_init[sysid])/energy_init[sysid] ) ;
+ensemble::range_t energy_baseline::error_range(ensemble& ens) const {
+	if(ens.nsys() != nsys())
+		ERROR("The ensemble does not match the energy baseline");
+	return ensemble_diagnostics(ens).energy_error(_initial);
+}
 
-        return ensemble::range_t::calculate( deltaE.begin(), deltaE.end() );
+ensemble::range_t system_attribute_range(ensemble& ens, const int& attribute){
+	if(ens.nsys() == 0) return ensemble::range_t(0, 0, 0, 0);
+	std::vector<double> v(ens.nsys());
+	for(int i = 0; i < ens.nsys(); i++)
+		v[i] = ens[i].attribute(attribute);
+	return ensemble::range_t::calculate( v.begin(), v.end() );
 }
 
 
@@ -167,49 +174,59 @@ std::ostream& operator << (std::ostream& o, const swarm::ensemble::range_t& r){
 		return o << r.median << "[" << (r.min-r.median) << "," << (r.max-r.median) << "] ";
 }
 
+//! Largest differences of the systems of every ensemble chunk, c.f. compare_ensembles
+struct compare_task : public runtime::task {
+	ensemble &e1, &e2;
+	double *pos_diff, *vel_diff, *time_diff;
+	compare_task(ensemble& e1, ensemble& e2, double* p, double* v, double* t)
+		:e1(e1),e2(e2),pos_diff(p),vel_diff(v),time_diff(t){}
+
+	void operator()(const int& begin, const int& end, scratch_arena&){
+		const int CS = ensemble::CHUNK_SIZE;
+		for(int c = begin; c < end; c++) {
+			double dp_max = 0, dv_max = 0, dt_max = 0;
+			for(int i = c * CS; i < std::min((c + 1) * CS, e1.nsys()); i++) {
+				for(int j = 0; j < e1.nbod() ; j++){
+
+					// Distance between body position in ensemble e1 and e2
+					double dp = sqrt( 
+							  square ( e1[i][j][0].pos() - e2[i][j][0].pos() ) 
+							+ square ( e1[i][j][1].pos() - e2[i][j][1].pos() ) 
+							+ square ( e1[i][j][2].pos() - e2[i][j][2].pos() ) ) ;
+
+					// Difference between body velocities in ensemble e1 and e2
+					double dv = sqrt( 
+							  square ( e1[i][j][0].vel() - e2[i][j][0].vel() ) 
+							+ square ( e1[i][j][1].vel() - e2[i][j][1].vel() ) 
+							+ square ( e1[i][j][2].vel() - e2[i][j][2].vel() ) ) ;
+
+					if ( dp > dp_max ) dp_max = dp;
+					if ( dv > dv_max ) dv_max = dv;
+				}
+
+				// Difference between time divided by average of the two
+				double dt = fabs(e1[i].time() - e2[i].time())
+					/(e1[i].time() + e2[i].time())*2;
+				if ( dt > dt_max ) dt_max = dt;
+			}
+			pos_diff[c] = dp_max, vel_diff[c] = dv_max, time_diff[c] = dt_max;
+		}
+	}
+};
+
 bool compare_ensembles( swarm::ensemble& e1, swarm::ensemble &e2 , double & pos_diff, double & vel_diff, double & time_diff ) {
 	if (e1.nsys() != e2.nsys() || e1.nbod() != e2.nbod() ) return false;
 
 	pos_diff = vel_diff = time_diff = 0;
+	if (e1.nsys() == 0) return true;
 
-	for(int i = 0; i < e1.nsys(); i++) {
-		for(int j = 0; j < e1.nbod() ; j++){
-
-			// Distance between body position in ensemble e1 and e2
-			double dp = sqrt( 
-					  square ( e1[i][j][0].pos() - e2[i][j][0].pos() ) 
-					+ square ( e1[i][j][1].pos() - e2[i][j][1].pos() ) 
-					+ square ( e1[i][j][2].pos() - e2[i][j][2].pos() ) ) ;
-
-			// Average magnitude of the position in e1 and e2
-			double ap = sqrt( 
-					  square ( e1[i][j][0].pos() + e2[i][j][0].pos() ) 
-					+ square ( e1[i][j][1].pos() + e2[i][j][1].pos() ) 
-					+ square ( e1[i][j][2].pos() + e2[i][j][2].pos() ) ) / 2.0 ;
-
-			// Difference between body velocities in ensemble e1 and e2
-			double dv = sqrt( 
-					  square ( e1[i][j][0].vel() - e2[i][j][0].vel() ) 
-					+ square ( e1[i][j][1].vel() - e2[i][j][1].vel() ) 
-					+ square ( e1[i][j][2].vel() - e2[i][j][2].vel() ) ) ;
+	const int chunks = (e1.nsys() + ensemble::CHUNK_SIZE - 1) / ensemble::CHUNK_SIZE;
+	std::vector<double> p(chunks), v(chunks), t(chunks);
+	compare_task task(e1, e2, &p[0], &v[0], &t[0]);
+	runtime::instance().parallel_for(chunks, task);
 
-			// Average magnitude of the velocity in e1 and e2
-			double av = sqrt( 
-					  square ( e1[i][j][0].vel() + e2[i][j][0].vel() ) 
-					+ square ( e1[i][j][1].vel() + e2[i][j][1].vel() ) 
-					+ square ( e1[i][j][2].vel() + e2[i][j][2].vel() ) ) / 2.0 ;
-
-			if ( dp > pos_diff ) pos_diff = dp;
-			if ( dv > vel_diff ) vel_diff = dv;
-
-		}
-
-		// Difference between time divided by average of the two
-		double dt = fabs(e1[i].time() - e2[i].time())
-			/(e1[i].time() + e2[i].time())*2;
-		if ( dt > time_diff ) time_diff = dt;
-
-	}
+	pos_diff = *std::max_element(p.begin(), p.end());
+	vel_diff = *std::max_element(v.begin(), v.end());
+	time_diff = *std::max_element(t.begin(), t.end());
 	return true;
 }
-
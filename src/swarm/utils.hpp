@@ -30,6 +30,7 @@
 #include "types/ensemble.hpp"
 #include "ensemble_alloc.hpp"
 #include "types/config.hpp"
+#include "diagnostics.hpp"
 #include <ostream>
 
 /**
@@ -93,6 +94,45 @@ double find_max_energy_conservation_error
 
         swarm::ensemble::range_t energy_conservation_error_range(swarm::ensemble& ens, swarm::ensemble& reference_ensemble ) ;
 
+/**
+ * Total energy of every system of an ensemble at one time, usually the
+ * initial conditions. Checking energy conservation against a baseline
+ * needs a few numbers per system instead of a full copy of the ensemble.
+ * The energies are computed by \ref swarm::ensemble_diagnostics, which also
+ * keeps the angular momentum and barycenter for other checks.
+ * Systems are matched by their index in the ensemble.
+ */
+class energy_baseline {
+	public:
+	energy_baseline(){}
+
+	//! Record the total energy of every system of ens
+	explicit energy_baseline(swarm::ensemble& ens);
+
+	int nsys() const { return _initial.nsys(); }
+
+	//! Recorded total energy of system i
+	const double& operator[] (const int& i) const { return _initial.energy(i); }
+
+	//! All the quantities recorded for the systems
+	const swarm::ensemble_diagnostics& diagnostics() const { return _initial; }
+
+	//! Relative energy conservation errors of the systems of ens
+	swarm::ensemble::range_t error_range(swarm::ensemble& ens) const;
+
+	//! Worst relative energy conservation error among the systems of ens
+	double max_error(swarm::ensemble& ens) const { return error_range(ens).max; }
+
+	private:
+	swarm::ensemble_diagnostics _initial;
+};
+
+/**
+ * Statistics of one attribute of all systems of an ensemble, e.g. an
+ * error maintained by the integrator (c.f. swarm::conservation_tracker).
+ */
+swarm::ensemble::range_t system_attribute_range(swarm::ensemble& ens, const int& attribute);
+
 /**
  * Pretty print selected values in a config data structure
  *